@@ -0,0 +1,475 @@
+// SPDX-License-Identifier: MIT
+#ifndef ADMISSION_H_17_10_2026
+#define ADMISSION_H_17_10_2026
+
+#include <array>
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+class ADMISSION {
+    // Decides whether a freshly accepted connection is let in before any
+    // memory is set aside for it. Every kind of listener can be capped in the
+    // number of its connections and in the number of its connections from any
+    // single source, where the sources are told apart by a prefix of their
+    // address. The live counts of the sources are kept in an open addressing
+    // table of compact slots that only holds the sources currently connected.
+    //
+    // The sources can also be limited in the rate of their connections by
+    // token buckets. The buckets are kept in a table of a fixed size where
+    // every source hashes to a set of two buckets, and a newcomer takes over
+    // the bucket of the set that was used the longest time ago.
+
+    public:
+    enum class LISTENER : uint8_t {
+        SUPPLY        = 0,
+        DEMAND        = 1,
+        DRIVER        = 2,
+        STATS         = 3,
+        MAX_LISTENERS = 4
+    };
+
+    static constexpr const size_t COUNT{
+        static_cast<size_t>(LISTENER::MAX_LISTENERS)
+    };
+
+    static constexpr const size_t MIN_SLOTS = 1024;
+    static constexpr const size_t RATE_SETS = 2048;
+    static constexpr const size_t RATE_WAYS = 2;
+    static constexpr const uint64_t TOKEN   = 1000000; // Microseconds.
+
+    struct rule_type {
+        uint32_t total;      // Connections of the listener, zero for no cap.
+        uint32_t per_source; // Connections from one source, zero for no cap.
+        uint8_t prefix4;     // Bits of an IPv4 address naming the source.
+        uint8_t prefix6;     // Bits of an IPv6 address naming the source.
+        uint32_t rate;       // Connections per second from one source.
+        uint32_t burst;      // Connections from one source in a burst.
+    };
+
+    struct counts_type {
+        uint64_t live;        // Connections admitted and not yet closed.
+        uint64_t over_total;  // Connections rejected by the cap of the total.
+        uint64_t over_source; // Connections rejected by the cap of a source.
+        uint64_t over_rate;   // Connections rejected by the rate of a source.
+    };
+
+    ADMISSION() : rules{}, counts{}, used(0), evictions(0) {
+        for (rule_type &rule : rules) rule = {0, 0, 32, 128, 0, 0};
+        for (int &descriptor : descriptors) descriptor = -1;
+    }
+
+    ~ADMISSION() {}
+
+    inline void bind(LISTENER listener, int descriptor) {
+        descriptors[static_cast<size_t>(listener)] = descriptor;
+    }
+
+    inline bool admit(
+        int listener, const sockaddr *address, long long usec, uint64_t &key
+    ) {
+        // Returns false if the connection accepted by the given listener at
+        // the given time in microseconds is to be rejected. Otherwise the
+        // connection is counted and the key of its source is returned for
+        // releasing it later.
+
+        key = 0;
+
+        size_t index = index_of(listener);
+
+        if (index == COUNT) return true;
+
+        const rule_type &rule = rules[index];
+        counts_type &count = counts[index];
+        uint64_t source = 0;
+
+        if (rule.rate) {
+            // Every connection takes a token, even if it is then rejected by
+            // a cap, since the rate limits the attempts to connect.
+
+            source = key_of(index, address, rule);
+
+            if (!take_token(source, rule, usec)) {
+                ++count.over_rate;
+                return false;
+            }
+        }
+
+        if (rule.total && count.live >= rule.total) {
+            ++count.over_total;
+            return false;
+        }
+
+        if (rule.per_source) {
+            if (!source) source = key_of(index, address, rule);
+
+            slot_type &slot = insert(source);
+
+            if (slot.count >= rule.per_source) {
+                ++count.over_source;
+                return false;
+            }
+
+            if (slot.count++ == 0) ++used;
+
+            key = source;
+        }
+
+        ++count.live;
+
+        return true;
+    }
+
+    inline void release(int listener, uint64_t key) {
+        size_t index = index_of(listener);
+
+        if (index == COUNT) return;
+
+        if (counts[index].live) --counts[index].live;
+
+        if (!key) return;
+
+        slot_type *slot = find(key);
+
+        if (slot && slot->count && --slot->count == 0) {
+            erase(slot);
+            --used;
+        }
+    }
+
+    inline const counts_type &get_counts(LISTENER listener) const {
+        return counts[static_cast<size_t>(listener)];
+    }
+
+    inline size_t get_sources() const {
+        return used;
+    }
+
+    inline size_t get_evictions() const {
+        return evictions;
+    }
+
+    inline size_t get_memory() const {
+        return (
+            slots.capacity() * sizeof(slot_type) +
+            buckets.capacity() * sizeof(bucket_type)
+        );
+    }
+
+    inline bool configure(const char *text) {
+        // Parses a rule given as listener=total[,source[,prefix4[,prefix6]]]
+        // where the source is the cap of the connections from one source and
+        // the prefixes are the lengths of the address prefixes that name a
+        // source. Returns false if the rule is invalid.
+
+        unsigned long values[4];
+        const unsigned long limits[]{ UINT32_MAX, UINT32_MAX, 32, 128 };
+        size_t index = COUNT;
+        size_t parsed = parse(text, index, values, limits, 4);
+
+        if (!parsed) return false;
+
+        rule_type &rule = rules[index];
+
+        values[1] = parsed > 1 ? values[1] : rule.per_source;
+        values[2] = parsed > 2 ? values[2] : rule.prefix4;
+        values[3] = parsed > 3 ? values[3] : rule.prefix6;
+
+        rule.total = uint32_t(values[0]);
+        rule.per_source = uint32_t(values[1]);
+        rule.prefix4 = uint8_t(values[2]);
+        rule.prefix6 = uint8_t(values[3]);
+
+        return true;
+    }
+
+    inline bool configure_rate(const char *text) {
+        // Parses a rule given as listener=rate[,burst] where the rate is the
+        // number of connections per second allowed from one source and the
+        // burst is the number of them allowed at once, the rate by default.
+        // The sources are named by the prefixes of the listener's caps.
+
+        unsigned long values[2];
+        const unsigned long limits[]{ UINT32_MAX, UINT32_MAX };
+        size_t index = COUNT;
+        size_t parsed = parse(text, index, values, limits, 2);
+
+        if (!parsed) return false;
+
+        rule_type &rule = rules[index];
+
+        if (parsed < 2 || values[1] == 0) values[1] = values[0];
+
+        rule.rate = uint32_t(values[0]);
+        rule.burst = uint32_t(values[1]);
+
+        if (rule.rate && buckets.empty()) {
+            buckets.assign(RATE_SETS * RATE_WAYS, bucket_type{0, 0, 0});
+        }
+
+        return true;
+    }
+
+    static inline const char *listener_name(LISTENER listener) {
+        switch (listener) {
+            case LISTENER::SUPPLY: return "supply";
+            case LISTENER::DEMAND: return "demand";
+            case LISTENER::DRIVER: return "driver";
+            case LISTENER::STATS:  return "stats";
+            default:               break;
+        }
+
+        return "unknown";
+    }
+
+    private:
+    struct slot_type {
+        uint64_t key;   // Zero for an empty slot.
+        uint64_t count; // Zero for a slot claimed but not yet counted.
+    };
+
+    struct bucket_type {
+        uint64_t key;   // Zero for a bucket not used yet.
+        uint64_t tokens;// Millionths of a token.
+        long long used; // Time of the latest token taken, in microseconds.
+    };
+
+    static inline size_t parse(
+        const char *text, size_t &index, unsigned long *values,
+        const unsigned long *limits, size_t count
+    ) {
+        // Parses the name of a listener followed by up to the given number of
+        // values separated by commas. Returns the number of values parsed, or
+        // zero if the text is invalid.
+
+        const char *value = strchr(text, '=');
+
+        if (!value) return 0;
+
+        size_t length = size_t(value - text);
+
+        for (index = 0; index < COUNT; ++index) {
+            const char *name = listener_name(static_cast<LISTENER>(index));
+
+            if (strlen(name) == length && !strncmp(text, name, length)) break;
+        }
+
+        if (index == COUNT) return 0;
+
+        char *end = const_cast<char *>(value);
+        size_t parsed = 0;
+
+        while (parsed < count) {
+            const char *start = end + 1;
+
+            values[parsed] = strtoul(start, &end, 10);
+
+            if (end == start || values[parsed] > limits[parsed]) return 0;
+
+            ++parsed;
+
+            if (*end != ',') break;
+        }
+
+        return *end == '\0' ? parsed : 0;
+    }
+
+    inline bool take_token(
+        uint64_t key, const rule_type &rule, long long usec
+    ) {
+        // A source that is not in its set takes over the least recently used
+        // bucket of the set with a full burst of tokens.
+
+        bucket_type *set = &buckets[size_t(key >> 32) % RATE_SETS * RATE_WAYS];
+        bucket_type *bucket = set;
+
+        for (size_t i=0; i<RATE_WAYS; ++i) {
+            if (set[i].key == key) {
+                bucket = &set[i];
+                break;
+            }
+
+            if (set[i].used < bucket->used) bucket = &set[i];
+        }
+
+        uint64_t burst = uint64_t(rule.burst) * TOKEN;
+
+        if (bucket->key != key) {
+            if (bucket->key) ++evictions;
+
+            bucket->key = key;
+            bucket->tokens = burst;
+        }
+        else if (usec > bucket->used && bucket->tokens < burst) {
+            // The elapsed time is compared before it is multiplied, so that
+            // a long silence would not overflow the tokens.
+
+            uint64_t elapsed = uint64_t(usec - bucket->used);
+            uint64_t missing = burst - bucket->tokens;
+
+            if (elapsed > missing / rule.rate) bucket->tokens = burst;
+            else bucket->tokens += elapsed * rule.rate;
+        }
+
+        bucket->used = usec;
+
+        if (bucket->tokens < TOKEN) return false;
+
+        bucket->tokens -= TOKEN;
+
+        return true;
+    }
+
+    inline size_t index_of(int listener) const {
+        size_t index = 0;
+
+        while (index < COUNT && descriptors[index] != listener) ++index;
+
+        return index;
+    }
+
+    static inline uint64_t mix(uint64_t hash) {
+        // The finalizer of MurmurHash3.
+
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdULL;
+        hash ^= hash >> 33;
+        hash *= 0xc4ceb9fe1a85ec53ULL;
+        hash ^= hash >> 33;
+
+        return hash;
+    }
+
+    static inline uint64_t fold(
+        const uint8_t *bytes, size_t size, size_t bits
+    ) {
+        // Hashes the given number of leading bits of an address, leaving out
+        // the rest of it.
+
+        uint64_t hash = 0;
+
+        for (size_t i=0; i<size; i+=8) {
+            uint64_t word = 0;
+
+            for (size_t j=i; j<i+8 && j<size; ++j) {
+                uint8_t byte = uint8_t(
+                    bits >= 8 ? bytes[j] : bytes[j] & ~(0xff >> bits)
+                );
+
+                bits = bits >= 8 ? bits - 8 : 0;
+                word = word << 8 | byte;
+            }
+
+            hash = mix(hash ^ word);
+        }
+
+        return hash;
+    }
+
+    static inline uint64_t key_of(
+        size_t index, const sockaddr *address, const rule_type &rule
+    ) {
+        // The key names the listener along with the source, so that every
+        // listener counts its sources apart from the others.
+
+        uint64_t key = mix(uint64_t(index) + 1);
+
+        if (address->sa_family == AF_INET) {
+            const sockaddr_in *in = reinterpret_cast<const sockaddr_in *>(
+                address
+            );
+
+            key ^= fold(
+                reinterpret_cast<const uint8_t *>(&in->sin_addr),
+                sizeof(in->sin_addr), rule.prefix4
+            );
+        }
+        else if (address->sa_family == AF_INET6) {
+            const sockaddr_in6 *in6 = reinterpret_cast<const sockaddr_in6 *>(
+                address
+            );
+
+            key ^= fold(
+                in6->sin6_addr.s6_addr, sizeof(in6->sin6_addr.s6_addr),
+                rule.prefix6
+            );
+        }
+
+        return key ? key : 1;
+    }
+
+    inline slot_type *find(uint64_t key) {
+        // Linear probing from the slot the key hashes to.
+
+        if (slots.empty()) return nullptr;
+
+        size_t mask = slots.size() - 1;
+
+        for (size_t i = size_t(key) & mask; slots[i].key; i = (i + 1) & mask) {
+            if (slots[i].key == key) return &slots[i];
+        }
+
+        return nullptr;
+    }
+
+    inline slot_type &insert(uint64_t key) {
+        // Returns the slot of the given key, claiming an empty one for it if
+        // needed. The table is kept at most half full.
+
+        if ((used + 1) * 2 > slots.size()) grow();
+
+        size_t mask = slots.size() - 1;
+        size_t i = size_t(key) & mask;
+
+        while (slots[i].key && slots[i].key != key) i = (i + 1) & mask;
+
+        slots[i].key = key;
+
+        return slots[i];
+    }
+
+    inline void erase(slot_type *slot) {
+        // The slots following the erased one are shifted back into the gap
+        // for as long as that brings them closer to where they hash to, which
+        // keeps the probe sequences unbroken without any tombstones.
+
+        size_t mask = slots.size() - 1;
+        size_t gap = size_t(slot - slots.data());
+
+        for (size_t i = (gap + 1) & mask; slots[i].key; i = (i + 1) & mask) {
+            size_t home = size_t(slots[i].key) & mask;
+
+            if (((i - home) & mask) >= ((i - gap) & mask)) {
+                slots[gap] = slots[i];
+                gap = i;
+            }
+        }
+
+        slots[gap] = {0, 0};
+    }
+
+    inline void grow() {
+        std::vector<slot_type> old(
+            slots.empty() ? MIN_SLOTS : slots.size() * 2, slot_type{0, 0}
+        );
+
+        old.swap(slots);
+
+        for (const slot_type &slot : old) {
+            if (slot.key) insert(slot.key).count = slot.count;
+        }
+    }
+
+    std::array<rule_type, COUNT> rules;
+    std::array<counts_type, COUNT> counts;
+    std::array<int, COUNT> descriptors;
+    std::vector<slot_type> slots;
+    std::vector<bucket_type> buckets;
+    size_t used;
+    size_t evictions;
+};
+
+#endif
@@ -0,0 +1,71 @@
+// SPDX-License-Identifier: MIT
+#include "allocs.h"
+
+#ifdef TCPHERALD_COUNT_ALLOCS
+
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <malloc.h>
+
+static std::atomic<uint64_t> allocations{0};
+
+extern "C" {
+    // The allocator of the C library remains available under these names,
+    // which lets the interposed functions below hand every request over to
+    // it. The operator new of the C++ library ends up in malloc too.
+
+    void *__libc_malloc(size_t);
+    void *__libc_calloc(size_t, size_t);
+    void *__libc_realloc(void *, size_t);
+    void *__libc_memalign(size_t, size_t);
+
+    void *malloc(size_t size) {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+        return __libc_malloc(size);
+    }
+
+    void *calloc(size_t count, size_t size) {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+        return __libc_calloc(count, size);
+    }
+
+    void *realloc(void *pointer, size_t size) {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+        return __libc_realloc(pointer, size);
+    }
+
+    void *memalign(size_t alignment, size_t size) {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+        return __libc_memalign(alignment, size);
+    }
+
+    void *aligned_alloc(size_t alignment, size_t size) {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+        return __libc_memalign(alignment, size);
+    }
+
+    int posix_memalign(void **pointer, size_t alignment, size_t size) {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+
+        void *memory = __libc_memalign(alignment, size);
+
+        if (!memory) return ENOMEM;
+
+        *pointer = memory;
+
+        return 0;
+    }
+}
+
+uint64_t ALLOCS::count() {
+    return allocations.load(std::memory_order_relaxed);
+}
+
+#else
+
+uint64_t ALLOCS::count() {
+    return 0;
+}
+
+#endif
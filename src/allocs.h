@@ -0,0 +1,23 @@
+// SPDX-License-Identifier: MIT
+#ifndef ALLOCS_H_17_10_2026
+#define ALLOCS_H_17_10_2026
+
+#include <cstdint>
+
+class ALLOCS {
+    // Counts the heap allocations made by the whole process. The counting is
+    // only compiled in when TCPHERALD_COUNT_ALLOCS is defined, in which case
+    // malloc and its kin are interposed in front of the C library. Otherwise
+    // the count is always zero.
+
+    public:
+#ifdef TCPHERALD_COUNT_ALLOCS
+    static constexpr const bool ENABLED = true;
+#else
+    static constexpr const bool ENABLED = false;
+#endif
+
+    static uint64_t count();
+};
+
+#endif
@@ -0,0 +1,335 @@
+// SPDX-License-Identifier: MIT
+#ifndef APPENDER_H_17_10_2026
+#define APPENDER_H_17_10_2026
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <csignal>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <errno.h>
+
+class APPENDER {
+    // The appender writes fixed-size records to the end of a file that begins
+    // with a header identifying the format. The records are buffered in memory
+    // and handed over in batches to a background thread that writes them out,
+    // so that the event loop never waits for the disk. A batch that could not
+    // be written in full is cut back to the last whole record, so that the
+    // file always remains readable, and is tried again with the next batch.
+    // The records are never dropped for the writer being slow: the buffer
+    // grows instead. Should the file fail to be cut back, nothing more is
+    // written to it.
+
+    public:
+    static constexpr const size_t BUFFER_SIZE = 64 * 1024;
+
+    APPENDER(
+        void (*log_fun) (const char *, const char *, ...) =drop_log,
+        const char *log_src ="Appender"
+    ) : descriptor (-1)
+      , file_size  (0)
+      , record_size(1)
+      , stopping   (false)
+      , ready      (false)
+      , writing    (false)
+      , broken     (false)
+      , error      (0)
+      , lost       (0)
+      , logfrom    (log_src)
+      , log        (log_fun)
+    {}
+
+    ~APPENDER() {}
+
+    inline bool init(
+        const char *path, const void *header, size_t header_size,
+        size_t rec_size
+    ) {
+        // The header is only written to an empty file. A file that does not
+        // hold a header and whole records is refused.
+
+        record_size = rec_size;
+
+        descriptor = open(
+            path, O_WRONLY|O_APPEND|O_CREAT|O_CLOEXEC, S_IRUSR|S_IWUSR|S_IRGRP
+        );
+
+        if (descriptor == -1) {
+            log(logfrom.c_str(), "%s: %s", path, strerror(errno));
+            return false;
+        }
+
+        buffer.reserve(BUFFER_SIZE);
+        batch.reserve(BUFFER_SIZE);
+
+        off_t size = lseek(descriptor, 0, SEEK_END);
+
+        if (size == -1) {
+            log(logfrom.c_str(), "lseek: %s", strerror(errno));
+            return false;
+        }
+
+        if (size != 0
+        && (size_t(size) < header_size
+        || (size_t(size) - header_size) % record_size)) {
+            log(
+                logfrom.c_str(), "%s: unexpected size of %lld bytes", path,
+                (long long) size
+            );
+
+            return false;
+        }
+
+        file_size = size_t(size);
+
+        if (size == 0
+        && !write_out(static_cast<const uint8_t *>(header), header_size)) {
+            log(logfrom.c_str(), "write: %s", strerror(errno));
+            return false;
+        }
+
+        // The writer must never receive the signals meant for the event loop,
+        // so it starts with all of them blocked.
+
+        sigset_t sigset_all;
+        sigset_t sigset_orig;
+
+        sigfillset(&sigset_all);
+        pthread_sigmask(SIG_SETMASK, &sigset_all, &sigset_orig);
+
+        try {
+            writer = std::thread(&APPENDER::write_loop, this);
+        }
+        catch (...) {
+            pthread_sigmask(SIG_SETMASK, &sigset_orig, nullptr);
+            log(logfrom.c_str(), "%s", "failed to start the writer");
+            return false;
+        }
+
+        pthread_sigmask(SIG_SETMASK, &sigset_orig, nullptr);
+
+        return true;
+    }
+
+    inline bool deinit() {
+        // Waits until every record has been written out.
+
+        flush();
+
+        if (writer.joinable()) {
+            {
+                std::lock_guard<std::mutex> guard(mutex);
+                stopping = true;
+            }
+
+            condition.notify_one();
+            writer.join();
+        }
+
+        // The writer may have left a failed batch behind, or the last records
+        // may not have been handed over. They are given one more try.
+
+        batch.insert(batch.end(), buffer.begin(), buffer.end());
+        buffer.clear();
+
+        if (!batch.empty() && descriptor != -1) {
+            if (!write_out(batch.data(), batch.size())) {
+                error.store(errno, std::memory_order_relaxed);
+                lost.fetch_add(
+                    batch.size() / record_size, std::memory_order_relaxed
+                );
+            }
+
+            batch.clear();
+        }
+
+        bool success = report();
+
+        if (descriptor != -1 && close(descriptor) == -1) {
+            log(logfrom.c_str(), "close: %s", strerror(errno));
+            success = false;
+        }
+
+        descriptor = -1;
+
+        return success;
+    }
+
+    inline void append(const void *data, size_t size) {
+        // Appends whole records. The buffer only grows beyond its size while
+        // the writer is busy.
+
+        if (broken.load(std::memory_order_relaxed)) {
+            lost.fetch_add(size / record_size, std::memory_order_relaxed);
+            return;
+        }
+
+        if (buffer.size() + size > BUFFER_SIZE) flush();
+
+        const uint8_t *bytes = static_cast<const uint8_t *>(data);
+
+        buffer.insert(buffer.end(), bytes, bytes + size);
+    }
+
+    inline bool flush() {
+        // Hands the buffered records over to the writer unless it is still
+        // busy. A batch that failed is handed back along with them. Returns
+        // false if any of the earlier batches failed to be written.
+
+        if (writer.joinable()) {
+            std::unique_lock<std::mutex> lock(mutex, std::try_to_lock);
+
+            if (lock.owns_lock() && !writing
+            && (!buffer.empty() || !batch.empty())) {
+                if (batch.empty()) batch.swap(buffer);
+                else {
+                    batch.insert(batch.end(), buffer.begin(), buffer.end());
+                    buffer.clear();
+                }
+
+                ready = true;
+                lock.unlock();
+                condition.notify_one();
+            }
+        }
+
+        return report();
+    }
+
+    private:
+    static void drop_log(const char *, const char *, ...) {}
+
+    inline bool report() {
+        // Logs the errors of the writer since the previous report.
+
+        int code = error.exchange(0, std::memory_order_relaxed);
+        size_t count = lost.exchange(0, std::memory_order_relaxed);
+
+        if (code) log(logfrom.c_str(), "write: %s", strerror(code));
+
+        if (code && broken.load(std::memory_order_relaxed)) {
+            log(
+                logfrom.c_str(), "%s",
+                "the file could not be cut back to a whole record, no more "
+                "records are written"
+            );
+        }
+
+        if (count) {
+            log(
+                logfrom.c_str(), "%lu record%s lost.", (unsigned long) count,
+                count == 1 ? " was" : "s were"
+            );
+        }
+
+        return !code && !count;
+    }
+
+    inline void write_loop() {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        while (1) {
+            if (!ready) {
+                if (stopping) break;
+
+                condition.wait(lock);
+                continue;
+            }
+
+            // The batch belongs to the writer for as long as it is writing.
+
+            ready = false;
+            writing = true;
+            lock.unlock();
+
+            bool written = write_out(batch.data(), batch.size());
+            int code = errno;
+
+            lock.lock();
+            writing = false;
+
+            if (written) {
+                batch.clear();
+                continue;
+            }
+
+            // A failed batch is kept for the next try unless the file can no
+            // longer be written to.
+
+            error.store(code, std::memory_order_relaxed);
+
+            if (broken.load(std::memory_order_relaxed)) {
+                lost.fetch_add(
+                    batch.size() / record_size, std::memory_order_relaxed
+                );
+                batch.clear();
+            }
+        }
+    }
+
+    inline bool write_out(const uint8_t *bytes, size_t length) {
+        // Writes the given whole records. On failure the file is truncated to
+        // its size before the call and errno is left as it was set by write.
+        // If even that fails, the file is considered broken.
+
+        if (broken.load(std::memory_order_relaxed)) {
+            errno = EIO;
+            return false;
+        }
+
+        size_t written = 0;
+
+        while (written < length) {
+            ssize_t count = write(
+                descriptor, bytes + written, length - written
+            );
+
+            if (count < 0) {
+                if (errno == EINTR) continue;
+
+                int code = errno;
+
+                if (written && ftruncate(descriptor, off_t(file_size)) == -1) {
+                    broken.store(true, std::memory_order_relaxed);
+                }
+
+                errno = code;
+
+                return false;
+            }
+
+            written += size_t(count);
+        }
+
+        file_size += written;
+
+        return true;
+    }
+
+    int descriptor;
+    size_t file_size;
+    size_t record_size;
+    std::vector<uint8_t> buffer;
+    std::vector<uint8_t> batch;
+    std::thread writer;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool stopping;
+    bool ready;   // The batch is waiting for the writer.
+    bool writing; // The writer is busy with the batch.
+    std::atomic<bool> broken;
+    std::atomic<int> error;
+    std::atomic<size_t> lost;
+    std::string logfrom;
+    void (*log)(const char *, const char *p_fmt, ...);
+};
+
+#endif
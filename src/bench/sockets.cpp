@@ -0,0 +1,457 @@
+// SPDX-License-Identifier: MIT
+// Microbenchmarks of the SOCKETS internals. The records are created for fake
+// descriptors without any kernel calls, so that the numbers reflect only the
+// hashing, the flag lists and the buffer handling.
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <getopt.h>
+#include <sched.h>
+#include <time.h>
+
+#include "sockets.h"
+
+struct settings_type {
+    std::vector<size_t> counts; // Connection counts to measure at.
+    std::string filter;         // Substring of the benchmark names to run.
+    size_t rounds;              // Measurements per benchmark.
+    long long round_nsec;       // Minimum duration of one measurement.
+    int cpu;                    // Processor to pin the thread to, or -1.
+};
+
+struct result_type {
+    double median; // Nanoseconds per operation.
+    double min;
+    size_t ops;    // Operations per round.
+};
+
+static uint64_t sink = 0;
+
+static void print_usage(const char *name) {
+    fprintf(
+        stderr,
+        "Usage: %s [options]\n"
+        "Options:\n"
+        "  -c  --cpu           Processor to pin the benchmark to (none).\n"
+        "  -f  --filter        Run only the benchmarks containing this text.\n"
+        "  -h  --help          Display this usage information.\n"
+        "  -n  --counts        Comma separated connection counts\n"
+        "                      (100,1000,10000,100000).\n"
+        "  -r  --rounds        Measurements per benchmark (9).\n"
+        "  -t  --time          Milliseconds per measurement (20).\n",
+        name
+    );
+}
+
+static long long get_nsec() {
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0) return 0;
+
+    return (long long)(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+static uint64_t next_random(uint64_t &state) {
+    // xorshift64*
+
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+
+    return state * 2685821657736338717ULL;
+}
+
+class SOCKETS_BENCH {
+    // Fake descriptor layer. The descriptors are numbered the way the kernel
+    // would number them, starting from the lowest free one, but nothing is
+    // ever opened.
+
+    public:
+    static constexpr const int FIRST_DESCRIPTOR = 5;
+    static constexpr const SOCKETS::FLAG FLAG = SOCKETS::FLAG::READ;
+
+    SOCKETS_BENCH() : sockets(), count(0) {}
+    ~SOCKETS_BENCH() {
+        while (count) {
+            release(FIRST_DESCRIPTOR + int(--count));
+        }
+    }
+
+    inline bool populate(size_t connections) {
+        while (count < connections) {
+            if (!adopt(FIRST_DESCRIPTOR + int(count))) return false;
+
+            ++count;
+        }
+
+        return true;
+    }
+
+    inline bool adopt(int descriptor) {
+        sockets.push(
+            SOCKETS::make_record(descriptor, FIRST_DESCRIPTOR - 1, 1)
+        );
+
+        SOCKETS::record_type *rec = sockets.find_record(descriptor);
+
+        if (!rec) return false;
+
+        rec->incoming = new (std::nothrow) std::vector<uint8_t>;
+        rec->outgoing = new (std::nothrow) std::vector<uint8_t>;
+
+        sockets.account(*rec, true);
+
+        if (!rec->incoming || !rec->outgoing) {
+            sockets.pop(descriptor);
+
+            return false;
+        }
+
+        return true;
+    }
+
+    inline void release(int descriptor) {
+        sockets.pop(descriptor);
+    }
+
+    inline bool find_record(int descriptor) {
+        return sockets.find_record(descriptor) != nullptr;
+    }
+
+    inline bool has_flag(int descriptor) const {
+        return sockets.has_flag(descriptor, FLAG);
+    }
+
+    inline bool set_flag(int descriptor) {
+        return sockets.set_flag(descriptor, FLAG);
+    }
+
+    inline bool rem_flag(int descriptor) {
+        return sockets.rem_flag(descriptor, FLAG);
+    }
+
+    inline bool append_outgoing(
+        int descriptor, const std::vector<uint8_t> &bytes
+    ) {
+        return sockets.append_outgoing(descriptor, bytes);
+    }
+
+    inline bool swap_outgoing(int descriptor, std::vector<uint8_t> &bytes) {
+        return sockets.swap_outgoing(descriptor, bytes);
+    }
+
+    inline bool swap_incoming(int descriptor, std::vector<uint8_t> &bytes) {
+        return sockets.swap_incoming(descriptor, bytes);
+    }
+
+    inline size_t get_count() const {
+        return count;
+    }
+
+    private:
+    SOCKETS sockets;
+    size_t count;
+};
+
+static inline int next_descriptor(const std::vector<int> &order, size_t &at) {
+    int descriptor = order[at];
+
+    if (++at == order.size()) at = 0;
+
+    return descriptor;
+}
+
+struct bench_type {
+    const char *name;
+
+    // Performs the given number of operations on the descriptors in the
+    // given order and returns a value that depends on their results.
+    uint64_t (*run)(
+        SOCKETS_BENCH &, const std::vector<int> &order, size_t ops
+    );
+};
+
+static uint64_t run_find_hit(
+    SOCKETS_BENCH &bench, const std::vector<int> &order, size_t ops
+) {
+    uint64_t found = 0;
+
+    for (size_t i=0, at=0; i<ops; ++i) {
+        found += bench.find_record(next_descriptor(order, at));
+    }
+
+    return found;
+}
+
+static uint64_t run_find_miss(
+    SOCKETS_BENCH &bench, const std::vector<int> &order, size_t ops
+) {
+    uint64_t found = 0;
+    int offset = int(bench.get_count());
+
+    for (size_t i=0, at=0; i<ops; ++i) {
+        found += bench.find_record(next_descriptor(order, at) + offset);
+    }
+
+    return found;
+}
+
+static uint64_t run_has_flag(
+    SOCKETS_BENCH &bench, const std::vector<int> &order, size_t ops
+) {
+    uint64_t found = 0;
+
+    for (size_t i=0, at=0; i<ops; ++i) {
+        found += bench.has_flag(next_descriptor(order, at));
+    }
+
+    return found;
+}
+
+static uint64_t run_set_rem_flag(
+    SOCKETS_BENCH &bench, const std::vector<int> &order, size_t ops
+) {
+    // The flag is toggled, so that about half of the descriptors keep
+    // carrying it and removing one has to move the last entry of a populated
+    // flag list.
+
+    uint64_t done = 0;
+
+    for (size_t i=0, at=0; i<ops; ++i) {
+        int descriptor = next_descriptor(order, at);
+
+        if (bench.has_flag(descriptor)) done += bench.rem_flag(descriptor);
+        else                            done += bench.set_flag(descriptor);
+    }
+
+    return done;
+}
+
+static uint64_t run_append_outgoing(
+    SOCKETS_BENCH &bench, const std::vector<int> &order, size_t ops
+) {
+    std::vector<uint8_t> bytes(64, 'x');
+    std::vector<uint8_t> drained;
+    uint64_t total = 0;
+
+    for (size_t i=0, at=0; i<ops; ++i) {
+        int descriptor = next_descriptor(order, at);
+
+        bench.append_outgoing(descriptor, bytes);
+        bench.swap_outgoing(descriptor, drained);
+        total += drained.size();
+        drained.clear();
+    }
+
+    return total;
+}
+
+static uint64_t run_swap_incoming(
+    SOCKETS_BENCH &bench, const std::vector<int> &order, size_t ops
+) {
+    std::vector<uint8_t> bytes;
+    uint64_t total = 0;
+
+    for (size_t i=0, at=0; i<ops; ++i) {
+        total += bench.swap_incoming(next_descriptor(order, at), bytes);
+    }
+
+    return total;
+}
+
+static uint64_t run_pop_push(
+    SOCKETS_BENCH &bench, const std::vector<int> &order, size_t ops
+) {
+    uint64_t done = 0;
+
+    for (size_t i=0, at=0; i<ops; ++i) {
+        int descriptor = next_descriptor(order, at);
+
+        bench.release(descriptor);
+        done += bench.adopt(descriptor);
+    }
+
+    return done;
+}
+
+static const bench_type benches[] = {
+    { "find_record/hit",   run_find_hit        },
+    { "find_record/miss",  run_find_miss       },
+    { "has_flag",          run_has_flag        },
+    { "set_flag/rem_flag", run_set_rem_flag    },
+    { "append_outgoing",   run_append_outgoing },
+    { "swap_incoming",     run_swap_incoming   },
+    { "pop+push",          run_pop_push        }
+};
+
+static result_type measure(
+    const bench_type &bench, SOCKETS_BENCH &sockets,
+    const std::vector<int> &order, const settings_type &settings
+) {
+    result_type result{0.0, 0.0, 1024};
+
+    // The operations per round are doubled until a round lasts long enough
+    // for the resolution of the clock not to matter.
+
+    for (;;) {
+        long long start = get_nsec();
+
+        sink += bench.run(sockets, order, result.ops);
+
+        if (get_nsec() - start >= settings.round_nsec) break;
+
+        result.ops *= 2;
+    }
+
+    std::vector<double> samples;
+
+    for (size_t i=0; i<settings.rounds; ++i) {
+        long long start = get_nsec();
+
+        sink += bench.run(sockets, order, result.ops);
+
+        samples.emplace_back(
+            double(get_nsec() - start) / double(result.ops)
+        );
+    }
+
+    std::sort(samples.begin(), samples.end());
+
+    result.min = samples.front();
+    result.median = samples[samples.size() / 2];
+
+    return result;
+}
+
+static bool parse_counts(const char *text, std::vector<size_t> &counts) {
+    counts.clear();
+
+    while (*text) {
+        char *end = nullptr;
+        unsigned long long count = strtoull(text, &end, 10);
+
+        if (end == text || count == 0) return false;
+
+        counts.emplace_back(size_t(count));
+
+        if (*end == ',') ++end;
+        else if (*end) return false;
+
+        text = end;
+    }
+
+    return !counts.empty();
+}
+
+int main(int argc, char **argv) {
+    settings_type settings{
+        { 100, 1000, 10000, 100000 }, "", 9, 20000000, -1
+    };
+
+    static struct option long_options[] = {
+        {"cpu",         required_argument, 0,        'c' },
+        {"filter",      required_argument, 0,        'f' },
+        {"help",        no_argument,       0,        'h' },
+        {"counts",      required_argument, 0,        'n' },
+        {"rounds",      required_argument, 0,        'r' },
+        {"time",        required_argument, 0,        't' },
+        {0,             0,                 0,          0 }
+    };
+
+    int c;
+    while ((c = getopt_long(
+        argc, argv, "c:f:hn:r:t:", long_options, nullptr
+    )) != -1) {
+        switch (c) {
+            case 'c': settings.cpu = atoi(optarg); break;
+            case 'f': settings.filter = optarg; break;
+            case 'n': {
+                if (!parse_counts(optarg, settings.counts)) {
+                    print_usage(argv[0]);
+                    return 1;
+                }
+
+                break;
+            }
+            case 'r': settings.rounds = size_t(atol(optarg)); break;
+            case 't': settings.round_nsec = atoll(optarg) * 1000000LL; break;
+            default : print_usage(argv[0]); return c == 'h' ? 0 : 1;
+        }
+    }
+
+    if (argc != optind || settings.rounds == 0 || settings.round_nsec <= 0) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    if (settings.cpu >= 0) {
+        cpu_set_t set;
+
+        CPU_ZERO(&set);
+        CPU_SET(settings.cpu, &set);
+
+        if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+            fprintf(stderr, "sched_setaffinity: %s\n", strerror(errno));
+            return 1;
+        }
+    }
+
+    std::sort(settings.counts.begin(), settings.counts.end());
+
+    printf(
+        "%-22s %12s %12s %12s %14s\n",
+        "benchmark", "connections", "ns/op", "min ns/op", "ops/round"
+    );
+
+    for (size_t count : settings.counts) {
+        SOCKETS_BENCH sockets;
+
+        if (!sockets.populate(count)) {
+            fprintf(stderr, "out of memory at %lu records\n", count);
+            return 1;
+        }
+
+        // The descriptors are visited in a random order, so that the cost of
+        // missing the caches grows with the number of connections the way it
+        // would in the event loop.
+
+        std::vector<int> order;
+        uint64_t state = 0x9e3779b97f4a7c15ULL;
+
+        for (size_t i=0; i<count; ++i) {
+            order.emplace_back(SOCKETS_BENCH::FIRST_DESCRIPTOR + int(i));
+        }
+
+        for (size_t i=count; i>1; --i) {
+            std::swap(order[i - 1], order[next_random(state) % i]);
+        }
+
+        for (size_t i=0; i<count; i += 2) {
+            // Half of the descriptors carry the flag, see run_set_rem_flag.
+            sockets.set_flag(order[i]);
+        }
+
+        for (const bench_type &bench : benches) {
+            if (!settings.filter.empty()
+            &&  !strstr(bench.name, settings.filter.c_str())) {
+                continue;
+            }
+
+            result_type result = measure(bench, sockets, order, settings);
+
+            printf(
+                "%-22s %12lu %12.2f %12.2f %14lu\n",
+                bench.name, count, result.median, result.min, result.ops
+            );
+
+            fflush(stdout);
+        }
+    }
+
+    return sink == 42 ? 2 : 0;
+}
@@ -0,0 +1,460 @@
+// SPDX-License-Identifier: MIT
+#ifndef BINLOG_H_17_10_2026
+#define BINLOG_H_17_10_2026
+
+#include <array>
+#include <string>
+#include <algorithm>
+#include <vector>
+#include <cstdarg>
+#include <cstdint>
+#include <cstring>
+
+class BINLOG {
+    // Encodes log lines as compact binary records instead of formatting them.
+    // A record of a log line carries the time, the id of its format and the
+    // raw values of its arguments. The origin and the format string along
+    // with the types of its arguments are written only once, in a definition
+    // record that precedes the first use of the format. Rendering the lines
+    // is left to an offline decoder.
+    //
+    // The formats are recognized by their addresses, which is why they should
+    // be string literals. A format found at a known address is still compared
+    // to the copy kept of it, so that reusing a buffer for different formats
+    // is merely slower. The formats that cannot be decoded without knowing
+    // the types of their arguments are written as preformatted text instead.
+
+    public:
+    static constexpr const char *MAGIC = "TCPHBLOG";
+    static constexpr const uint32_t VERSION = 1;
+    static constexpr const size_t MAX_FORMATS = 1024;
+    static constexpr const size_t MAX_ARGS = 32;
+    static constexpr const size_t SLOTS = 2 * MAX_FORMATS;
+
+    enum class RECORD : uint8_t {
+        HEADER = 0, // magic, version, pid
+        FORMAT = 1, // id, argument types, origin, format
+        ENTRY  = 2, // time, id, arguments
+        TEXT   = 3  // time, preformatted text
+    };
+
+    enum class ARG : uint8_t {
+        INT     = 0, // Integers are stored in 8 bytes regardless of the type.
+        UINT    = 1,
+        LONG    = 2,
+        ULONG   = 3,
+        LLONG   = 4,
+        ULLONG  = 5,
+        DOUBLE  = 6,
+        POINTER = 7,
+        STRING  = 8  // Stored as a 16-bit length followed by the bytes.
+    };
+
+    struct record_type {
+        uint8_t  type;
+        uint8_t  reserved;
+        uint16_t size; // Including this head.
+    };
+
+    struct header_type {
+        record_type head;
+        char        magic[8];
+        uint32_t    version;
+        uint32_t    pid;
+    };
+
+    struct format_type {
+        record_type head;
+        uint16_t    id;
+        uint16_t    origin_size;
+        uint16_t    format_size;
+        uint8_t     arg_count;
+        uint8_t     reserved;
+    };
+
+    struct entry_type {
+        record_type head;
+        uint16_t    id;
+        uint16_t    reserved;
+        uint64_t    time; // Microseconds since the Epoch.
+    };
+
+    struct text_type {
+        record_type head;
+        uint32_t    reserved;
+        uint64_t    time; // Microseconds since the Epoch.
+    };
+
+    static_assert(sizeof(record_type) == 4, "unexpected record size");
+    static_assert(sizeof(header_type) == 20, "unexpected header size");
+    static_assert(sizeof(format_type) == 12, "unexpected format size");
+    static_assert(sizeof(entry_type) == 16, "unexpected entry size");
+    static_assert(sizeof(text_type) == 16, "unexpected text size");
+
+    BINLOG() : slots{}, generation(0), pending(MAX_FORMATS) {}
+    ~BINLOG() {}
+
+    static inline size_t header(char *out, size_t size, uint32_t pid) {
+        header_type record{};
+
+        if (size < sizeof(record)) return 0;
+
+        record.head.type = uint8_t(RECORD::HEADER);
+        record.head.size = uint16_t(sizeof(record));
+        std::memcpy(record.magic, MAGIC, sizeof(record.magic));
+        record.version = VERSION;
+        record.pid = pid;
+
+        std::memcpy(out, &record, sizeof(record));
+
+        return sizeof(record);
+    }
+
+    inline void set_generation(uint64_t value) {
+        // A new generation means the next line goes to a new file. The formats
+        // are then defined again, so that every file could be decoded alone.
+
+        if (value == generation) return;
+
+        generation = value;
+
+        for (definition_type &definition : definitions) {
+            definition.defined = false;
+        }
+    }
+
+    inline size_t encode(
+        char *out, size_t size, uint64_t time, const char *origin,
+        const char *fmt, va_list ap
+    ) {
+        // Writes the records of the given log line to the output and returns
+        // their total size. Returns zero if the line has to be written as
+        // text instead. If the records include a definition, it is not
+        // considered written until the caller confirms it.
+
+        size_t id = find(origin, fmt);
+
+        pending = MAX_FORMATS;
+
+        if (id >= definitions.size()) return 0;
+
+        const definition_type &definition = definitions[id];
+        size_t length = 0;
+
+        if (!definition.defined) {
+            length = define(out, size, id);
+
+            if (!length) return 0;
+        }
+
+        entry_type entry{};
+
+        if (size - length < sizeof(entry)) return 0;
+
+        size_t start = length;
+
+        length += sizeof(entry);
+
+        for (ARG arg : definition.args) {
+            uint64_t value = 0;
+
+            switch (arg) {
+                case ARG::INT: {
+                    value = uint64_t(int64_t(va_arg(ap, int)));
+                    break;
+                }
+                case ARG::UINT: {
+                    value = va_arg(ap, unsigned);
+                    break;
+                }
+                case ARG::LONG: {
+                    value = uint64_t(int64_t(va_arg(ap, long)));
+                    break;
+                }
+                case ARG::ULONG: {
+                    value = va_arg(ap, unsigned long);
+                    break;
+                }
+                case ARG::LLONG: {
+                    value = uint64_t(int64_t(va_arg(ap, long long)));
+                    break;
+                }
+                case ARG::ULLONG: {
+                    value = va_arg(ap, unsigned long long);
+                    break;
+                }
+                case ARG::DOUBLE: {
+                    double number = va_arg(ap, double);
+                    std::memcpy(&value, &number, sizeof(value));
+                    break;
+                }
+                case ARG::POINTER: {
+                    value = uint64_t(uintptr_t(va_arg(ap, void *)));
+                    break;
+                }
+                case ARG::STRING: {
+                    const char *text = va_arg(ap, const char *);
+
+                    if (!text) text = "(null)";
+
+                    if (size - length < sizeof(uint16_t)) return 0;
+
+                    size_t room = std::min(
+                        size - length - sizeof(uint16_t), size_t(UINT16_MAX)
+                    );
+                    uint16_t bytes = uint16_t(strnlen(text, room));
+
+                    std::memcpy(out + length, &bytes, sizeof(bytes));
+                    std::memcpy(out + length + sizeof(bytes), text, bytes);
+                    length += sizeof(bytes) + bytes;
+
+                    continue;
+                }
+            }
+
+            if (size - length < sizeof(value)) return 0;
+
+            std::memcpy(out + length, &value, sizeof(value));
+            length += sizeof(value);
+        }
+
+        if (length - start > UINT16_MAX) return 0;
+
+        entry.head.type = uint8_t(RECORD::ENTRY);
+        entry.head.size = uint16_t(length - start);
+        entry.id = uint16_t(id);
+        entry.time = time;
+
+        std::memcpy(out + start, &entry, sizeof(entry));
+
+        if (start) pending = id;
+
+        return length;
+    }
+
+    inline void confirm() {
+        // Marks the definition included by the last encoded line as written.
+        // Lines that never made it to the output leave theirs undefined.
+
+        if (pending < definitions.size()) definitions[pending].defined = true;
+
+        pending = MAX_FORMATS;
+    }
+
+    static inline size_t text(
+        char *out, size_t size, uint64_t time, const char *text, size_t length
+    ) {
+        text_type record{};
+
+        if (size < sizeof(record)) return 0;
+
+        length = std::min(
+            length,
+            std::min(size, size_t(UINT16_MAX)) - sizeof(record)
+        );
+
+        record.head.type = uint8_t(RECORD::TEXT);
+        record.head.size = uint16_t(sizeof(record) + length);
+        record.time = time;
+
+        std::memcpy(out, &record, sizeof(record));
+        std::memcpy(out + sizeof(record), text, length);
+
+        return sizeof(record) + length;
+    }
+
+    static inline bool parse(const char *fmt, std::vector<ARG> &args) {
+        // Finds the types of the arguments that the given format expects.
+        // Returns false if any of them is not supported.
+
+        args.clear();
+
+        for (const char *c = fmt; *c; ++c) {
+            if (*c != '%') continue;
+
+            if (*++c == '%') continue;
+
+            while (*c && strchr("-+ #0'", *c)) ++c;
+
+            if (*c == '*') {
+                args.push_back(ARG::INT);
+                ++c;
+            }
+            else while (*c >= '0' && *c <= '9') ++c;
+
+            if (*c == '.') {
+                ++c;
+
+                if (*c == '*') {
+                    args.push_back(ARG::INT);
+                    ++c;
+                }
+                else while (*c >= '0' && *c <= '9') ++c;
+            }
+
+            size_t longs = 0;
+            bool sized = false;
+
+            for (;; ++c) {
+                if (*c == 'h') continue;
+                else if (*c == 'l') ++longs;
+                else if (*c == 'z' || *c == 't' || *c == 'j') sized = true;
+                else break;
+            }
+
+            if (longs > 2 || (longs && sized)) return false;
+
+            switch (*c) {
+                case 'c': {
+                    if (longs || sized) return false;
+
+                    args.push_back(ARG::INT);
+                    break;
+                }
+                case 'd': case 'i': {
+                    args.push_back(
+                        longs == 2 ? ARG::LLONG :
+                        longs == 1 || sized ? ARG::LONG : ARG::INT
+                    );
+                    break;
+                }
+                case 'u': case 'o': case 'x': case 'X': {
+                    args.push_back(
+                        longs == 2 ? ARG::ULLONG :
+                        longs == 1 || sized ? ARG::ULONG : ARG::UINT
+                    );
+                    break;
+                }
+                case 'f': case 'F': case 'e': case 'E': case 'g': case 'G':
+                case 'a': case 'A': {
+                    if (longs || sized) return false;
+
+                    args.push_back(ARG::DOUBLE);
+                    break;
+                }
+                case 's': {
+                    if (longs || sized) return false;
+
+                    args.push_back(ARG::STRING);
+                    break;
+                }
+                case 'p': {
+                    args.push_back(ARG::POINTER);
+                    break;
+                }
+                default: return false;
+            }
+
+            if (args.size() > MAX_ARGS) return false;
+        }
+
+        return true;
+    }
+
+    private:
+    struct definition_type {
+        const char *origin_address;
+        const char *format_address;
+        std::string origin;
+        std::string format;
+        std::vector<ARG> args;
+        bool defined;
+    };
+
+    inline size_t find(const char *origin, const char *fmt) {
+        // Returns the id of the given format or MAX_FORMATS if there is none.
+
+        size_t slot = (
+            (uintptr_t(fmt) * 0x9e3779b97f4a7c15ULL) ^ uintptr_t(origin)
+        ) % SLOTS;
+
+        for (size_t probe = 0; probe < SLOTS; ++probe) {
+            uint16_t &entry = slots[slot];
+
+            if (entry == 0) {
+                // The slots hold the ids plus one so that zero means empty.
+
+                size_t id = add(origin, fmt);
+
+                if (id < MAX_FORMATS) entry = uint16_t(id + 1);
+
+                return id;
+            }
+
+            const definition_type &definition = definitions[entry - 1u];
+
+            if (definition.format_address == fmt
+            &&  definition.origin_address == origin) {
+                if (!std::strcmp(definition.format.c_str(), fmt)
+                &&  !std::strcmp(definition.origin.c_str(), origin)) {
+                    return entry - 1u;
+                }
+
+                // The buffer has been reused for something else.
+
+                size_t id = add(origin, fmt);
+
+                if (id < MAX_FORMATS) entry = uint16_t(id + 1);
+
+                return id;
+            }
+
+            slot = (slot + 1) % SLOTS;
+        }
+
+        return MAX_FORMATS;
+    }
+
+    inline size_t add(const char *origin, const char *fmt) {
+        if (definitions.size() >= MAX_FORMATS) return MAX_FORMATS;
+
+        std::vector<ARG> args;
+
+        if (!parse(fmt, args)) return MAX_FORMATS;
+
+        definitions.push_back(
+            definition_type{origin, fmt, origin, fmt, std::move(args), false}
+        );
+
+        return definitions.size() - 1;
+    }
+
+    inline size_t define(char *out, size_t size, size_t id) const {
+        const definition_type &definition = definitions[id];
+        size_t length{
+            sizeof(format_type) + definition.args.size() +
+            definition.origin.size() + definition.format.size()
+        };
+
+        if (length > size || length > UINT16_MAX) return 0;
+
+        format_type record{};
+
+        record.head.type = uint8_t(RECORD::FORMAT);
+        record.head.size = uint16_t(length);
+        record.id = uint16_t(id);
+        record.origin_size = uint16_t(definition.origin.size());
+        record.format_size = uint16_t(definition.format.size());
+        record.arg_count = uint8_t(definition.args.size());
+
+        char *at = out;
+
+        std::memcpy(at, &record, sizeof(record));
+        at += sizeof(record);
+
+        for (ARG arg : definition.args) *at++ = char(arg);
+
+        std::memcpy(at, definition.origin.data(), definition.origin.size());
+        at += definition.origin.size();
+        std::memcpy(at, definition.format.data(), definition.format.size());
+
+        return length;
+    }
+
+    std::array<uint16_t, SLOTS> slots;
+    std::vector<definition_type> definitions;
+    uint64_t generation;
+    size_t pending;
+};
+
+#endif
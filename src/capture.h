@@ -0,0 +1,173 @@
+// SPDX-License-Identifier: MIT
+#ifndef CAPTURE_H_17_10_2026
+#define CAPTURE_H_17_10_2026
+
+#include <limits>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+
+#include "appender.h"
+
+class CAPTURE {
+    // The capture is an append-only binary file of fixed-size records that
+    // describe the shape of the forwarded traffic: when the pairs begin and
+    // end, and the size, direction and timing of every chunk in between. No
+    // payload is ever recorded. The load generator replays these files. Like
+    // the journal, the records are written out in the background by the
+    // appender.
+
+    public:
+    static constexpr const char *MAGIC = "TCPHCAPT";
+    static constexpr const uint32_t VERSION = 1;
+
+    enum class TYPE : uint8_t {
+        NONE   = 0,
+        BEGIN  = 1, // The delay is counted from the previous pair's beginning.
+        SUPPLY = 2, // A chunk forwarded from supply to demand.
+        DEMAND = 3, // A chunk forwarded from demand to supply.
+        END    = 4
+    };
+
+    struct header_type {
+        char     magic[8];
+        uint32_t version;
+        uint32_t record_size;
+    };
+
+    struct record_type {
+        uint32_t pair;     // Sequence number of the pair within the session.
+        uint32_t delay;    // Microseconds since the pair's previous record.
+        uint32_t size;     // Bytes in the chunk.
+        uint8_t  type;
+        uint8_t  reserved[3];
+    };
+
+    static_assert(sizeof(header_type) == 16, "unexpected header size");
+    static_assert(sizeof(record_type) == 16, "unexpected record size");
+
+    CAPTURE(
+        void (*log_fun) (const char *, const char *, ...) =drop_log,
+        const char *log_src ="Capture"
+    ) : appender  (log_fun, log_src)
+      , sequence  (0)
+      , last_begin(-1)
+      , last      (0)
+    {}
+
+    ~CAPTURE() {}
+
+    inline bool init(const char *path) {
+        header_type header{};
+
+        std::memcpy(header.magic, MAGIC, sizeof(header.magic));
+        header.version = VERSION;
+        header.record_size = uint32_t(sizeof(record_type));
+
+        return appender.init(
+            path, &header, sizeof(header), sizeof(record_type)
+        );
+    }
+
+    inline bool deinit() {
+        // Waits until every record has been written out.
+
+        end_all(last);
+
+        return appender.deinit();
+    }
+
+    inline void begin(int key, long long usec) {
+        // The first pair of a session begins without a delay, so that the
+        // sessions appended to the same file would replay back to back.
+
+        pair_type &pair = pairs[key];
+
+        pair.id = ++sequence;
+        pair.last = usec;
+
+        record(
+            pair.id, last_begin < 0 ? 0 : usec - last_begin, 0, TYPE::BEGIN
+        );
+
+        last_begin = usec;
+        last = usec;
+    }
+
+    inline void forward(
+        int key, bool from_supply, size_t bytes, long long usec
+    ) {
+        auto it = pairs.find(key);
+
+        if (it == pairs.end()) return;
+
+        pair_type &pair = it->second;
+
+        record(
+            pair.id, usec - pair.last,
+            uint32_t(std::min(
+                bytes, size_t(std::numeric_limits<uint32_t>::max())
+            )),
+            from_supply ? TYPE::SUPPLY : TYPE::DEMAND
+        );
+
+        pair.last = usec;
+        last = usec;
+    }
+
+    inline void end(int key, long long usec) {
+        auto it = pairs.find(key);
+
+        if (it == pairs.end()) return;
+
+        record(it->second.id, usec - it->second.last, 0, TYPE::END);
+        pairs.erase(it);
+        last = usec;
+    }
+
+    inline void end_all(long long usec) {
+        while (!pairs.empty()) {
+            end(pairs.begin()->first, usec);
+        }
+    }
+
+    inline bool flush() {
+        // Returns false if any of the earlier records failed to be written.
+
+        return appender.flush();
+    }
+
+    private:
+    struct pair_type {
+        uint32_t id;
+        long long last; // Time of the pair's previous record.
+    };
+
+    static void drop_log(const char *, const char *, ...) {}
+
+    inline void record(uint32_t pair, long long delay, uint32_t size, TYPE t) {
+        // Delays that do not fit the record are saturated, which is more than
+        // an hour of silence.
+
+        record_type r{};
+
+        r.pair = pair;
+        r.delay = uint32_t(std::min(
+            std::max(delay, 0LL),
+            (long long) std::numeric_limits<uint32_t>::max()
+        ));
+        r.size = size;
+        r.type = static_cast<uint8_t>(t);
+
+        appender.append(&r, sizeof(r));
+    }
+
+    APPENDER appender;
+    uint32_t sequence;
+    long long last_begin;
+    long long last;
+    std::unordered_map<int, pair_type> pairs;
+};
+
+#endif
@@ -0,0 +1,35 @@
+#!/bin/sh
+# SPDX-License-Identifier: MIT
+# Starts a herald that counts its allocations and checks with the allocs tool
+# that it forwards between established pairs without allocating from the heap.
+#
+# Usage: allocs.sh herald allocs [port]
+
+HERALD=$1
+ALLOCS=$2
+PORT=${3:-17300}
+
+if [ ! -x "$HERALD" ] || [ ! -x "$ALLOCS" ]; then
+    echo "usage: $0 herald allocs [port]" >&2
+    exit 1
+fi
+
+SUPPLY=$PORT
+DEMAND=$((PORT + 1))
+STATS_FILE=/dev/shm/tcpherald-allocs-$$
+
+"$HERALD" --stats-file $STATS_FILE $SUPPLY $DEMAND 2> /dev/null &
+PID=$!
+
+sleep 0.5
+
+status=0
+
+"$ALLOCS" --stats-file $STATS_FILE $SUPPLY $DEMAND || status=1
+
+kill -TERM $PID
+wait $PID || status=1
+
+rm -f $STATS_FILE
+
+exit $status
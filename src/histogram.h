@@ -0,0 +1,110 @@
+// SPDX-License-Identifier: MIT
+#ifndef HISTOGRAM_H_17_10_2026
+#define HISTOGRAM_H_17_10_2026
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+
+class HISTOGRAM {
+    // Log-bucketed histogram in the spirit of HDR histograms. Every power of
+    // two is split into SUB_COUNT linear sub-buckets, keeping the relative
+    // error of any recorded value below 1/SUB_COUNT. Recording a value costs a
+    // count-leading-zeros instruction and a few additions.
+
+    public:
+    static constexpr const size_t SUB_BITS  = 4;
+    static constexpr const size_t SUB_COUNT = size_t(1) << SUB_BITS;
+    static constexpr const size_t BUCKETS   = (64 - SUB_BITS + 1) * SUB_COUNT;
+
+    HISTOGRAM() : buckets{}, count(0), sum(0), max(0) {}
+    ~HISTOGRAM() {}
+
+    inline void record(uint64_t value) {
+        ++buckets[index_of(value)];
+        ++count;
+        sum += value;
+
+        if (value > max) max = value;
+    }
+
+    inline void clear() {
+        buckets.fill(0);
+        count = 0;
+        sum = 0;
+        max = 0;
+    }
+
+    inline uint64_t get_count() const {
+        return count;
+    }
+
+    inline uint64_t get_sum() const {
+        return sum;
+    }
+
+    inline uint64_t get_max() const {
+        return max;
+    }
+
+    inline uint64_t get_bucket(size_t index) const {
+        return index < buckets.size() ? buckets[index] : 0;
+    }
+
+    inline uint64_t value_at(double quantile) const {
+        // Returns the highest value equivalent to the one found at the given
+        // quantile, never exceeding the largest value ever recorded.
+
+        if (count == 0) return 0;
+
+        uint64_t rank = uint64_t(quantile * double(count) + 0.5);
+
+        if (rank == 0) rank = 1;
+        if (rank > count) rank = count;
+
+        uint64_t seen = 0;
+
+        for (size_t i=0; i<buckets.size(); ++i) {
+            seen += buckets[i];
+
+            if (seen >= rank) {
+                uint64_t value = highest_of(i);
+
+                return value < max ? value : max;
+            }
+        }
+
+        return max;
+    }
+
+    static inline size_t index_of(uint64_t value) {
+        if (value < SUB_COUNT) return size_t(value);
+
+        size_t msb = size_t(63 - __builtin_clzll(value));
+        size_t shift = msb - SUB_BITS;
+
+        return (shift + 1) * SUB_COUNT + size_t((value >> shift) - SUB_COUNT);
+    }
+
+    static inline uint64_t lowest_of(size_t index) {
+        if (index < SUB_COUNT) return uint64_t(index);
+
+        size_t shift = index / SUB_COUNT - 1;
+
+        return uint64_t(SUB_COUNT + index % SUB_COUNT) << shift;
+    }
+
+    static inline uint64_t highest_of(size_t index) {
+        if (index + 1 >= BUCKETS) return UINT64_MAX;
+
+        return lowest_of(index + 1) - 1;
+    }
+
+    private:
+    std::array<uint64_t, BUCKETS> buckets;
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+};
+
+#endif
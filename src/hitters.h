@@ -0,0 +1,157 @@
+// SPDX-License-Identifier: MIT
+#ifndef HITTERS_H_17_10_2026
+#define HITTERS_H_17_10_2026
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+
+class HITTERS {
+    // Bounded-memory tracking of the keys with the largest total weight, such
+    // as the hosts opening the most connections. The candidates are kept by
+    // the Space-Saving algorithm in a fixed number of slots. A key that takes
+    // over the slot of the lightest candidate starts from the estimate of a
+    // Count-Min sketch instead of the weight of that candidate, which keeps
+    // the overestimation of newcomers small. The memory used does not depend
+    // on the number of distinct keys.
+
+    public:
+    static constexpr const size_t SLOTS    = 64;
+    static constexpr const size_t DEPTH    = 4;
+    static constexpr const size_t WIDTH    = 1024;
+    static constexpr const size_t KEY_SIZE = 46; // INET6_ADDRSTRLEN
+
+    struct entry_type {
+        uint64_t hash;
+        uint64_t count; // Never less than the true weight of the key.
+        uint64_t error; // Largest possible overestimation of the count.
+        std::array<char, KEY_SIZE> key;
+    };
+
+    HITTERS() : sketch{}, slots{}, used(0), total(0) {}
+    ~HITTERS() {}
+
+    inline void update(uint64_t hash, const char *key, uint64_t weight =1) {
+        total += weight;
+
+        uint64_t estimate = UINT64_MAX;
+
+        for (size_t row=0; row<DEPTH; ++row) {
+            uint64_t &cell = sketch[row][cell_of(hash, row)];
+
+            cell += weight;
+
+            if (cell < estimate) estimate = cell;
+        }
+
+        for (size_t i=0; i<used; ++i) {
+            if (slots[i].hash == hash) {
+                slots[i].count += weight;
+                return;
+            }
+        }
+
+        entry_type *entry = nullptr;
+
+        if (used < SLOTS) {
+            entry = &slots[used++];
+            entry->error = 0;
+            entry->count = weight;
+        }
+        else {
+            entry = &slots[0];
+
+            for (size_t i=1; i<SLOTS; ++i) {
+                if (slots[i].count < entry->count) entry = &slots[i];
+            }
+
+            uint64_t count = std::min(estimate, entry->count + weight);
+
+            entry->error = count - weight;
+            entry->count = count;
+        }
+
+        size_t length = key ? strnlen(key, KEY_SIZE - 1) : 0;
+
+        entry->hash = hash;
+        entry->key.fill('\0');
+
+        if (length) std::memcpy(entry->key.data(), key, length);
+    }
+
+    inline uint64_t estimate(uint64_t hash) const {
+        // Returns an upper bound of the total weight of the given key.
+
+        uint64_t estimate = UINT64_MAX;
+
+        for (size_t row=0; row<DEPTH; ++row) {
+            uint64_t cell = sketch[row][cell_of(hash, row)];
+
+            if (cell < estimate) estimate = cell;
+        }
+
+        return estimate;
+    }
+
+    inline size_t top(entry_type *out, size_t count) const {
+        // Copies up to the given number of the heaviest candidates in the
+        // descending order of their counts and returns how many were copied.
+
+        std::array<entry_type, SLOTS> sorted;
+        size_t n = std::min(count, used);
+
+        std::copy(slots.begin(), slots.begin() + used, sorted.begin());
+        std::partial_sort(
+            sorted.begin(), sorted.begin() + n, sorted.begin() + used,
+            [](const entry_type &a, const entry_type &b) {
+                return a.count > b.count;
+            }
+        );
+        std::copy(sorted.begin(), sorted.begin() + n, out);
+
+        return n;
+    }
+
+    inline uint64_t get_total() const {
+        return total;
+    }
+
+    static inline uint64_t hash_of(const char *key) {
+        // FNV-1a followed by the finalizer of MurmurHash3 so that all of the
+        // bits of the result would depend on every byte of the key.
+
+        uint64_t hash = 14695981039346656037ULL;
+
+        for (; key && *key; ++key) {
+            hash ^= uint8_t(*key);
+            hash *= 1099511628211ULL;
+        }
+
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdULL;
+        hash ^= hash >> 33;
+        hash *= 0xc4ceb9fe1a85ec53ULL;
+        hash ^= hash >> 33;
+
+        return hash;
+    }
+
+    private:
+    static inline size_t cell_of(uint64_t hash, size_t row) {
+        // The rows are indexed by double hashing on the halves of the hash.
+
+        uint64_t h1 = hash & 0xffffffffULL;
+        uint64_t h2 = (hash >> 32) | 1;
+
+        return size_t((h1 + row * h2) % WIDTH);
+    }
+
+    std::array<std::array<uint64_t, WIDTH>, DEPTH> sketch;
+    std::array<entry_type, SLOTS> slots;
+    size_t used;
+    uint64_t total;
+};
+
+#endif
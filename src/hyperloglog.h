@@ -0,0 +1,57 @@
+// SPDX-License-Identifier: MIT
+#ifndef HYPERLOGLOG_H_17_10_2026
+#define HYPERLOGLOG_H_17_10_2026
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+
+class HYPERLOGLOG {
+    // Estimates the number of distinct keys inserted into it from their
+    // 64-bit hashes. With 2^PRECISION single byte registers the standard error
+    // of the estimate is about 1.04 / sqrt(2^PRECISION), that is 1.6%.
+
+    public:
+    static constexpr const size_t PRECISION = 12;
+    static constexpr const size_t REGISTERS = size_t(1) << PRECISION;
+
+    HYPERLOGLOG() : registers{} {}
+    ~HYPERLOGLOG() {}
+
+    inline void insert(uint64_t hash) {
+        size_t index = size_t(hash >> (64 - PRECISION));
+        uint64_t rest = (hash << PRECISION) | (uint64_t(1) << (PRECISION - 1));
+        uint8_t rank = uint8_t(__builtin_clzll(rest) + 1);
+
+        if (rank > registers[index]) registers[index] = rank;
+    }
+
+    inline uint64_t estimate() const {
+        double sum = 0.0;
+        size_t zeros = 0;
+
+        for (uint8_t reg : registers) {
+            sum += std::ldexp(1.0, -int(reg));
+
+            if (reg == 0) ++zeros;
+        }
+
+        const double m = double(REGISTERS);
+        const double alpha = 0.7213 / (1.0 + 1.079 / m);
+        double estimate = alpha * m * m / sum;
+
+        if (estimate <= 2.5 * m && zeros > 0) {
+            // Linear counting is more accurate for small cardinalities.
+
+            estimate = m * std::log(m / double(zeros));
+        }
+
+        return uint64_t(estimate + 0.5);
+    }
+
+    private:
+    std::array<uint8_t, REGISTERS> registers;
+};
+
+#endif
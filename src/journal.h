@@ -0,0 +1,179 @@
+// SPDX-License-Identifier: MIT
+#ifndef JOURNAL_H_17_10_2026
+#define JOURNAL_H_17_10_2026
+
+#include <array>
+#include <string>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <unordered_map>
+
+#include "appender.h"
+
+class JOURNAL {
+    // The journal is an append-only binary file of fixed-size entries, one per
+    // pair of connections, preceded by a header identifying the format. The
+    // entries are written out in the background by the appender, which never
+    // drops them for being slow and cuts a failed batch back to the last
+    // whole entry.
+
+    public:
+    static constexpr const char *MAGIC = "TCPHJRNL";
+    static constexpr const uint32_t VERSION = 1;
+
+    enum class REASON : uint8_t {
+        NONE          = 0,
+        SUPPLY_CLOSED = 1,
+        DEMAND_CLOSED = 2,
+        TIMEOUT       = 3,
+        SHUTDOWN      = 4,
+        SLOW_CONSUMER = 5,
+        MAX_REASONS   = 6
+    };
+
+    struct header_type {
+        char     magic[8];
+        uint32_t version;
+        uint32_t entry_size;
+    };
+
+    struct entry_type {
+        uint64_t start;         // Microseconds since the Epoch.
+        uint64_t end;           // Microseconds since the Epoch.
+        uint64_t supply_bytes;  // Bytes forwarded from supply to demand.
+        uint64_t demand_bytes;  // Bytes forwarded from demand to supply.
+        uint64_t supply_chunks;
+        uint64_t demand_chunks;
+        char     supply_host[46];
+        char     demand_host[46];
+        uint16_t supply_port;
+        uint16_t demand_port;
+        uint8_t  reason;
+        uint8_t  reserved[7];
+    };
+
+    static_assert(sizeof(header_type) == 16, "unexpected header size");
+    static_assert(sizeof(entry_type) == 152, "unexpected entry size");
+
+    JOURNAL(
+        void (*log_fun) (const char *, const char *, ...) =drop_log,
+        const char *log_src ="Journal"
+    ) : appender(log_fun, log_src) {}
+
+    ~JOURNAL() {}
+
+    inline bool init(const char *path) {
+        header_type header{};
+
+        std::memcpy(header.magic, MAGIC, sizeof(header.magic));
+        header.version = VERSION;
+        header.entry_size = uint32_t(sizeof(entry_type));
+
+        return appender.init(
+            path, &header, sizeof(header), sizeof(entry_type)
+        );
+    }
+
+    inline bool deinit() {
+        // Waits until every entry has been written out.
+
+        end_all(REASON::SHUTDOWN);
+
+        return appender.deinit();
+    }
+
+    inline void begin(
+        int key,
+        const char *supply_host, const char *supply_port,
+        const char *demand_host, const char *demand_port
+    ) {
+        entry_type &entry = entries[key];
+
+        std::memset(&entry, 0, sizeof(entry));
+        entry.start = get_time();
+
+        // The entry has been zeroed, so the copied hosts remain terminated.
+        std::memcpy(
+            entry.supply_host, supply_host,
+            strnlen(supply_host, sizeof(entry.supply_host) - 1)
+        );
+
+        std::memcpy(
+            entry.demand_host, demand_host,
+            strnlen(demand_host, sizeof(entry.demand_host) - 1)
+        );
+
+        entry.supply_port = uint16_t(std::atoi(supply_port));
+        entry.demand_port = uint16_t(std::atoi(demand_port));
+    }
+
+    inline void forward(int key, bool from_supply, size_t bytes) {
+        auto it = entries.find(key);
+
+        if (it == entries.end()) return;
+
+        if (from_supply) {
+            it->second.supply_bytes += bytes;
+            it->second.supply_chunks++;
+        }
+        else {
+            it->second.demand_bytes += bytes;
+            it->second.demand_chunks++;
+        }
+    }
+
+    inline void end(int key, REASON reason) {
+        auto it = entries.find(key);
+
+        if (it == entries.end()) return;
+
+        it->second.end = get_time();
+        it->second.reason = static_cast<uint8_t>(reason);
+
+        appender.append(&(it->second), sizeof(entry_type));
+        entries.erase(it);
+    }
+
+    inline void end_all(REASON reason) {
+        while (!entries.empty()) {
+            end(entries.begin()->first, reason);
+        }
+    }
+
+    inline bool flush() {
+        // Returns false if any of the earlier entries failed to be written.
+
+        return appender.flush();
+    }
+
+    static inline uint64_t get_time() {
+        return uint64_t(
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::system_clock::now().time_since_epoch()
+            ).count()
+        );
+    }
+
+    static inline const char *reason_name(uint8_t reason) {
+        switch (static_cast<REASON>(reason)) {
+            case REASON::SUPPLY_CLOSED: return "supply";
+            case REASON::DEMAND_CLOSED: return "demand";
+            case REASON::TIMEOUT:       return "timeout";
+            case REASON::SHUTDOWN:      return "shutdown";
+            case REASON::SLOW_CONSUMER: return "slow";
+            default:                    break;
+        }
+
+        return "unknown";
+    }
+
+    private:
+    static void drop_log(const char *, const char *, ...) {}
+
+    APPENDER appender;
+    std::unordered_map<int, entry_type> entries;
+};
+
+#endif
@@ -0,0 +1,62 @@
+// SPDX-License-Identifier: MIT
+#ifndef KERNEL_H_17_10_2026
+#define KERNEL_H_17_10_2026
+
+#include <csignal>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+class KERNEL {
+    // The system calls the proxy makes to accept, serve and time its
+    // connections. They are called through this table, so that a simulated
+    // network could be put in place of the real one.
+
+    public:
+    int     (*accept4)(int, sockaddr *, socklen_t *, int);
+    ssize_t (*read)(int, void *, size_t);
+    ssize_t (*write)(int, const void *, size_t);
+    int     (*epoll_create1)(int);
+    int     (*epoll_ctl)(int, int, int, epoll_event *);
+    int     (*epoll_pwait)(int, epoll_event *, int, int, const sigset_t *);
+    int     (*socket)(int, int, int);
+    int     (*bind)(int, const sockaddr *, socklen_t);
+    int     (*listen)(int, int);
+    int     (*connect)(int, const sockaddr *, socklen_t);
+    int     (*shutdown)(int, int);
+    int     (*open)(const char *, int, mode_t);
+    int     (*close)(int);
+    int     (*getsockopt)(int, int, int, void *, socklen_t *);
+    int     (*setsockopt)(int, int, int, const void *, socklen_t);
+    int     (*clock_gettime)(clockid_t, timespec *);
+    int     (*setitimer)(int, const itimerval *, itimerval *);
+
+    static inline const KERNEL &native() {
+        static const KERNEL kernel{
+            ::accept4, ::read, ::write, ::epoll_create1, ::epoll_ctl,
+            ::epoll_pwait, ::socket, ::bind, ::listen, ::connect, ::shutdown,
+            open_file, ::close, ::getsockopt, ::setsockopt, ::clock_gettime,
+            set_timer
+        };
+
+        return kernel;
+    }
+
+    private:
+    static int open_file(const char *path, int flags, mode_t mode) {
+        // The glibc prototype takes the mode as a variadic argument.
+
+        return ::open(path, flags, mode);
+    }
+
+    static int set_timer(int which, const itimerval *value, itimerval *old) {
+        // The glibc prototype takes the timer as an enumeration.
+
+        return ::setitimer(__itimer_which(which), value, old);
+    }
+};
+
+#endif
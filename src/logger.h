@@ -0,0 +1,353 @@
+// SPDX-License-Identifier: MIT
+#ifndef LOGGER_H_17_10_2026
+#define LOGGER_H_17_10_2026
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <string>
+#include <algorithm>
+#include <new>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+class LOGGER {
+    // Hands the log lines over to a background thread that writes them out in
+    // batches, either to the standard error or to a file that is rotated once
+    // it grows too large. The lines are copied into a preallocated ring of
+    // bytes that is shared by a single producer and a single consumer without
+    // locks. The producer never waits: if the ring is full because the output
+    // is too slow, the line is dropped and counted instead. The lines that the
+    // writer fails to write out are counted separately.
+    //
+    // The writer finds out when the file has grown too large, but it is the
+    // producer that picks the position in the stream where the next file
+    // begins. Thus the producer always knows which file a line goes to.
+
+    public:
+    static constexpr const size_t CAPACITY = size_t(1) << 20;
+    static constexpr const size_t ROTATIONS = 4;
+
+    static_assert((CAPACITY & (CAPACITY - 1)) == 0, "capacity must be 2^n");
+
+    LOGGER()
+    : ring      (nullptr)
+    , head      (0)
+    , tail      (0)
+    , waiting   (false)
+    , stopping  (false)
+    , descriptor(STDERR_FILENO)
+    , file_size (0)
+    , max_size  (0)
+    , dropped   (0)
+    , lost      (0)
+    , failed    (0)
+    , generation(0)
+    , rotate_at (NOWHERE)
+    , rotation_due(false) {}
+
+    ~LOGGER() {
+        delete [] ring;
+    }
+
+    inline bool init(
+        const char *file =nullptr, size_t rotate_size =0,
+        const char *preamble_bytes =nullptr, size_t preamble_size =0
+    ) {
+        // Without a file the lines are written to the standard error. The
+        // errors of initialization are reported by the return value only,
+        // since this is the very facility that would be used to log them.
+        // The preamble, if any, is written whenever a file is opened.
+
+        ring = new (std::nothrow) char [CAPACITY];
+
+        if (!ring) return false;
+
+        if (file && *file) {
+            path = file;
+            max_size = rotate_size;
+
+            if (preamble_bytes) preamble.assign(preamble_bytes, preamble_size);
+
+            if (!open_file()) return false;
+        }
+
+        // The writer must never receive the signals meant for the event loop,
+        // so it starts with all of them blocked.
+
+        sigset_t sigset_all;
+        sigset_t sigset_orig;
+
+        sigfillset(&sigset_all);
+        pthread_sigmask(SIG_SETMASK, &sigset_all, &sigset_orig);
+
+        try {
+            writer = std::thread(&LOGGER::write_loop, this);
+        }
+        catch (...) {
+            pthread_sigmask(SIG_SETMASK, &sigset_orig, nullptr);
+            return false;
+        }
+
+        pthread_sigmask(SIG_SETMASK, &sigset_orig, nullptr);
+
+        return true;
+    }
+
+    inline void deinit() {
+        // Waits until every line in the ring has been written out.
+
+        if (writer.joinable()) {
+            stopping.store(true);
+            wake();
+            writer.join();
+        }
+
+        if (!path.empty() && descriptor > STDERR_FILENO) close(descriptor);
+
+        descriptor = STDERR_FILENO;
+        path.clear();
+    }
+
+    inline bool is_running() const {
+        return ring != nullptr && writer.joinable();
+    }
+
+    inline bool push(const char *text, size_t length) {
+        // Copies the given text into the ring unless there is no room for it.
+        // May only be called by a single thread at a time.
+
+        if (rotation_due.load(std::memory_order_acquire)) mark_rotation();
+
+        if (dropped && !push_dropped()) {
+            ++dropped;
+            return false;
+        }
+
+        if (!copy_in(text, length)) {
+            ++dropped;
+            return false;
+        }
+
+        return true;
+    }
+
+    inline uint64_t get_lost() const {
+        // Returns the number of lines dropped for the lack of room in total.
+
+        return lost + dropped;
+    }
+
+    inline uint64_t get_failed() const {
+        // Returns the number of lines that failed to be written out in total.
+
+        return failed.load(std::memory_order_relaxed);
+    }
+
+    inline uint64_t get_generation() {
+        // Returns the number of files begun so far, including the one that
+        // the next pushed line is going to. May only be called by the thread
+        // that pushes the lines.
+
+        if (rotation_due.load(std::memory_order_acquire)) mark_rotation();
+
+        return generation;
+    }
+
+    private:
+    static constexpr const size_t NOWHERE = SIZE_MAX;
+
+    inline void mark_rotation() {
+        // Everything pushed from now on belongs to the next file.
+
+        rotation_due.store(false, std::memory_order_relaxed);
+        rotate_at.store(
+            head.load(std::memory_order_relaxed), std::memory_order_release
+        );
+        ++generation;
+    }
+
+    inline bool copy_in(const char *text, size_t length) {
+        size_t h = head.load(std::memory_order_relaxed);
+        size_t t = tail.load(std::memory_order_acquire);
+
+        if (length > CAPACITY - (h - t)) return false;
+
+        size_t offset = h & (CAPACITY - 1);
+        size_t first = std::min(length, CAPACITY - offset);
+
+        std::memcpy(ring + offset, text, first);
+        std::memcpy(ring, text + first, length - first);
+
+        head.store(h + length, std::memory_order_seq_cst);
+
+        if (waiting.load(std::memory_order_seq_cst)) wake();
+
+        return true;
+    }
+
+    inline bool push_dropped() {
+        char line[64];
+
+        int length = snprintf(
+            line, sizeof(line), "%llu log line%s dropped.\n",
+            (unsigned long long) dropped, dropped == 1 ? " was" : "s were"
+        );
+
+        if (length <= 0 || !copy_in(line, size_t(length))) return false;
+
+        lost += dropped;
+        dropped = 0;
+
+        return true;
+    }
+
+    inline void wake() {
+        std::lock_guard<std::mutex> guard(mutex);
+        condition.notify_one();
+    }
+
+    inline void write_loop() {
+        while (1) {
+            size_t t = tail.load(std::memory_order_relaxed);
+            size_t h = head.load(std::memory_order_acquire);
+
+            size_t at = rotate_at.load(std::memory_order_acquire);
+
+            if (at == t) {
+                rotate();
+                rotate_at.store(NOWHERE, std::memory_order_relaxed);
+                continue;
+            }
+
+            if (h != t) {
+                // Everything there is is written out at once, since the
+                // producer only ever publishes whole lines. The only
+                // exception is the position where the next file begins.
+
+                if (at != NOWHERE && at - t < h - t) h = at;
+
+                size_t offset = t & (CAPACITY - 1);
+                size_t length = h - t;
+                size_t first = std::min(length, CAPACITY - offset);
+
+                write_all(ring + offset, first);
+                write_all(ring, length - first);
+
+                tail.store(h, std::memory_order_release);
+
+                if (max_size && file_size >= max_size
+                && descriptor > STDERR_FILENO
+                && rotate_at.load(std::memory_order_relaxed) == NOWHERE) {
+                    rotation_due.store(true, std::memory_order_release);
+                }
+
+                continue;
+            }
+
+            if (stopping.load()) break;
+
+            std::unique_lock<std::mutex> lock(mutex);
+
+            waiting.store(true, std::memory_order_seq_cst);
+
+            if (head.load(std::memory_order_seq_cst) == t
+            && !stopping.load()) {
+                condition.wait_for(lock, std::chrono::seconds(1));
+            }
+
+            waiting.store(false, std::memory_order_relaxed);
+        }
+    }
+
+    inline void write_all(const char *bytes, size_t length) {
+        while (length > 0) {
+            ssize_t written = write(descriptor, bytes, length);
+
+            if (written < 0) {
+                if (errno == EINTR) continue;
+
+                failed.fetch_add(
+                    uint64_t(std::count(bytes, bytes + length, '\n')),
+                    std::memory_order_relaxed
+                );
+
+                return;
+            }
+
+            bytes += written;
+            length -= size_t(written);
+            file_size += size_t(written);
+        }
+    }
+
+    inline bool open_file() {
+        descriptor = open(
+            path.c_str(), O_WRONLY|O_APPEND|O_CREAT|O_CLOEXEC, 0644
+        );
+
+        if (descriptor == -1) return false;
+
+        struct stat info;
+
+        file_size = fstat(descriptor, &info) == 0 ? size_t(info.st_size) : 0;
+
+        write_all(preamble.data(), preamble.size());
+
+        return true;
+    }
+
+    inline void rotate() {
+        // The file is renamed to have the suffix .1 while the older ones have
+        // their suffixes incremented. The oldest one is overwritten.
+
+        if (descriptor <= STDERR_FILENO) return;
+
+        close(descriptor);
+
+        for (size_t i=ROTATIONS; i>0; --i) {
+            std::string from(path);
+
+            if (i > 1) from.append(".").append(std::to_string(i - 1));
+
+            std::string to(path);
+
+            to.append(".").append(std::to_string(i));
+
+            rename(from.c_str(), to.c_str());
+        }
+
+        if (!open_file()) descriptor = STDERR_FILENO;
+    }
+
+    char *ring;
+    std::atomic<size_t> head;
+    std::atomic<size_t> tail;
+    std::atomic<bool> waiting;
+    std::atomic<bool> stopping;
+    std::thread writer;
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::string path;
+    std::string preamble;
+    int descriptor;
+    size_t file_size;
+    size_t max_size;
+    uint64_t dropped;
+    uint64_t lost;
+    std::atomic<uint64_t> failed;
+    uint64_t generation;
+    std::atomic<size_t> rotate_at;
+    std::atomic<bool> rotation_due;
+};
+
+#endif
@@ -0,0 +1,203 @@
+// SPDX-License-Identifier: MIT
+#ifndef LOGLIMIT_H_17_10_2026
+#define LOGLIMIT_H_17_10_2026
+
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+class LOGLIMIT {
+    // Decides whether a log line of a given category is to be written before
+    // the line is formatted. Every category can be turned off, sampled so
+    // that only one in every N lines gets through and limited by a token
+    // bucket refilled once per second. The lines that do not get through are
+    // only counted, so that they could be summarized later.
+
+    public:
+    enum class CATEGORY : uint8_t {
+        CONNECT        = 0,
+        DISCONNECT     = 1,
+        FORWARD        = 2,
+        TIMEOUT        = 3,
+        SLOW           = 4,
+        MAX_CATEGORIES = 5
+    };
+
+    static constexpr const size_t COUNT{
+        static_cast<size_t>(CATEGORY::MAX_CATEGORIES)
+    };
+
+    struct rule_type {
+        bool enabled;
+        uint32_t rate;   // Lines per second, zero for no limit.
+        uint32_t sample; // Only one in every this many lines is considered.
+    };
+
+    LOGLIMIT() : now(0), rules{}, states{} {
+        for (rule_type &rule : rules) rule = {true, 0, 1};
+        for (state_type &state : states) state.refilled = -1;
+    }
+
+    ~LOGLIMIT() {}
+
+    inline void set_time(long long seconds) {
+        now = seconds;
+    }
+
+    inline bool allow(CATEGORY category) {
+        size_t index = static_cast<size_t>(category);
+        const rule_type &rule = rules[index];
+        state_type &state = states[index];
+
+        if (!rule.enabled) {
+            ++state.suppressed;
+            return false;
+        }
+
+        if (rule.sample > 1 && state.seen++ % rule.sample) {
+            ++state.suppressed;
+            return false;
+        }
+
+        if (rule.rate == 0) return true;
+
+        if (state.refilled != now) {
+            uint64_t elapsed = uint64_t(
+                now > state.refilled ? now - state.refilled : 1
+            );
+
+            state.tokens += elapsed * rule.rate;
+
+            if (state.tokens > rule.rate) state.tokens = rule.rate;
+
+            state.refilled = now;
+        }
+
+        if (state.tokens == 0) {
+            ++state.suppressed;
+            return false;
+        }
+
+        --state.tokens;
+
+        return true;
+    }
+
+    inline uint64_t take_suppressed(CATEGORY category) {
+        // Returns the number of lines suppressed since the previous call.
+
+        state_type &state = states[static_cast<size_t>(category)];
+        uint64_t suppressed = state.suppressed - state.summarized;
+
+        state.summarized = state.suppressed;
+
+        return suppressed;
+    }
+
+    inline bool is_enabled(CATEGORY category) const {
+        return rules[static_cast<size_t>(category)].enabled;
+    }
+
+    inline uint64_t get_suppressed(CATEGORY category) const {
+        return states[static_cast<size_t>(category)].suppressed;
+    }
+
+    inline void set_rule(CATEGORY category, const rule_type &rule) {
+        rules[static_cast<size_t>(category)] = rule;
+    }
+
+    inline bool configure(const char *text) {
+        // Parses a rule given as category=on|off[,rate[,sample]] where the
+        // category may also be "all". Returns false if the rule is invalid.
+
+        const char *level = strchr(text, '=');
+
+        if (!level) return false;
+
+        size_t first = 0;
+        size_t last = COUNT;
+        size_t length = size_t(level - text);
+
+        if (length != 3 || strncmp(text, "all", 3)) {
+            for (first = 0; first < COUNT; ++first) {
+                const char *name = category_name(static_cast<CATEGORY>(first));
+
+                if (strlen(name) == length && !strncmp(text, name, length)) {
+                    break;
+                }
+            }
+
+            if (first == COUNT) return false;
+
+            last = first + 1;
+        }
+
+        rule_type rule = rules[first];
+        const char *rest = strchr(++level, ',');
+
+        length = rest ? size_t(rest - level) : strlen(level);
+
+        if (length == 2 && !strncmp(level, "on", 2)) rule.enabled = true;
+        else if (length == 3 && !strncmp(level, "off", 3)) {
+            rule.enabled = false;
+        }
+        else return false;
+
+        if (rest) {
+            char *end = nullptr;
+            unsigned long rate = strtoul(rest + 1, &end, 10);
+
+            if (end == rest + 1 || rate > UINT32_MAX) return false;
+
+            rule.rate = uint32_t(rate);
+
+            if (*end == ',') {
+                rest = end;
+                unsigned long sample = strtoul(rest + 1, &end, 10);
+
+                if (end == rest + 1 || sample == 0 || sample > UINT32_MAX) {
+                    return false;
+                }
+
+                rule.sample = uint32_t(sample);
+            }
+
+            if (*end != '\0') return false;
+        }
+
+        for (size_t i=first; i<last; ++i) {
+            rules[i] = rule;
+        }
+
+        return true;
+    }
+
+    static inline const char *category_name(CATEGORY category) {
+        switch (category) {
+            case CATEGORY::CONNECT:    return "connect";
+            case CATEGORY::DISCONNECT: return "disconnect";
+            case CATEGORY::FORWARD:    return "forward";
+            case CATEGORY::TIMEOUT:    return "timeout";
+            case CATEGORY::SLOW:       return "slow";
+            default:                   break;
+        }
+
+        return "unknown";
+    }
+
+    private:
+    struct state_type {
+        uint64_t seen;
+        uint64_t tokens;
+        uint64_t suppressed;
+        uint64_t summarized;
+        long long refilled;
+    };
+
+    long long now;
+    std::array<rule_type, COUNT> rules;
+    std::array<state_type, COUNT> states;
+};
+
+#endif
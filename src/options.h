@@ -3,11 +3,25 @@
 #define OPTIONS_H_01_01_2021
 
 #include <string>
+#include <vector>
 #include <limits>
+#include <cstdlib>
+#include <cstring>
 #include <getopt.h>
 
 class OPTIONS {
     public:
+    enum class POLICY : uint8_t {
+        ALLOW = 0, // Only count the slow consumers.
+        PAUSE = 1, // Stop reading from the peer until the queue drains.
+        DROP  = 2  // Disconnect the slow consumer.
+    };
+
+    struct queue_policy_type {
+        POLICY action;
+        size_t bytes;    // Budget of the outgoing queue in bytes.
+        uint32_t seconds;// Budget of the queue outgrowing its drain in seconds.
+    };
 
     OPTIONS(
         const char *version,
@@ -15,11 +29,23 @@ class OPTIONS {
         const char *log_src ="Options"
     ) : verbose         (      0)
       , exit_flag       (      0)
+      , binary_log      (      0)
       , supply_port     (      0)
       , demand_port     (      0)
       , driver_port     (      0)
+      , stats_port      (      0)
       , idle_timeout    (     60)
       , driver_period   (     30)
+      , tcp_info_rate   (     64)
+      , supply_queue    {POLICY::ALLOW, 1048576, 10}
+      , demand_queue    {POLICY::ALLOW, 1048576, 10}
+      , log_size        (16777216)
+      , capture         (     "")
+      , journal         (     "")
+      , log_file        (     "")
+      , simulate        (     "")
+      , stats_file      (     "")
+      , trace           (     "")
       , name            (     "")
       , version         (version)
       , logfrom         (log_src)
@@ -29,19 +55,49 @@ class OPTIONS {
 
     int verbose;
     int exit_flag;
+    int binary_log;
     uint16_t supply_port;
     uint16_t demand_port;
     uint16_t driver_port;
+    uint16_t stats_port;
     uint32_t idle_timeout;
     uint32_t driver_period;
+    uint32_t tcp_info_rate;
+    queue_policy_type supply_queue;
+    queue_policy_type demand_queue;
+    size_t log_size;
+    std::string capture;
+    std::string journal;
+    std::string log_file;
+    std::vector<std::string> log_rules;
+    std::vector<std::string> admission_rules;
+    std::vector<std::string> admission_rates;
+    std::string simulate;
+    std::string stats_file;
+    std::string trace;
     std::string name;
 
     static constexpr const char *usage{
         "Options:\n"
+        "  -a  --admit         Connection caps, e.g. demand=10000,100,24.\n"
+        "  -A  --admit-rate    Connection rate per source, e.g. demand=5,20.\n"
+        "      --binary-log    Write the log file as binary records.\n"
         "      --brief         Print brief information (default).\n"
+        "  -c  --capture       Append the shape of the traffic to the file.\n"
+        "  -D  --demand-queue  Slow demand policy (allow,1048576,10).\n"
+        "  -f  --stats-file    Publish statistics in the given mapped file.\n"
         "  -h  --help          Display this usage information.\n"
+        "  -i  --tcp-info      TCP_INFO samples per second (64).\n"
+        "  -j  --journal       Append pair accounting to the given file.\n"
+        "  -l  --log-file      Write the log to the given file.\n"
+        "  -L  --log-size      Rotate the log file at this size (16777216).\n"
+        "  -m  --simulate      Play the given script on a simulated network.\n"
         "  -p  --period        Driver refresh period in seconds (30).\n"
+        "  -r  --log-rule      Log category rule, e.g. forward=on,100,10.\n"
+        "  -s  --stats-port    Serve statistics on the given port.\n"
+        "  -S  --supply-queue  Slow supply policy (allow,1048576,10).\n"
         "  -t  --timeout       Connection idle timeout in seconds (60).\n"
+        "  -T  --trace         File to dump the event trace to on SIGUSR1.\n"
         "      --verbose       Print verbose information.\n"
         "  -v  --version       Show version information.\n"
     };
@@ -69,9 +125,24 @@ class OPTIONS {
                 // These options set a flag:
                 {"brief",       no_argument,       &verbose,   0 },
                 {"verbose",     no_argument,       &verbose,   1 },
+                {"binary-log",  no_argument,       &binary_log, 1 },
                 // These options may take an argument:
+                {"admit",       required_argument, 0,        'a' },
+                {"admit-rate",  required_argument, 0,        'A' },
+                {"tcp-info",    required_argument, 0,        'i' },
+                {"capture",     required_argument, 0,        'c' },
+                {"journal",     required_argument, 0,        'j' },
+                {"stats-file",  required_argument, 0,        'f' },
+                {"log-file",    required_argument, 0,        'l' },
+                {"log-size",    required_argument, 0,        'L' },
+                {"log-rule",    required_argument, 0,        'r' },
+                {"simulate",    required_argument, 0,        'm' },
+                {"demand-queue", required_argument, 0,        'D' },
+                {"supply-queue", required_argument, 0,        'S' },
                 {"period",      required_argument, 0,        'p' },
+                {"stats-port",  required_argument, 0,        's' },
                 {"timeout",     required_argument, 0,        't' },
+                {"trace",       required_argument, 0,        'T' },
                 {"help",        no_argument,       0,        'h' },
                 {"version",     no_argument,       0,        'v' },
                 {0,             0,                 0,          0 }
@@ -79,7 +150,8 @@ class OPTIONS {
 
             int option_index = 0;
             c = getopt_long(
-                argc, argv, "p:t:hv", long_options, &option_index
+                argc, argv, "a:A:c:D:f:i:j:l:L:m:p:r:s:S:t:T:hv", long_options,
+                &option_index
             );
 
             if (c == -1) break; // End of command line parameters?
@@ -100,6 +172,80 @@ class OPTIONS {
                     log(logfrom.c_str(), buf.c_str());
                     break;
                 }
+                case 'a': {
+                    admission_rules.emplace_back(optarg);
+                    break;
+                }
+                case 'A': {
+                    admission_rates.emplace_back(optarg);
+                    break;
+                }
+                case 'D': {
+                    if (!parse_queue_policy(optarg, demand_queue)) {
+                        log(
+                            logfrom.c_str(), "invalid demand queue policy: %s",
+                            optarg
+                        );
+                        return false;
+                    }
+                    break;
+                }
+                case 'S': {
+                    if (!parse_queue_policy(optarg, supply_queue)) {
+                        log(
+                            logfrom.c_str(), "invalid supply queue policy: %s",
+                            optarg
+                        );
+                        return false;
+                    }
+                    break;
+                }
+                case 'i': {
+                    int i = atoi(optarg);
+                    if ((i == 0 && (optarg[0] != '0' || optarg[1] != '\0'))
+                    ||  (i < 0)) {
+                        log(
+                            logfrom.c_str(), "invalid TCP_INFO rate: %s",
+                            optarg
+                        );
+                        return false;
+                    }
+                    else tcp_info_rate = uint32_t(i);
+                    break;
+                }
+                case 'f': {
+                    stats_file = optarg;
+                    break;
+                }
+                case 'c': {
+                    capture = optarg;
+                    break;
+                }
+                case 'j': {
+                    journal = optarg;
+                    break;
+                }
+                case 'l': {
+                    log_file = optarg;
+                    break;
+                }
+                case 'L': {
+                    char *end = nullptr;
+                    unsigned long long size = strtoull(optarg, &end, 10);
+
+                    if (end == optarg || *end != '\0') {
+                        log(
+                            logfrom.c_str(), "invalid log size: %s", optarg
+                        );
+                        return false;
+                    }
+                    else log_size = size_t(size);
+                    break;
+                }
+                case 'm': {
+                    simulate = optarg;
+                    break;
+                }
                 case 'p': {
                     int i = atoi(optarg);
                     if ((i == 0 && (optarg[0] != '0' || optarg[1] != '\0'))
@@ -112,6 +258,22 @@ class OPTIONS {
                     else driver_period = uint32_t(i);
                     break;
                 }
+                case 'r': {
+                    log_rules.emplace_back(optarg);
+                    break;
+                }
+                case 's': {
+                    int p = atoi(optarg);
+
+                    if (p <= 0 || p > std::numeric_limits<uint16_t>::max()) {
+                        log(
+                            logfrom.c_str(), "invalid stats port: %s", optarg
+                        );
+                        return false;
+                    }
+                    else stats_port = uint16_t(p);
+                    break;
+                }
                 case 't': {
                     int i = atoi(optarg);
                     if ((i == 0 && (optarg[0] != '0' || optarg[1] != '\0'))
@@ -124,6 +286,10 @@ class OPTIONS {
                     else idle_timeout = uint32_t(i);
                     break;
                 }
+                case 'T': {
+                    trace = optarg;
+                    break;
+                }
                 case 'h': {
                     log(nullptr, "%s\n", print_usage().c_str());
                     exit_flag = 1;
@@ -208,6 +374,47 @@ class OPTIONS {
     }
 
     private:
+    static bool parse_queue_policy(const char *arg, queue_policy_type &policy) {
+        // The policy is given as its name optionally followed by the budget
+        // of the queue in bytes and then in seconds, separated by commas.
+
+        const char *budget = strchr(arg, ',');
+        size_t length = budget ? size_t(budget - arg) : strlen(arg);
+
+        if (length == 5 && !strncmp(arg, "allow", length)) {
+            policy.action = POLICY::ALLOW;
+        }
+        else if (length == 5 && !strncmp(arg, "pause", length)) {
+            policy.action = POLICY::PAUSE;
+        }
+        else if (length == 4 && !strncmp(arg, "drop", length)) {
+            policy.action = POLICY::DROP;
+        }
+        else return false;
+
+        if (!budget) return true;
+
+        char *end = nullptr;
+        unsigned long long bytes = strtoull(budget + 1, &end, 10);
+
+        if (end == budget + 1 || bytes == 0) return false;
+
+        policy.bytes = size_t(bytes);
+
+        if (*end == '\0') return true;
+        if (*end != ',') return false;
+
+        budget = end;
+        unsigned long seconds = strtoul(budget + 1, &end, 10);
+
+        if (end == budget + 1 || *end != '\0') return false;
+        if (seconds > std::numeric_limits<uint32_t>::max()) return false;
+
+        policy.seconds = uint32_t(seconds);
+
+        return true;
+    }
+
     static void drop_log(const char *, const char *, ...) {}
 
     std::string version;
@@ -0,0 +1,55 @@
+#!/bin/sh
+# SPDX-License-Identifier: MIT
+# Runs the same workloads against two builds of the herald, one at a time, and
+# prints the rate of pairs along with the processor time that the herald spent
+# per pair, which is less at the mercy of the load generator than the rate.
+#
+# Usage: compare.sh baseline optimized bench [port]
+
+BASELINE=$1
+OPTIMIZED=$2
+BENCH=$3
+PORT=${4:-17200}
+
+if [ ! -x "$BASELINE" ] || [ ! -x "$OPTIMIZED" ] || [ ! -x "$BENCH" ]; then
+    echo "usage: $0 baseline optimized bench [port]" >&2
+    exit 1
+fi
+
+SUPPLY=$PORT
+DEMAND=$((PORT + 1))
+
+measure() {
+    # Prints the pairs per second and the microseconds of processor time
+    # used by the herald per pair.
+
+    "$1" $SUPPLY $DEMAND 2> /dev/null &
+    pid=$!
+
+    sleep 0.5
+
+    "$BENCH" --pid $pid --mode $2 --clients $3 --duration 5 $SUPPLY $DEMAND |
+    awk '
+        /^Pairs:/  { rate = $NF; sub("/s", "", rate) }
+        /^Herald:/ { cpu = $2; sub("%", "", cpu) }
+        END        {
+            us = rate > 0 ? cpu * 10000 / rate : 0
+            printf " %12s %10.1f", rate " /s", us
+        }
+    '
+
+    kill -TERM $pid
+    wait $pid
+}
+
+printf "%-20s %12s %10s %12s %10s\n" \
+    "Workload" "Baseline" "us/pair" "Optimized" "us/pair"
+
+for workload in "churn 200" "rr 100"; do
+    set -- $workload
+
+    printf "%-20s" "$1, $2 clients"
+    measure "$BASELINE" $1 $2
+    measure "$OPTIMIZED" $1 $2
+    printf "\n"
+done
@@ -0,0 +1,49 @@
+#!/bin/sh
+# SPDX-License-Identifier: MIT
+# Runs the training workload of the profile-guided build over the loopback
+# interface: requests and responses, churn, bulk streams and a driver, with
+# the statistics being scraped along the way.
+#
+# Usage: train.sh herald bench [port]
+
+HERALD=$1
+BENCH=$2
+PORT=${3:-17100}
+
+if [ ! -x "$HERALD" ] || [ ! -x "$BENCH" ]; then
+    echo "usage: $0 herald bench [port]" >&2
+    exit 1
+fi
+
+SUPPLY=$PORT
+DEMAND=$((PORT + 1))
+DRIVER=$((PORT + 2))
+STATS=$((PORT + 3))
+
+"$HERALD" --stats-port $STATS --period 1 $SUPPLY $DEMAND $DRIVER \
+    2> /dev/null &
+PID=$!
+
+sleep 0.5
+
+status=0
+
+train() {
+    "$BENCH" "$@" > /dev/null || status=1
+}
+
+train --mode rr --clients 100 --duration 3 $SUPPLY $DEMAND
+train --mode churn --clients 200 --duration 3 $SUPPLY $DEMAND
+train --mode bulk --clients 8 --duration 2 $SUPPLY $DEMAND
+train --mode churn --clients 50 --duration 2 $SUPPLY $DEMAND $DRIVER
+
+if command -v curl > /dev/null; then
+    curl -s http://127.0.0.1:$STATS/metrics > /dev/null
+fi
+
+# The profile is written out when the herald exits normally.
+
+kill -TERM $PID
+wait $PID || status=1
+
+exit $status
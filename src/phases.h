@@ -0,0 +1,131 @@
+// SPDX-License-Identifier: MIT
+#ifndef PHASES_H_17_10_2026
+#define PHASES_H_17_10_2026
+
+#include <array>
+#include <cstdint>
+
+#include "trace.h"
+
+class PHASES {
+    // Exclusive accounting of the time spent in each phase of the event loop.
+    // Switching to another phase charges the ticks elapsed since the previous
+    // switch to the phase that was active until then. Since a switch is a
+    // single read of the time-stamp counter, the accounting is kept on at all
+    // times unless TCPHERALD_NO_PHASES is defined, in which case it compiles
+    // down to nothing.
+
+    public:
+    enum class PHASE : uint8_t {
+        OTHER      = 0,
+        SIGNALS    = 1,
+        WAIT       = 2, // Waiting in epoll_pwait.
+        SERVE      = 3, // Walking the flags of the descriptors.
+        MATCH      = 4, // Pairing new connections and notifying drivers.
+        FORWARD    = 5, // Forwarding the incoming bytes.
+        TIMEOUT    = 6, // Scanning for idle connections.
+        LOG        = 7,
+        MAX_PHASES = 8
+    };
+
+    static constexpr const size_t COUNT{
+        static_cast<size_t>(PHASE::MAX_PHASES)
+    };
+
+    PHASES()
+    : active    (PHASE::OTHER)
+    , since     (TRACE::get_ticks())
+    , init_ticks(since)
+    , init_nsec (TRACE::get_nsec())
+    , iterations(0)
+    , current   {}
+    , total     {}
+    , max       {} {}
+
+    ~PHASES() {}
+
+    inline PHASE enter(PHASE phase) {
+        // Returns the phase that was active until now, so that the caller could
+        // switch back to it later.
+
+        PHASE previous = active;
+#ifndef TCPHERALD_NO_PHASES
+        uint64_t now = TRACE::get_ticks();
+
+        current[static_cast<size_t>(active)] += now - since;
+        since = now;
+        active = phase;
+#endif
+        return previous;
+    }
+
+    inline void next_iteration() {
+#ifndef TCPHERALD_NO_PHASES
+        enter(active);
+
+        for (size_t i=0; i<COUNT; ++i) {
+            total[i] += current[i];
+
+            if (current[i] > max[i]) max[i] = current[i];
+
+            current[i] = 0;
+        }
+
+        ++iterations;
+#endif
+    }
+
+    inline uint64_t get_iterations() const {
+        return iterations;
+    }
+
+    inline double get_total(PHASE phase) const {
+        return to_seconds(total[static_cast<size_t>(phase)]);
+    }
+
+    inline double get_max(PHASE phase) const {
+        return to_seconds(max[static_cast<size_t>(phase)]);
+    }
+
+    static inline const char *phase_name(PHASE phase) {
+        switch (phase) {
+            case PHASE::OTHER:   return "other";
+            case PHASE::SIGNALS: return "signals";
+            case PHASE::WAIT:    return "wait";
+            case PHASE::SERVE:   return "serve";
+            case PHASE::MATCH:   return "match";
+            case PHASE::FORWARD: return "forward";
+            case PHASE::TIMEOUT: return "timeout";
+            case PHASE::LOG:     return "log";
+            default:             break;
+        }
+
+        return "unknown";
+    }
+
+    private:
+    inline double to_seconds(uint64_t ticks) const {
+        // The rate of the ticks is measured against the monotonic clock over
+        // the whole lifetime of this instance.
+
+        uint64_t elapsed_ticks = TRACE::get_ticks() - init_ticks;
+        uint64_t elapsed_nsec = TRACE::get_nsec() - init_nsec;
+
+        if (elapsed_ticks == 0) return 0.0;
+
+        return (
+            double(ticks) * double(elapsed_nsec) / double(elapsed_ticks) / 1e9
+        );
+    }
+
+    PHASE active;
+    uint64_t since;
+    uint64_t init_ticks;
+    uint64_t init_nsec;
+    uint64_t iterations;
+    std::array<uint64_t, COUNT> current;
+    std::array<uint64_t, COUNT> total;
+    std::array<uint64_t, COUNT> max;
+};
+
+#endif
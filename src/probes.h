@@ -0,0 +1,42 @@
+// SPDX-License-Identifier: MIT
+#ifndef PROBES_H_17_10_2026
+#define PROBES_H_17_10_2026
+
+// Statically defined tracing probes in the style of sys/sdt.h. A probe costs a
+// single nop instruction until a tracer such as bpftrace or perf attaches to
+// it. The probes are left out altogether if the header is not available or if
+// TCPHERALD_NO_PROBES is defined.
+//
+// The probes of the tcpherald provider and their arguments are as follows:
+//
+//   accept  (descriptor, listener)
+//   read    (descriptor, bytes)
+//   write   (descriptor, bytes, microseconds since the oldest forwarded chunk
+//            completed by the write was queued, zero if none)
+//   close   (descriptor)
+//   pair    (demand, supply, demand wait in us, supply wait in us)
+//   timeout (descriptor, idle seconds)
+
+#if !defined(TCPHERALD_NO_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define TCPHERALD_PROBES 1
+#endif
+#endif
+
+#ifdef TCPHERALD_PROBES
+#define PROBE1(name, a1) STAP_PROBE1(tcpherald, name, a1)
+#define PROBE2(name, a1, a2) STAP_PROBE2(tcpherald, name, a1, a2)
+#define PROBE3(name, a1, a2, a3) STAP_PROBE3(tcpherald, name, a1, a2, a3)
+#define PROBE4(name, a1, a2, a3, a4) \
+    STAP_PROBE4(tcpherald, name, a1, a2, a3, a4)
+#else
+#define PROBE1(name, a1) do { (void) (a1); } while (0)
+#define PROBE2(name, a1, a2) do { (void) (a1); (void) (a2); } while (0)
+#define PROBE3(name, a1, a2, a3) \
+    do { (void) (a1); (void) (a2); (void) (a3); } while (0)
+#define PROBE4(name, a1, a2, a3, a4) \
+    do { (void) (a1); (void) (a2); (void) (a3); (void) (a4); } while (0)
+#endif
+
+#endif
@@ -0,0 +1,94 @@
+// SPDX-License-Identifier: MIT
+#ifndef PROCSTAT_H_17_10_2026
+#define PROCSTAT_H_17_10_2026
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <time.h>
+#include <unistd.h>
+
+class PROCSTAT {
+    // Samples the resource usage of a process from the proc file system, so
+    // that the tools could measure a tcpherald instance from the outside.
+
+    public:
+    struct sample_type {
+        long long usec;      // Monotonic time of the sample.
+        uint64_t  cpu_ticks; // User and system time in clock ticks.
+        size_t    rss;       // Resident set size in bytes.
+    };
+
+    static inline bool sample(int pid, sample_type &out) {
+        char path[64];
+        char line[1024];
+
+        out.usec = get_usec();
+
+        snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+
+        FILE *fp = fopen(path, "r");
+
+        if (!fp) return false;
+
+        bool found = fgets(line, sizeof(line), fp) != nullptr;
+
+        fclose(fp);
+
+        // The name of the executable may contain spaces, which is why the
+        // fields are counted from the last closing parenthesis.
+
+        const char *at = found ? strrchr(line, ')') : nullptr;
+
+        if (!at) return false;
+
+        unsigned long long utime = 0;
+        unsigned long long stime = 0;
+        long long rss_pages = 0;
+
+        if (sscanf(
+            at + 2,
+            "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu "
+            "%*d %*d %*d %*d %*d %*d %*u %*u %lld", &utime, &stime, &rss_pages
+        ) != 3) {
+            return false;
+        }
+
+        out.cpu_ticks = utime + stime;
+        out.rss = size_t(rss_pages > 0 ? rss_pages : 0) * page_size();
+
+        return true;
+    }
+
+    static inline double cpu_share(
+        const sample_type &from, const sample_type &to
+    ) {
+        // Returns the share of a single processor used between the samples.
+
+        if (to.usec <= from.usec || to.cpu_ticks < from.cpu_ticks) return 0.0;
+
+        double seconds = double(to.cpu_ticks - from.cpu_ticks) / double(
+            sysconf(_SC_CLK_TCK)
+        );
+
+        return seconds * 1000000.0 / double(to.usec - from.usec);
+    }
+
+    static inline long long get_usec() {
+        struct timespec ts;
+
+        if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0) return 0;
+
+        return (long long)(ts.tv_sec) * 1000000LL + ts.tv_nsec / 1000;
+    }
+
+    private:
+    static inline size_t page_size() {
+        long size = sysconf(_SC_PAGESIZE);
+
+        return size > 0 ? size_t(size) : 4096;
+    }
+};
+
+#endif
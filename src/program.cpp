@@ -3,22 +3,41 @@
 #include <stdarg.h>
 #include <unordered_map>
 #include <unordered_set>
-#include <chrono>
-
+#include <algorithm>
+#include <malloc.h>
+
+#include "admission.h"
+#include "allocs.h"
+#include "binlog.h"
+#include "journal.h"
+#include "capture.h"
+#include "kernel.h"
+#include "logger.h"
+#include "loglimit.h"
 #include "options.h"
+#include "probes.h"
 #include "program.h"
+#include "segment.h"
 #include "signals.h"
+#include "simnet.h"
 #include "sockets.h"
+#include "stats.h"
+#include "trace.h"
 
 volatile sig_atomic_t
     SIGNALS::sig_alarm{0},
     SIGNALS::sig_pipe {0},
     SIGNALS::sig_int  {0},
     SIGNALS::sig_term {0},
-    SIGNALS::sig_quit {0};
+    SIGNALS::sig_quit {0},
+    SIGNALS::sig_usr1 {0};
 
-size_t PROGRAM::log_size = 0;
-bool   PROGRAM::log_time = false;
+size_t  PROGRAM::log_size = 0;
+bool    PROGRAM::log_time = false;
+LOGGER *PROGRAM::logger   = nullptr;
+BINLOG *PROGRAM::binlog   = nullptr;
+const KERNEL *PROGRAM::kernel = &KERNEL::native();
+SIMNET *SIMNET::active    = nullptr;
 
 void PROGRAM::run() {
     if (!options) return bug();
@@ -46,6 +65,14 @@ void PROGRAM::run() {
         );
     }
 
+    int stats_descriptor = SOCKETS::NO_DESCRIPTOR;
+
+    if (get_stats_port()) {
+        stats_descriptor = sockets->listen(
+            std::to_string(get_stats_port()).c_str()
+        );
+    }
+
     if (supply_descriptor == SOCKETS::NO_DESCRIPTOR
     ||  demand_descriptor == SOCKETS::NO_DESCRIPTOR) {
         terminated = true;
@@ -68,22 +95,249 @@ void PROGRAM::run() {
                 int(get_driver_port())
             );
         }
+
+        if (stats_descriptor != SOCKETS::NO_DESCRIPTOR) {
+            log("Serving statistics on port %d...", int(get_stats_port()));
+        }
     }
 
     std::vector<uint8_t> buffer;
     std::unordered_map<int, long long> timestamp_map;
+    std::unordered_map<int, long long> usec_map;
     std::unordered_map<int, int> supply_map;
     std::unordered_map<int, int> demand_map;
     std::unordered_set<int> unmet_supply;
     std::unordered_set<int> unmet_demand;
     std::unordered_set<int> drivers;
+    std::unordered_set<int> scrapers;
+    std::unordered_set<int> scraped;
+    std::string report;
+    std::unordered_map<int, int> paused; // Slow consumers and their peers.
+    std::unordered_set<int> slow;
+    SOCKETS::queue_type queue{};
 
     static constexpr const size_t USEC_PER_SEC = 1000000;
+    static constexpr const long long HEAP_PERIOD = 10000000; // Microseconds.
+
+    long long heap_checked = 0;
+
+    auto is_over_budget = [&](const OPTIONS::queue_policy_type &policy) {
+        long long budget = (long long) policy.seconds * (long long) USEC_PER_SEC;
+
+        return queue.size > policy.bytes || (
+            policy.seconds > 0 && queue.growing > budget
+        );
+    };
+
+    auto police = [&](int consumer, int source, bool supply_side) {
+        // Applies the policy of the side of the consumer if its outgoing
+        // queue has gone over the budget. Returns true if it has.
+
+        const OPTIONS::queue_policy_type &policy = (
+            supply_side ? options->supply_queue : options->demand_queue
+        );
+
+        STATS::consumer_type &counters = (
+            supply_side ? stats->slow_supply : stats->slow_demand
+        );
+
+        if (!sockets->get_outgoing_queue(consumer, queue)
+        ||  !is_over_budget(policy)) {
+            return false;
+        }
+
+        if (slow.insert(consumer).second) {
+            ++counters.detected;
+
+            if (limits->allow(LOGLIMIT::CATEGORY::SLOW)) {
+                log(
+                    "Connection %s:%s is a slow consumer (descriptor %d, "
+                    "%lu byte%s queued).", sockets->get_host(consumer),
+                    sockets->get_port(consumer), consumer, queue.size,
+                    queue.size == 1 ? "" : "s"
+                );
+            }
+        }
+
+        switch (policy.action) {
+            case OPTIONS::POLICY::PAUSE: {
+                if (!paused.count(consumer)) {
+                    paused[consumer] = source;
+                    sockets->pause(source);
+                    ++counters.paused;
+                }
+
+                break;
+            }
+            case OPTIONS::POLICY::DROP: {
+                ++counters.dropped;
+
+                if (journal) {
+                    journal->end(
+                        supply_side ? consumer : source,
+                        JOURNAL::REASON::SLOW_CONSUMER
+                    );
+                }
+
+                if (capture) {
+                    capture->end(
+                        supply_side ? consumer : source, get_usec()
+                    );
+                }
+
+                sockets->disconnect(consumer);
+                break;
+            }
+            case OPTIONS::POLICY::ALLOW: break;
+        }
+
+        return true;
+    };
+
+    auto map_bytes = [](const auto &map) -> uint64_t {
+        // Every element is a node holding the value and a pointer to the next
+        // node, while every bucket is a pointer.
+
+        using map_type = typename std::decay<decltype(map)>::type;
+
+        return map.size() * (
+            sizeof(void *) + sizeof(typename map_type::value_type)
+        ) + map.bucket_count() * sizeof(void *);
+    };
+
+    auto refresh_gauges = [&]() {
+        SOCKETS::memory_type memory;
+        SOCKETS::exhaustion_type exhaustion;
+
+        stats->unmet_supply = unmet_supply.size();
+        stats->unmet_demand = unmet_demand.size();
+        stats->paired = demand_map.size();
+        stats->incoming_bytes = sockets->get_incoming_total();
+        stats->outgoing_bytes = sockets->get_outgoing_total();
+        stats->log_dropped = logger ? logger->get_lost() : 0;
+        stats->log_failed = logger ? logger->get_failed() : 0;
+        stats->allocations = ALLOCS::count();
+
+        sockets->get_memory(memory);
+
+        stats->descriptors = memory.count;
+        stats->memory_records = memory.records;
+        stats->memory_buffers = memory.buffers;
+        stats->memory_flags = memory.flags;
+        stats->memory_maps = (
+            map_bytes(timestamp_map) + map_bytes(usec_map) +
+            map_bytes(supply_map) + map_bytes(demand_map) +
+            map_bytes(unmet_supply) + map_bytes(unmet_demand) +
+            map_bytes(drivers) + map_bytes(scrapers) + map_bytes(scraped) +
+            map_bytes(paused) + map_bytes(slow) + memory.groups
+        );
+
+        if (admission) {
+            const struct {
+                ADMISSION::LISTENER listener;
+                STATS::listener_type &counts;
+            } listeners[]{
+                { ADMISSION::LISTENER::SUPPLY, stats->supply  },
+                { ADMISSION::LISTENER::DEMAND, stats->demand  },
+                { ADMISSION::LISTENER::DRIVER, stats->driver  },
+                { ADMISSION::LISTENER::STATS,  stats->scraper }
+            };
+
+            for (const auto &row : listeners) {
+                const ADMISSION::counts_type &counts{
+                    admission->get_counts(row.listener)
+                };
+
+                row.counts.over_total = counts.over_total;
+                row.counts.over_source = counts.over_source;
+                row.counts.over_rate = counts.over_rate;
+            }
+
+            stats->admitted_sources = admission->get_sources();
+            stats->rate_evictions = admission->get_evictions();
+            stats->memory_maps += admission->get_memory();
+        }
+
+        sockets->get_exhaustion(exhaustion);
+
+        stats->descriptor_limit = exhaustion.limit;
+        stats->descriptor_headroom = exhaustion.headroom;
+        stats->accept_shed = exhaustion.shed;
+        stats->accept_pauses = exhaustion.pauses;
+        stats->accept_paused = exhaustion.paused;
+
+        long long now = get_usec();
+
+        if (heap_checked && now - heap_checked < HEAP_PERIOD) return;
+
+        heap_checked = now;
+
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+        // The allocator is asked for the bytes in use, including the large
+        // blocks that were mapped separately. Since that walks the heap with
+        // the arenas locked, it is only done once per period.
+
+        struct mallinfo2 heap = mallinfo2();
+
+        stats->memory_heap = heap.uordblks + heap.hblkhd;
+#endif
+    };
+
+    auto rank_queue = [&](int descriptor, const char *side) {
+        // Keeps the deepest outgoing queues in the statistics.
+
+        std::vector<STATS::queue_type> &top = stats->top_queues;
+
+        if (!sockets->get_outgoing_queue(descriptor, queue)
+        ||  queue.size == 0
+        || (top.size() >= STATS::TOP_QUEUES && top.back().size >= queue.size)) {
+            return;
+        }
+
+        STATS::queue_type entry{
+            side, queue.size, queue.growth, queue.drain,
+            double(queue.age) / double(USEC_PER_SEC),
+            std::string(sockets->get_host(descriptor)).append(":").append(
+                sockets->get_port(descriptor)
+            )
+        };
+
+        top.insert(
+            std::upper_bound(
+                top.begin(), top.end(), entry,
+                [](const STATS::queue_type &a, const STATS::queue_type &b) {
+                    return a.size > b.size;
+                }
+            ), entry
+        );
+
+        if (top.size() > STATS::TOP_QUEUES) top.pop_back();
+    };
     bool alarmed = false;
+    bool dumping = false;
     set_timer(USEC_PER_SEC);
 
+    sockets->set_latency_histogram(&stats->write_latency);
+    sockets->set_trace(trace);
+    sockets->set_phases(&stats->phases);
+    sockets->set_accept_sketches(
+        &stats->connecting_hosts, &stats->distinct_hosts
+    );
+
+    if (admission) {
+        admission->bind(ADMISSION::LISTENER::SUPPLY, supply_descriptor);
+        admission->bind(ADMISSION::LISTENER::DEMAND, demand_descriptor);
+        admission->bind(ADMISSION::LISTENER::DRIVER, driver_descriptor);
+        admission->bind(ADMISSION::LISTENER::STATS, stats_descriptor);
+
+        sockets->set_admission(admission);
+    }
+
     do {
         alarmed = false;
+        dumping = false;
+
+        stats->phases.enter(PHASES::PHASE::SIGNALS);
 
         signals->block();
         while (int sig = signals->next()) {
@@ -94,6 +348,10 @@ void PROGRAM::run() {
                     alarmed = true;
                     break;
                 }
+                case SIGUSR1: {
+                    dumping = true;
+                    break;
+                }
                 case SIGINT :
                 case SIGTERM:
                 case SIGQUIT: terminated = true; // fall through
@@ -111,37 +369,85 @@ void PROGRAM::run() {
             }
         }
 
-        if (alarmed) set_timer(USEC_PER_SEC);
+        if (alarmed) {
+            set_timer(USEC_PER_SEC);
+
+            if (journal) journal->flush();
+            if (capture) capture->flush();
+        }
 
         signals->unblock();
 
+        stats->phases.enter(PHASES::PHASE::OTHER);
+
+        if (dumping) {
+            dump_stats();
+            dump_trace();
+        }
+
         if (terminated) {
             sockets->disconnect(demand_descriptor);
             sockets->disconnect(supply_descriptor);
             sockets->disconnect(driver_descriptor);
+            sockets->disconnect(stats_descriptor);
 
             continue;
         }
 
+        stats->phases.enter(PHASES::PHASE::SERVE);
+
         if (!alarmed && !sockets->serve()) {
             log("%s", "Error while serving the listening descriptors.");
             status = EXIT_FAILURE;
             terminated = true;
         }
 
+        stats->phases.enter(PHASES::PHASE::MATCH);
+
         long long timestamp = get_timestamp();
+        long long usec = get_usec();
+
+        limits->set_time(timestamp);
 
         int d = SOCKETS::NO_DESCRIPTOR;
         while ((d = sockets->next_disconnection()) != SOCKETS::NO_DESCRIPTOR) {
-            log(
-                "Disconnected %s:%s (descriptor %d).",
-                sockets->get_host(d), sockets->get_port(d), d
-            );
+            if (limits->allow(LOGLIMIT::CATEGORY::DISCONNECT)) {
+                log(
+                    "Disconnected %s:%s (descriptor %d).",
+                    sockets->get_host(d), sockets->get_port(d), d
+                );
+            }
 
             if (timestamp_map.count(d)) {
                 timestamp_map.erase(d);
             }
 
+            slow.erase(d);
+            paused.erase(d);
+
+            long long since = usec;
+
+            if (usec_map.count(d)) {
+                since = usec_map[d];
+                usec_map.erase(d);
+            }
+
+            int listener = sockets->get_listener(d);
+
+            if (listener == SOCKETS::NO_DESCRIPTOR) {
+                // Listeners themselves are not accounted for.
+            }
+            else if (listener == supply_descriptor) ++stats->supply.closed;
+            else if (listener == demand_descriptor) ++stats->demand.closed;
+            else if (listener == driver_descriptor) ++stats->driver.closed;
+            else if (listener == stats_descriptor ) ++stats->scraper.closed;
+
+            if (scrapers.count(d)) {
+                scrapers.erase(d);
+                scraped.erase(d);
+                continue;
+            }
+
             if (drivers.count(d)) {
                 drivers.erase(d);
                 continue;
@@ -163,6 +469,26 @@ void PROGRAM::run() {
             }
 
             if (other_descriptor != SOCKETS::NO_DESCRIPTOR) {
+                stats->pair_lifetime.record(uint64_t(usec - since));
+
+                if (journal) {
+                    if (supply_map.count(other_descriptor)) {
+                        journal->end(
+                            other_descriptor, JOURNAL::REASON::DEMAND_CLOSED
+                        );
+                    }
+                    else {
+                        journal->end(d, JOURNAL::REASON::SUPPLY_CLOSED);
+                    }
+                }
+
+                if (capture) {
+                    capture->end(
+                        supply_map.count(other_descriptor) ?
+                        other_descriptor : d, usec
+                    );
+                }
+
                 if (supply_map.count(other_descriptor)) {
                     supply_map[other_descriptor] = SOCKETS::NO_DESCRIPTOR;
                 }
@@ -177,16 +503,21 @@ void PROGRAM::run() {
         size_t new_demand = 0;
 
         while ((d = sockets->next_connection()) != SOCKETS::NO_DESCRIPTOR) {
-            log(
-                "New connection from %s:%s (descriptor %d).",
-                sockets->get_host(d), sockets->get_port(d), d
-            );
+            if (limits->allow(LOGLIMIT::CATEGORY::CONNECT)) {
+                log(
+                    "New connection from %s:%s (descriptor %d).",
+                    sockets->get_host(d), sockets->get_port(d), d
+                );
+            }
 
             timestamp_map[d] = timestamp;
+            usec_map[d] = usec;
 
             int listener = sockets->get_listener(d);
 
             if (listener == supply_descriptor) {
+                ++stats->supply.accepted;
+
                 if (unmet_demand.empty()) {
                     unmet_supply.insert(d);
                     sockets->freeze(d);
@@ -198,9 +529,38 @@ void PROGRAM::run() {
                     demand_map[other_descriptor] = d;
                     sockets->unfreeze(other_descriptor);
                     timestamp_map[other_descriptor] = timestamp;
+                    ++stats->pairs;
+                    if (trace) {
+                        trace->record(TRACE::TYPE::PAIR, other_descriptor, d);
+                    }
+
+                    stats->supply_wait.record(0);
+                    stats->demand_wait.record(
+                        uint64_t(usec - usec_map[other_descriptor])
+                    );
+
+                    PROBE4(
+                        pair, other_descriptor, d,
+                        usec - usec_map[other_descriptor], 0
+                    );
+                    usec_map[other_descriptor] = usec;
+
+                    if (journal) {
+                        journal->begin(
+                            d,
+                            sockets->get_host(d),
+                            sockets->get_port(d),
+                            sockets->get_host(other_descriptor),
+                            sockets->get_port(other_descriptor)
+                        );
+                    }
+
+                    if (capture) capture->begin(d, usec);
                 }
             }
             else if (listener == demand_descriptor) {
+                ++stats->demand.accepted;
+
                 if (unmet_supply.empty()) {
                     unmet_demand.insert(d);
                     sockets->freeze(d);
@@ -213,10 +573,38 @@ void PROGRAM::run() {
                     supply_map[other_descriptor] = d;
                     sockets->unfreeze(other_descriptor);
                     timestamp_map[other_descriptor] = timestamp;
+                    ++stats->pairs;
+                    if (trace) {
+                        trace->record(TRACE::TYPE::PAIR, d, other_descriptor);
+                    }
+
+                    stats->demand_wait.record(0);
+                    stats->supply_wait.record(
+                        uint64_t(usec - usec_map[other_descriptor])
+                    );
+
+                    PROBE4(
+                        pair, d, other_descriptor, 0,
+                        usec - usec_map[other_descriptor]
+                    );
+                    usec_map[other_descriptor] = usec;
+
+                    if (journal) {
+                        journal->begin(
+                            other_descriptor,
+                            sockets->get_host(other_descriptor),
+                            sockets->get_port(other_descriptor),
+                            sockets->get_host(d),
+                            sockets->get_port(d)
+                        );
+                    }
+
+                    if (capture) capture->begin(other_descriptor, usec);
                 }
             }
             else if (listener == driver_descriptor
             && driver_descriptor != SOCKETS::NO_DESCRIPTOR) {
+                ++stats->driver.accepted;
                 drivers.insert(d);
 
                 timestamp_map[d] = (
@@ -225,6 +613,12 @@ void PROGRAM::run() {
                 );
 
                 sockets->writef(d, "%lu\n", unmet_demand.size());
+                ++stats->driver_messages;
+            }
+            else if (listener == stats_descriptor
+            && stats_descriptor != SOCKETS::NO_DESCRIPTOR) {
+                ++stats->scraper.accepted;
+                scrapers.insert(d);
             }
             else log("Forbidden condition met (%s:%d).", __FILE__, __LINE__);
         }
@@ -253,18 +647,97 @@ void PROGRAM::run() {
                     sockets->writef(driver, "%lu\n", new_demand);
                 }
 
+                ++stats->driver_messages;
+
                 timestamp_map[driver] = timestamp;
             }
         }
 
+        stats->phases.enter(PHASES::PHASE::FORWARD);
+
+        for (auto it = paused.begin(); it != paused.end();) {
+            // The peers of the slow consumers are resumed once the queue has
+            // drained to half of its budget.
+
+            const OPTIONS::queue_policy_type &policy = (
+                supply_map.count(it->first) ?
+                options->supply_queue : options->demand_queue
+            );
+
+            if (sockets->get_outgoing_queue(it->first, queue)
+            &&  (queue.size > policy.bytes / 2 || is_over_budget(policy))) {
+                ++it;
+                continue;
+            }
+
+            sockets->resume(it->second);
+            it = paused.erase(it);
+        }
+
         while ((d = sockets->next_incoming()) != SOCKETS::NO_DESCRIPTOR) {
             sockets->swap_incoming(d, buffer);
 
-            if (!drivers.count(d)) {
+            if (scrapers.count(d)) {
+                static constexpr const char trace_request[]{"GET /trace "};
+
+                if (!scraped.count(d)
+                && buffer.size() >= sizeof(trace_request) - 1
+                && !memcmp(
+                    buffer.data(), trace_request, sizeof(trace_request) - 1
+                )) {
+                    buffer.clear();
+                    if (trace) trace->serialize(buffer);
+
+                    sockets->writef(
+                        d,
+                        "HTTP/1.0 200 OK\r\n"
+                        "Content-Type: application/octet-stream\r\n"
+                        "Content-Length: %lu\r\n"
+                        "Connection: close\r\n\r\n", buffer.size()
+                    );
+
+                    sockets->append_outgoing(d, buffer);
+                    scraped.insert(d);
+                }
+                else if (!scraped.count(d)) {
+                    // Any other request is responded to with the metrics. The
+                    // client is disconnected once the response has been sent.
+
+                    refresh_gauges();
+                    stats->top_queues.clear();
+
+                    for (const auto &p : supply_map) {
+                        rank_queue(p.first, "supply");
+                    }
+
+                    for (const auto &p : demand_map) {
+                        rank_queue(p.first, "demand");
+                    }
+                    ++stats->scrapes;
+
+                    report.clear();
+                    render_stats(report);
+
+                    sockets->writef(
+                        d,
+                        "HTTP/1.0 200 OK\r\n"
+                        "Content-Type: text/plain; version=0.0.4\r\n"
+                        "Content-Length: %lu\r\n"
+                        "Connection: close\r\n\r\n", report.size()
+                    );
+
+                    buffer.assign(report.begin(), report.end());
+                    sockets->append_outgoing(d, buffer);
+                    scraped.insert(d);
+                }
+            }
+            else if (!drivers.count(d)) {
                 int forward_to = SOCKETS::NO_DESCRIPTOR;
+                bool from_supply = false;
 
                 if (supply_map.count(d)) {
                     forward_to = supply_map[d];
+                    from_supply = true;
                 }
                 else if (demand_map.count(d)) {
                     forward_to = demand_map[d];
@@ -274,7 +747,7 @@ void PROGRAM::run() {
                     log("Forbidden condition met (%s:%d).", __FILE__, __LINE__);
                 }
                 else {
-                    if (is_verbose()) {
+                    if (limits->allow(LOGLIMIT::CATEGORY::FORWARD)) {
                         log(
                             "%lu byte%s from %s:%s %s sent to %s:%s.",
                             buffer.size(), buffer.size() == 1 ? "" : "s",
@@ -285,8 +758,45 @@ void PROGRAM::run() {
                         );
                     }
 
-                    sockets->append_outgoing(forward_to, buffer);
+                    sockets->forward_outgoing(forward_to, buffer);
                     timestamp_map[forward_to] = timestamp;
+
+                    if (sockets->get_outgoing_size(forward_to) > (
+                        from_supply ?
+                        options->demand_queue.bytes :
+                        options->supply_queue.bytes
+                    )) {
+                        police(forward_to, d, !from_supply);
+                    }
+
+                    const char *host = sockets->get_host(d);
+
+                    stats->forwarding_hosts.update(
+                        HITTERS::hash_of(host), host, buffer.size()
+                    );
+
+                    if (from_supply) {
+                        stats->supply_bytes += buffer.size();
+                        ++stats->supply_chunks;
+                    }
+                    else {
+                        stats->demand_bytes += buffer.size();
+                        ++stats->demand_chunks;
+                    }
+
+                    if (journal) {
+                        journal->forward(
+                            from_supply ? d : forward_to, from_supply,
+                            buffer.size()
+                        );
+                    }
+
+                    if (capture) {
+                        capture->forward(
+                            from_supply ? d : forward_to, from_supply,
+                            buffer.size(), usec
+                        );
+                    }
                 }
             }
 
@@ -294,6 +804,14 @@ void PROGRAM::run() {
             timestamp_map[d] = timestamp;
         }
 
+        for (int scraper : scraped) {
+            if (sockets->get_outgoing_size(scraper) == 0) {
+                sockets->disconnect(scraper);
+            }
+        }
+
+        stats->phases.enter(PHASES::PHASE::TIMEOUT);
+
         uint32_t idle_timeout = get_idle_timeout();
 
         if (idle_timeout > 0 && alarmed) {
@@ -301,7 +819,29 @@ void PROGRAM::run() {
                 if (timestamp - p.second >= idle_timeout) {
                     int d = p.first;
 
-                    if (is_verbose()) {
+                    ++stats->timeouts;
+                    if (trace) trace->record(TRACE::TYPE::TIMEOUT, d);
+                    PROBE2(timeout, d, timestamp - p.second);
+
+                    if (journal) {
+                        if (supply_map.count(d)) {
+                            journal->end(d, JOURNAL::REASON::TIMEOUT);
+                        }
+                        else if (demand_map.count(d)) {
+                            journal->end(
+                                demand_map[d], JOURNAL::REASON::TIMEOUT
+                            );
+                        }
+                    }
+
+                    if (capture) {
+                        if (supply_map.count(d)) capture->end(d, usec);
+                        else if (demand_map.count(d)) {
+                            capture->end(demand_map[d], usec);
+                        }
+                    }
+
+                    if (limits->allow(LOGLIMIT::CATEGORY::TIMEOUT)) {
                         log(
                             "Connection %s:%s has timed out (descriptor %d).",
                             sockets->get_host(d), sockets->get_port(d), d
@@ -312,6 +852,74 @@ void PROGRAM::run() {
                 }
             }
         }
+
+        if (alarmed) {
+            // The time budget of the queues is only checked once per second
+            // whereas the byte budget is also checked whenever bytes are
+            // forwarded.
+
+            sockets->roll_outgoing_rates();
+            stats->slow_supply.slow = 0;
+            stats->slow_demand.slow = 0;
+
+            for (const auto &p : supply_map) {
+                if (p.second == SOCKETS::NO_DESCRIPTOR) continue;
+
+                if (police(p.first, p.second, true)) ++stats->slow_supply.slow;
+                else slow.erase(p.first);
+            }
+
+            for (const auto &p : demand_map) {
+                if (p.second == SOCKETS::NO_DESCRIPTOR) continue;
+
+                if (police(p.first, p.second, false)) ++stats->slow_demand.slow;
+                else slow.erase(p.first);
+            }
+        }
+
+        if (alarmed) {
+            // The lines suppressed by the rate limits and the sampling are
+            // summarized once per second. The categories that have been
+            // turned off altogether are left out.
+
+            for (size_t i=0; i<LOGLIMIT::COUNT; ++i) {
+                LOGLIMIT::CATEGORY category{static_cast<LOGLIMIT::CATEGORY>(i)};
+                uint64_t suppressed = limits->take_suppressed(category);
+
+                if (suppressed && limits->is_enabled(category)) {
+                    log(
+                        "Suppressed %llu similar %s message%s.",
+                        (unsigned long long) suppressed,
+                        LOGLIMIT::category_name(category),
+                        suppressed == 1 ? "" : "s"
+                    );
+                }
+            }
+        }
+
+        if (alarmed && segment) {
+            // The shared memory segment is refreshed once per second with a
+            // plain copy of the statistics.
+
+            refresh_gauges();
+            stats->publish(*segment);
+        }
+
+        uint32_t tcp_info_rate = get_tcp_info_rate();
+
+        if (tcp_info_rate > 0 && alarmed) {
+            // Only the paired connections are sampled, half of the samples
+            // being taken from either side.
+
+            stats->tcp.sample_some(
+                supply_map, (tcp_info_rate + 1) / 2, stats->tcp.supply
+            );
+            stats->tcp.sample_some(
+                demand_map, tcp_info_rate / 2, stats->tcp.demand
+            );
+        }
+
+        stats->phases.next_iteration();
     }
     while (!terminated);
 
@@ -333,13 +941,140 @@ bool PROGRAM::init(int argc, char **argv) {
         return false;
     }
 
+    limits = new (std::nothrow) LOGLIMIT;
+    if (!limits) return false;
+
+    // The connections and disconnections are logged without a limit. The
+    // other categories are limited to 100 lines per second and are only
+    // logged if verbose.
+
+    bool verbose = is_verbose();
+
+    limits->set_rule(LOGLIMIT::CATEGORY::FORWARD, {verbose, 100, 1});
+    limits->set_rule(LOGLIMIT::CATEGORY::TIMEOUT, {verbose, 100, 1});
+    limits->set_rule(LOGLIMIT::CATEGORY::SLOW,    {verbose, 100, 1});
+
+    for (const std::string &rule : options->log_rules) {
+        if (!limits->configure(rule.c_str())) {
+            log("invalid log rule: %s", rule.c_str());
+            return false;
+        }
+    }
+
+    if (!options->admission_rules.empty()
+    ||  !options->admission_rates.empty()) {
+        admission = new (std::nothrow) ADMISSION;
+        if (!admission) return false;
+
+        for (const std::string &rule : options->admission_rules) {
+            if (!admission->configure(rule.c_str())) {
+                log("invalid admission rule: %s", rule.c_str());
+                return false;
+            }
+        }
+
+        for (const std::string &rule : options->admission_rates) {
+            if (!admission->configure_rate(rule.c_str())) {
+                log("invalid admission rate: %s", rule.c_str());
+                return false;
+            }
+        }
+    }
+
+    if (!options->simulate.empty()) {
+        // The simulated connections have no TCP_INFO to sample.
+
+        simnet = new (std::nothrow) SIMNET(print_log);
+        if (!simnet) return false;
+
+        if (!simnet->init(options->simulate.c_str())) {
+            return false;
+        }
+
+        kernel = &simnet->get_kernel();
+        options->tcp_info_rate = 0;
+    }
+
+    stats = new (std::nothrow) STATS;
+    if (!stats) return false;
+
+    trace = new (std::nothrow) TRACE;
+    if (!trace) return false;
+
+    if (!options->stats_file.empty()) {
+        segment = new (std::nothrow) SEGMENT(print_log);
+        if (!segment) return false;
+
+        if (!segment->init(options->stats_file.c_str())) {
+            return false;
+        }
+
+        stats->describe(*segment);
+    }
+
+    if (!options->journal.empty()) {
+        journal = new (std::nothrow) JOURNAL(print_log);
+        if (!journal) return false;
+
+        if (!journal->init(options->journal.c_str())) {
+            return false;
+        }
+    }
+
+    if (!options->capture.empty()) {
+        capture = new (std::nothrow) CAPTURE(print_log);
+        if (!capture) return false;
+
+        if (!capture->init(options->capture.c_str())) {
+            return false;
+        }
+    }
+
     sockets = new (std::nothrow) SOCKETS(print_log);
     if (!sockets) return false;
 
+    sockets->set_kernel(kernel);
+
     if (!sockets->init()) {
         return false;
     }
 
+    if (!options->exit_flag) {
+        // Once the background writer has started, the log lines are no longer
+        // written out by the event loop.
+
+        char preamble[sizeof(BINLOG::header_type)];
+        size_t preamble_size = 0;
+
+        if (options->binary_log) {
+            if (options->log_file.empty()) {
+                log("%s", "binary log requires a log file");
+                return false;
+            }
+
+            binlog = new (std::nothrow) BINLOG;
+            if (!binlog) return false;
+
+            preamble_size = BINLOG::header(
+                preamble, sizeof(preamble), uint32_t(getpid())
+            );
+        }
+
+        logger = new (std::nothrow) LOGGER;
+        if (!logger) return false;
+
+        if (!logger->init(
+            options->log_file.c_str(), options->log_size,
+            binlog ? preamble : nullptr, preamble_size
+        )) {
+            log(
+                "%s: %s", options->log_file.empty() ?
+                "stderr" : options->log_file.c_str(), strerror(errno)
+            );
+            return false;
+        }
+    }
+
     return true;
 }
 
@@ -354,6 +1089,63 @@ int PROGRAM::deinit() {
         sockets = nullptr;
     }
 
+    if (simnet) {
+        // The results of the simulation are logged once every descriptor has
+        // been closed.
+
+        simnet->deinit();
+        delete simnet;
+        simnet = nullptr;
+        kernel = &KERNEL::native();
+    }
+
+    if (journal) {
+        if (!journal->deinit()) {
+            status = EXIT_FAILURE;
+        }
+
+        delete journal;
+        journal = nullptr;
+    }
+
+    if (capture) {
+        if (!capture->deinit()) {
+            status = EXIT_FAILURE;
+        }
+
+        delete capture;
+        capture = nullptr;
+    }
+
+    if (trace) {
+        delete trace;
+        trace = nullptr;
+    }
+
+    if (segment) {
+        if (!segment->deinit()) {
+            status = EXIT_FAILURE;
+        }
+
+        delete segment;
+        segment = nullptr;
+    }
+
+    if (stats) {
+        delete stats;
+        stats = nullptr;
+    }
+
+    if (limits) {
+        delete limits;
+        limits = nullptr;
+    }
+
+    if (admission) {
+        delete admission;
+        admission = nullptr;
+    }
+
     if (options) {
         delete options;
         options = nullptr;
@@ -364,6 +1156,17 @@ int PROGRAM::deinit() {
         signals = nullptr;
     }
 
+    if (logger) {
+        logger->deinit();
+        delete logger;
+        logger = nullptr;
+    }
+
+    if (binlog) {
+        delete binlog;
+        binlog = nullptr;
+    }
+
     return get_status();
 }
 
@@ -399,93 +1202,217 @@ bool PROGRAM::print_text(FILE *fp, const char *text, size_t len) {
 
 void PROGRAM::print_log(const char *origin, const char *p_fmt, ...) {
     va_list ap;
-    char *buf = nullptr;
-    char *newbuf = nullptr;
-    int buffered = 0;
-    int	size = 1024;
 
     if (p_fmt == nullptr) return;
-    buf = (char *) malloc (size * sizeof (char));
 
-    while (1) {
-        va_start(ap, p_fmt);
-        buffered = vsnprintf(buf, size, p_fmt, ap);
-        va_end (ap);
+    va_start(ap, p_fmt);
+    vprint_log(origin, p_fmt, ap);
+    va_end(ap);
+}
+
+void PROGRAM::vprint_log(const char *origin, const char *p_fmt, va_list ap) {
+    // The line is formatted on the stack. Unless the background writer is
+    // running, it is written out right away. If the log is binary, then the
+    // arguments are copied as they are and only the lines of an unsupported
+    // format get formatted.
+
+    static constexpr const size_t LINE_SIZE = 4096;
+
+    bool binary = PROGRAM::binlog && PROGRAM::logger->is_running();
+
+    if (binary && origin) {
+        char record[LINE_SIZE];
+        va_list copy;
+
+        PROGRAM::binlog->set_generation(PROGRAM::logger->get_generation());
+
+        va_copy(copy, ap);
+        size_t length = PROGRAM::binlog->encode(
+            record, sizeof(record), SEGMENT::get_time(), origin, p_fmt, copy
+        );
+        va_end(copy);
 
-        if (buffered > -1 && buffered < size) break;
-        if (buffered > -1) size = buffered + 1;
-        else               size *= 2;
+        if (length) {
+            PROGRAM::log_size += length;
+
+            if (PROGRAM::logger->push(record, length)) {
+                PROGRAM::binlog->confirm();
+            }
 
-        if ((newbuf = (char *) realloc (buf, size)) == nullptr) {
-            free (buf);
             return;
-        } else {
-            buf = newbuf;
         }
     }
 
-    std::string logline;
-    logline.reserve(size);
+    static constexpr const size_t PREFIX_SIZE = 24;
+    static char prefix[PREFIX_SIZE] = "";
+    static time_t prefix_time = 0;
+
+    char line[LINE_SIZE];
+    size_t length = 0;
 
     if (PROGRAM::log_time) {
-        char timebuf[20];
-        struct timeval timeofday;
-        gettimeofday(&timeofday, nullptr);
+        // The formatted time only changes once per second.
 
-        time_t timestamp = (time_t) timeofday.tv_sec;
-        struct tm *tm_ptr = gmtime(&timestamp);
+        struct timespec now;
+        PROGRAM::kernel->clock_gettime(CLOCK_REALTIME_COARSE, &now);
 
-        if (!strftime(timebuf, sizeof(timebuf), "%Y-%m-%d %H:%M:%S", tm_ptr)) {
-            timebuf[0] = '\0';
+        if (now.tv_sec != prefix_time || prefix[0] == '\0') {
+            struct tm tm_now;
+
+            prefix_time = now.tv_sec;
+
+            if (!gmtime_r(&prefix_time, &tm_now)
+            ||  !strftime(
+                prefix, sizeof(prefix), "%Y-%m-%d %H:%M:%S :: ", &tm_now
+            )) {
+                prefix[0] = '\0';
+            }
         }
 
-        logline.append(timebuf);
-        logline.append(" :: ");
+        length = strlen(prefix);
+        std::memcpy(line, prefix, length);
     }
 
     if (origin && *origin) {
-        logline.append(origin);
-        logline.append(": ");
+        int written = snprintf(
+            line + length, LINE_SIZE - length, "%s: ", origin
+        );
+
+        if (written > 0) {
+            length = std::min(length + size_t(written), LINE_SIZE - 1);
+        }
+    }
+
+    int written = vsnprintf(line + length, LINE_SIZE - length, p_fmt, ap);
+
+    if (written > 0) {
+        length = std::min(length + size_t(written), LINE_SIZE - 1);
+    }
+
+    if (origin) {
+        // Lines that did not fit are cut short but still end the line.
+
+        if (length == LINE_SIZE - 1) --length;
+
+        line[length++] = '\n';
     }
 
-    logline.append(buf);
+    if (binary) {
+        char record[sizeof(BINLOG::text_type) + LINE_SIZE];
+
+        length = BINLOG::text(
+            record, sizeof(record), SEGMENT::get_time(), line, length
+        );
+
+        PROGRAM::log_size += length;
+        PROGRAM::logger->push(record, length);
+
+        return;
+    }
 
-    if (origin) logline.append("\n");
+    PROGRAM::log_size += length;
 
-    PROGRAM::log_size += logline.size();
-    print_text(stderr, logline.c_str(), logline.size());
-    free(buf);
+    if (PROGRAM::logger && PROGRAM::logger->is_running()) {
+        PROGRAM::logger->push(line, length);
+    }
+    else print_text(stderr, line, length);
 }
 
 void PROGRAM::log(const char *p_fmt, ...) {
     va_list ap;
-    char *buf = nullptr;
-    char *newbuf = nullptr;
-    int buffered = 0;
-    int	size = 1024;
 
     if (p_fmt == nullptr) return;
-    buf = (char *) malloc (size * sizeof (char));
 
-    while (1) {
-        va_start(ap, p_fmt);
-        buffered = vsnprintf(buf, size, p_fmt, ap);
-        va_end (ap);
+    PHASES::PHASE phase = PHASES::PHASE::OTHER;
 
-        if (buffered > -1 && buffered < size) break;
-        if (buffered > -1) size = buffered + 1;
-        else               size *= 2;
+    if (stats) phase = stats->phases.enter(PHASES::PHASE::LOG);
 
-        if ((newbuf = (char *) realloc (buf, size)) == nullptr) {
-            free (buf);
-            return;
-        } else {
-            buf = newbuf;
-        }
+    va_start(ap, p_fmt);
+    vprint_log("", p_fmt, ap);
+    va_end(ap);
+
+    if (stats) stats->phases.enter(phase);
+}
+
+void PROGRAM::render_stats(std::string &out) const {
+    stats->render(out);
+
+    STATS::family(
+        out, "tcpherald_log_lines_suppressed_total", "counter",
+        "Log lines suppressed by their category, sampling or rate limit."
+    );
+
+    for (size_t i=0; i<LOGLIMIT::COUNT; ++i) {
+        LOGLIMIT::CATEGORY category{static_cast<LOGLIMIT::CATEGORY>(i)};
+        char labels[64];
+
+        snprintf(
+            labels, sizeof(labels), "category=\"%s\"",
+            LOGLIMIT::category_name(category)
+        );
+
+        STATS::sample(
+            out, "tcpherald_log_lines_suppressed_total",
+            limits->get_suppressed(category), labels
+        );
+    }
+}
+
+void PROGRAM::dump_stats() {
+    struct {
+        const char *name;
+        const HISTOGRAM *hist;
+    } const table[]{
+        { "Demand wait",   &stats->demand_wait   },
+        { "Supply wait",   &stats->supply_wait   },
+        { "Pair lifetime", &stats->pair_lifetime },
+        { "Write latency", &stats->write_latency }
+    };
+
+    for (const auto &row : table) {
+        log(
+            "%s: %llu sample%s (p50 %llu, p90 %llu, p99 %llu, p99.9 %llu, "
+            "max %llu us).", row.name, (unsigned long long) row.hist->get_count(),
+            row.hist->get_count() == 1 ? "" : "s",
+            (unsigned long long) row.hist->value_at(0.5),
+            (unsigned long long) row.hist->value_at(0.9),
+            (unsigned long long) row.hist->value_at(0.99),
+            (unsigned long long) row.hist->value_at(0.999),
+            (unsigned long long) row.hist->get_max()
+        );
+    }
+}
+
+bool PROGRAM::dump_trace() {
+    if (!trace) return false;
+
+    std::string path(options->trace);
+
+    if (path.empty()) {
+        path.assign(get_name()).append("-").append(std::to_string(getpid()));
+        path.append(".trace");
+    }
+
+    std::vector<uint8_t> bytes;
+    trace->serialize(bytes);
+
+    FILE *fp = fopen(path.c_str(), "wb");
+
+    if (!fp) {
+        log("%s: %s", path.c_str(), strerror(errno));
+        return false;
     }
 
-    print_log("", "%s", buf);
-    free(buf);
+    size_t written = fwrite(bytes.data(), 1, bytes.size(), fp);
+
+    if (fclose(fp) != 0 || written != bytes.size()) {
+        log("%s: %s", path.c_str(), "failed to write the trace");
+        return false;
+    }
+
+    log("Dumped the event trace to %s.", path.c_str());
+
+    return true;
 }
 
 void PROGRAM::bug(const char *file, int line) {
@@ -512,6 +1439,10 @@ uint16_t PROGRAM::get_driver_port() const {
     return options->driver_port;
 }
 
+uint16_t PROGRAM::get_stats_port() const {
+    return options->stats_port;
+}
+
 bool PROGRAM::is_verbose() const {
     return options->verbose;
 }
@@ -524,17 +1455,31 @@ uint32_t PROGRAM::get_driver_period() const {
     return options->driver_period;
 }
 
+uint32_t PROGRAM::get_tcp_info_rate() const {
+    return options->tcp_info_rate;
+}
+
 void PROGRAM::set_timer(size_t usec) {
     timer.it_value.tv_sec     = usec / 1000000;
     timer.it_value.tv_usec    = usec % 1000000;
     timer.it_interval.tv_sec  = 0;
     timer.it_interval.tv_usec = 0;
 
-    setitimer(ITIMER_REAL, &timer, nullptr);
+    kernel->setitimer(ITIMER_REAL, &timer, nullptr);
+}
+
+long long PROGRAM::get_usec() const {
+    struct timespec ts;
+
+    if (kernel->clock_gettime(CLOCK_MONOTONIC, &ts) != 0) return 0;
+
+    return (long long)(ts.tv_sec) * 1000000LL + ts.tv_nsec / 1000;
 }
 
 long long PROGRAM::get_timestamp() const {
-    return std::chrono::duration_cast<std::chrono::seconds>(
-        std::chrono::system_clock::now().time_since_epoch()
-    ).count();
+    struct timespec ts;
+
+    if (kernel->clock_gettime(CLOCK_REALTIME, &ts) != 0) return 0;
+
+    return (long long)(ts.tv_sec);
 }
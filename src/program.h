@@ -3,6 +3,7 @@
 #define PROGRAM_H_01_01_2021
 
 #include <string>
+#include <cstdarg>
 #include <sys/time.h>
 
 class PROGRAM {
@@ -16,7 +17,15 @@ class PROGRAM {
     , status(EXIT_FAILURE)
     , options(nullptr)
     , signals(nullptr)
-    , sockets(nullptr) {}
+    , sockets(nullptr)
+    , stats  (nullptr)
+    , journal(nullptr)
+    , capture(nullptr)
+    , trace  (nullptr)
+    , segment(nullptr)
+    , limits (nullptr)
+    , admission(nullptr)
+    , simnet (nullptr) {}
 
     ~PROGRAM() {}
 
@@ -39,15 +48,22 @@ class PROGRAM {
     uint16_t get_supply_port() const;
     uint16_t get_demand_port() const;
     uint16_t get_driver_port() const;
+    uint16_t get_stats_port() const;
     uint32_t get_idle_timeout() const;
     uint32_t get_driver_period() const;
+    uint32_t get_tcp_info_rate() const;
     bool is_verbose() const;
 
     long long get_timestamp() const;
+    long long get_usec() const;
     void set_timer(size_t usec);
 
     private:
     static bool print_text(FILE *fp, const char *text, size_t length);
+    static void vprint_log(const char *origin, const char *fmt, va_list ap);
+    void render_stats(std::string &out) const;
+    void dump_stats();
+    bool dump_trace();
 
     std::string    pname;
     std::string    pver;
@@ -55,9 +71,20 @@ class PROGRAM {
     class OPTIONS *options;
     class SIGNALS *signals;
     class SOCKETS *sockets;
+    class STATS   *stats;
+    class JOURNAL *journal;
+    class CAPTURE *capture;
+    class TRACE   *trace;
+    class SEGMENT *segment;
+    class LOGLIMIT *limits;
+    class ADMISSION *admission;
+    class SIMNET  *simnet;
 
     static size_t log_size;
     static bool   log_time;
+    static class LOGGER *logger;
+    static class BINLOG *binlog;
+    static const class KERNEL *kernel;
     struct itimerval timer;
 };
 
@@ -0,0 +1,108 @@
+// SPDX-License-Identifier: MIT
+#ifndef SAMPLER_H_17_10_2026
+#define SAMPLER_H_17_10_2026
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/tcp.h>
+
+#include "histogram.h"
+
+class SAMPLER {
+    // Samples the TCP_INFO of connected sockets into histograms that are kept
+    // separately for the supply and the demand side. The sockets are visited
+    // a bounded number at a time, continuing from where the previous visit
+    // left off, so that the cost of sampling does not depend on the number of
+    // connections.
+
+    public:
+    struct side_type {
+        HISTOGRAM rtt;           // Microseconds.
+        HISTOGRAM rttvar;        // Microseconds.
+        HISTOGRAM retransmits;   // Segments retransmitted in total.
+        HISTOGRAM cwnd;          // Segments.
+        HISTOGRAM delivery_rate; // Bytes per second.
+        HISTOGRAM unacked;       // Segments.
+        uint64_t samples;
+        uint64_t failures;
+        size_t cursor;
+    };
+
+    SAMPLER() : supply{}, demand{} {}
+    ~SAMPLER() {}
+
+    side_type supply;
+    side_type demand;
+
+    template<class T>
+    inline size_t sample_some(
+        const T &container, size_t limit, side_type &side
+    ) {
+        // Samples at least the given number of sockets found in the given
+        // unordered container by walking its buckets. At most a few times as
+        // many buckets are visited in case most of them happen to be empty.
+
+        size_t buckets = container.bucket_count();
+        size_t sampled = 0;
+
+        if (buckets == 0 || container.empty()) return 0;
+
+        for (size_t visited = 0; visited < buckets && visited < limit * 8
+        && sampled < limit; ++visited) {
+            size_t bucket = side.cursor++ % buckets;
+
+            for (auto it = container.begin(bucket); it != container.end(bucket);
+            ++it) {
+                sample(key_of(*it), side);
+                ++sampled;
+            }
+        }
+
+        return sampled;
+    }
+
+    inline bool sample(int descriptor, side_type &side) {
+        struct tcp_info info{};
+        socklen_t length = sizeof(info);
+
+        if (getsockopt(descriptor, IPPROTO_TCP, TCP_INFO, &info, &length)) {
+            ++side.failures;
+            return false;
+        }
+
+        side.rtt.record(info.tcpi_rtt);
+        side.rttvar.record(info.tcpi_rttvar);
+        side.retransmits.record(info.tcpi_total_retrans);
+        side.cwnd.record(info.tcpi_snd_cwnd);
+        side.unacked.record(info.tcpi_unacked);
+
+        static constexpr const size_t delivery_rate_end{
+            offsetof(struct tcp_info, tcpi_delivery_rate) +
+            sizeof(info.tcpi_delivery_rate)
+        };
+
+        if (length >= delivery_rate_end) {
+            // Older kernels do not report the delivery rate.
+            side.delivery_rate.record(info.tcpi_delivery_rate);
+        }
+
+        ++side.samples;
+
+        return true;
+    }
+
+    private:
+    static inline int key_of(int key) {
+        return key;
+    }
+
+    template<class V>
+    static inline int key_of(const std::pair<const int, V> &pair) {
+        return pair.first;
+    }
+};
+
+#endif
@@ -0,0 +1,274 @@
+// SPDX-License-Identifier: MIT
+#ifndef SEGMENT_H_17_10_2026
+#define SEGMENT_H_17_10_2026
+
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+
+class SEGMENT {
+    // Memory-mapped file publishing a fixed set of named values to readers on
+    // the same host. The layout describes itself: the names and kinds of the
+    // fields are written once when the segment is created and the values are
+    // then published under a sequence lock. Readers never make the writer wait
+    // and the writer never makes a system call to publish.
+    //
+    // A reader copies the values after having seen an even sequence number
+    // and retries if the sequence number has changed by the time it is done.
+
+    public:
+    static constexpr const char *MAGIC = "TCPHSTAT";
+    static constexpr const uint32_t VERSION = 1;
+    static constexpr const size_t NAME_SIZE = 56;
+    static constexpr const size_t MAX_FIELDS = 128;
+
+    enum class KIND : uint32_t {
+        COUNTER = 0,
+        GAUGE   = 1
+    };
+
+    struct header_type {
+        char     magic[8];
+        uint32_t version;
+        uint32_t field_count;
+        uint64_t pid;
+        uint64_t started;   // Microseconds since the epoch.
+        uint64_t sequence;  // Odd while the values are being updated.
+        uint64_t published; // Microseconds since the epoch.
+        uint64_t reserved[2];
+    };
+
+    struct field_type {
+        char name[NAME_SIZE];
+        KIND kind;
+        uint32_t reserved;
+    };
+
+    struct layout_type {
+        header_type header;
+        field_type fields[MAX_FIELDS];
+        uint64_t values[MAX_FIELDS];
+    };
+
+    static_assert(sizeof(header_type) == 64, "unexpected header size");
+    static_assert(sizeof(field_type) == 64, "unexpected field size");
+
+    SEGMENT(
+        void (*log_fun) (const char *, const char *, ...) =drop_log,
+        const char *log_src ="Segment"
+    ) : layout (nullptr)
+      , logfrom(log_src)
+      , log    (log_fun) {}
+
+    ~SEGMENT() {
+        if (layout) {
+            log(logfrom.c_str(), "%s", "segment was not deinitialized");
+        }
+    }
+
+    inline bool init(const char *file) {
+        int descriptor = open(file, O_RDWR|O_CREAT|O_TRUNC|O_CLOEXEC, 0644);
+
+        if (descriptor == -1) {
+            log(logfrom.c_str(), "%s: %s", file, strerror(errno));
+            return false;
+        }
+
+        if (ftruncate(descriptor, off_t(sizeof(layout_type))) == -1) {
+            log(logfrom.c_str(), "ftruncate: %s", strerror(errno));
+            close(descriptor);
+            unlink(file);
+            return false;
+        }
+
+        void *address = mmap(
+            nullptr, sizeof(layout_type), PROT_READ|PROT_WRITE, MAP_SHARED,
+            descriptor, 0
+        );
+
+        close(descriptor);
+
+        if (address == MAP_FAILED) {
+            log(logfrom.c_str(), "mmap: %s", strerror(errno));
+            unlink(file);
+            return false;
+        }
+
+        path = file;
+        layout = static_cast<layout_type *>(address);
+
+        std::memcpy(layout->header.magic, MAGIC, sizeof(layout->header.magic));
+        layout->header.version = VERSION;
+        layout->header.pid = uint64_t(getpid());
+        layout->header.started = get_time();
+
+        return true;
+    }
+
+    inline bool deinit() {
+        if (!layout) return true;
+
+        bool success = true;
+
+        if (munmap(layout, sizeof(layout_type)) == -1) {
+            log(logfrom.c_str(), "munmap: %s", strerror(errno));
+            success = false;
+        }
+
+        if (unlink(path.c_str()) == -1) {
+            log(logfrom.c_str(), "%s: %s", path.c_str(), strerror(errno));
+            success = false;
+        }
+
+        layout = nullptr;
+
+        return success;
+    }
+
+    inline bool is_open() const {
+        return layout != nullptr;
+    }
+
+    inline size_t add_field(const char *name, KIND kind) {
+        // Returns the index of the new field or MAX_FIELDS if there is no
+        // room for it. The fields are to be added before publishing.
+
+        if (!layout || layout->header.field_count >= MAX_FIELDS) {
+            return MAX_FIELDS;
+        }
+
+        size_t index = layout->header.field_count++;
+        field_type &field = layout->fields[index];
+
+        std::memcpy(field.name, name, strnlen(name, NAME_SIZE - 1));
+        field.kind = kind;
+
+        return index;
+    }
+
+    inline void begin() {
+        uint64_t &sequence = layout->header.sequence;
+
+        __atomic_store_n(&sequence, sequence + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+    }
+
+    inline void set(size_t index, uint64_t value) {
+        if (index < MAX_FIELDS) {
+            __atomic_store_n(&layout->values[index], value, __ATOMIC_RELAXED);
+        }
+    }
+
+    inline void end() {
+        uint64_t &sequence = layout->header.sequence;
+
+        __atomic_store_n(
+            &layout->header.published, get_time(), __ATOMIC_RELAXED
+        );
+        __atomic_store_n(&sequence, sequence + 1, __ATOMIC_RELEASE);
+    }
+
+    static inline bool read(const layout_type *from, layout_type &to) {
+        // Takes a consistent snapshot of the given segment. Returns false if
+        // the writer kept changing the values during every attempt.
+
+        for (size_t attempt = 0; attempt < 1000; ++attempt) {
+            uint64_t before = __atomic_load_n(
+                &from->header.sequence, __ATOMIC_ACQUIRE
+            );
+
+            if (before % 2) continue;
+
+            for (size_t i=0; i<MAX_FIELDS; ++i) {
+                to.values[i] = __atomic_load_n(
+                    &from->values[i], __ATOMIC_RELAXED
+                );
+            }
+
+            to.header.published = __atomic_load_n(
+                &from->header.published, __ATOMIC_RELAXED
+            );
+
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+            uint64_t after = __atomic_load_n(
+                &from->header.sequence, __ATOMIC_RELAXED
+            );
+
+            if (before == after) {
+                to.header.sequence = after;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    static inline const layout_type *attach(const char *file) {
+        // Maps the segment published in the given file for reading. Returns
+        // nullptr and leaves errno set if it could not be mapped, or sets it
+        // to EPROTO if the file is not a segment of this version.
+
+        int descriptor = open(file, O_RDONLY|O_CLOEXEC);
+
+        if (descriptor == -1) return nullptr;
+
+        void *address = mmap(
+            nullptr, sizeof(layout_type), PROT_READ, MAP_SHARED, descriptor, 0
+        );
+
+        close(descriptor);
+
+        if (address == MAP_FAILED) return nullptr;
+
+        const layout_type *layout = static_cast<const layout_type *>(address);
+
+        if (memcmp(layout->header.magic, MAGIC, sizeof(layout->header.magic))
+        ||  layout->header.version != VERSION
+        ||  layout->header.field_count > MAX_FIELDS) {
+            munmap(address, sizeof(layout_type));
+            errno = EPROTO;
+            return nullptr;
+        }
+
+        return layout;
+    }
+
+    static inline void detach(const layout_type *layout) {
+        munmap(const_cast<layout_type *>(layout), sizeof(layout_type));
+    }
+
+    static inline size_t index_of(const layout_type *layout, const char *name) {
+        // Returns the index of the named field or MAX_FIELDS if there is none.
+
+        for (size_t i=0; i<layout->header.field_count; ++i) {
+            if (!strncmp(layout->fields[i].name, name, NAME_SIZE)) return i;
+        }
+
+        return MAX_FIELDS;
+    }
+
+    static inline uint64_t get_time() {
+        struct timespec ts;
+
+        if (clock_gettime(CLOCK_REALTIME, &ts) != 0) return 0;
+
+        return uint64_t(ts.tv_sec) * 1000000 + uint64_t(ts.tv_nsec) / 1000;
+    }
+
+    private:
+    static void drop_log(const char *, const char *, ...) {}
+
+    layout_type *layout;
+    std::string path;
+    std::string logfrom;
+    void (*log)(const char *, const char *p_fmt, ...);
+};
+
+#endif
@@ -50,6 +50,7 @@ class SIGNALS {
         ||  !init_signal(SIGINT )
         ||  !init_signal(SIGTERM)
         ||  !init_signal(SIGQUIT)
+        ||  !init_signal(SIGUSR1)
         ||  !init_signal(SIGSEGV)
         ||  !init_signal(SIGILL )
         ||  !init_signal(SIGABRT)
@@ -68,6 +69,7 @@ class SIGNALS {
         if (sig_quit ) {sig_quit  = 0; return SIGQUIT;}
         if (sig_pipe ) {sig_pipe  = 0; return SIGPIPE;}
         if (sig_alarm) {sig_alarm = 0; return SIGALRM;}
+        if (sig_usr1 ) {sig_usr1  = 0; return SIGUSR1;}
         return 0;
     }
 
@@ -78,6 +80,7 @@ class SIGNALS {
             case SIGQUIT: sig_quit  = 1; return;
             case SIGPIPE: sig_pipe  = 1; return;
             case SIGALRM: sig_alarm = 1; return;
+            case SIGUSR1: sig_usr1  = 1; return;
             default     : break;
         }
 
@@ -123,13 +126,15 @@ class SIGNALS {
         sigaddset(&mask, SIGQUIT);
         sigaddset(&mask, SIGPIPE);
         sigaddset(&mask, SIGALRM);
+        sigaddset(&mask, SIGUSR1);
 
         if (sigprocmask(SIG_BLOCK, &mask, &oldmask) == -1) {
             log(logfrom.c_str(), "sigprocmask: %s", strerror(errno));
             return false;
         }
 
-        while (!sig_alarm && !sig_pipe && !sig_int && !sig_term && !sig_quit) {
+        while (!sig_alarm && !sig_pipe && !sig_int && !sig_term && !sig_quit
+        &&     !sig_usr1) {
             sigsuspend(&oldmask);
         }
 
@@ -146,6 +151,7 @@ class SIGNALS {
     static volatile sig_atomic_t sig_int;
     static volatile sig_atomic_t sig_term;
     static volatile sig_atomic_t sig_quit;
+    static volatile sig_atomic_t sig_usr1;
 
     sigset_t sigset_most;
     sigset_t sigset_none;
@@ -0,0 +1,1078 @@
+// SPDX-License-Identifier: MIT
+#ifndef SIMNET_H_17_10_2026
+#define SIMNET_H_17_10_2026
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <csignal>
+#include <deque>
+#include <queue>
+#include <string>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+#include <netinet/in.h>
+
+#include "histogram.h"
+#include "kernel.h"
+
+class SIMNET {
+    // Simulated network standing in for the kernel. Clients connect, send
+    // bytes and disconnect as told by a script, while a virtual clock only
+    // advances when the proxy would otherwise wait for events. Replaying the
+    // same script gives the proxy the very same sequence of events, no matter
+    // how long each of them takes to handle in reality.
+    //
+    // Every line of the script starts with the virtual time of the directive,
+    // such as 1.5s, 20ms or 300us, or with a plus sign for a time relative to
+    // the previous line. The directives are the following:
+    //
+    //   connect CLIENT PORT   The client with the given number connects.
+    //   send CLIENT BYTES     The client sends the given number of bytes.
+    //   close CLIENT          The client closes the connection.
+    //   load COUNT INTERVAL SUPPLY-PORT DEMAND-PORT BYTES HOLD [LAG]
+    //                         Every INTERVAL, a demand client connects and
+    //                         sends BYTES, and LAG later a supply client
+    //                         connects to echo them back. The demand closes
+    //                         HOLD after receiving the echo. COUNT sessions
+    //                         are started.
+    //   end                   The simulation ends at the time of this line.
+    //
+    // Unless ended explicitly, the simulation ends once the script has been
+    // played and either every client has disconnected or LINGER_USEC has
+    // passed since the last directive. The proxy is then sent SIGTERM.
+
+    public:
+    static constexpr const long long LINGER_USEC = 10000000;
+    static constexpr const long long EPOCH_USEC  = 1767225600000000LL;
+
+    SIMNET(
+        void (*log_fun) (const char *, const char *, ...) =drop_log,
+        const char *log_src ="Simnet"
+    ) : logfrom(log_src)
+      , log    (log_fun)
+      , now(0)
+      , alarm_at(0)
+      , end_at(0)
+      , last_at(0)
+      , sequence(0)
+      , next_descriptor(FIRST_DESCRIPTOR)
+      , epoll_descriptor(-1)
+      , next_load_id(LOAD_ID_BASE)
+      , live(0)
+      , finished(false)
+      , started_usec(0)
+      , counters{} {}
+
+    ~SIMNET() {}
+
+    inline bool init(const char *script_file) {
+        if (active) {
+            log(logfrom.c_str(), "%s", "only one simulation may be active");
+            return false;
+        }
+
+        if (!load_script(script_file)) return false;
+
+        started_usec = get_wall_usec();
+        active = this;
+
+        return true;
+    }
+
+    inline bool deinit() {
+        if (active != this) return false;
+
+        double wall = double(get_wall_usec() - started_usec) / 1000000.0;
+        double simulated = double(now) / 1000000.0;
+
+        log(
+            logfrom.c_str(),
+            "Simulated %.3f seconds in %.3f seconds (%.1f times faster).",
+            simulated, wall, wall > 0.0 ? simulated / wall : 0.0
+        );
+
+        log(
+            logfrom.c_str(),
+            "Clients: %llu connected, %llu refused, %llu closed by the proxy, "
+            "%llu left open.", ull(counters.connected), ull(counters.refused),
+            ull(counters.dropped), ull(live)
+        );
+
+        log(
+            logfrom.c_str(),
+            "Bytes: %llu sent by the clients, %llu delivered to them.",
+            ull(counters.sent), ull(counters.delivered)
+        );
+
+        log(
+            logfrom.c_str(),
+            "Sessions: %llu started, %llu completed in %llu/%llu/%llu us "
+            "(p50/p99/max).", ull(counters.sessions),
+            ull(completion.get_count()), ull(completion.value_at(0.5)),
+            ull(completion.value_at(0.99)), ull(completion.get_max())
+        );
+
+        log(
+            logfrom.c_str(),
+            "First byte delivered in %llu/%llu/%llu us (p50/p99/max) to %llu "
+            "clients.", ull(first_byte.value_at(0.5)),
+            ull(first_byte.value_at(0.99)), ull(first_byte.get_max()),
+            ull(first_byte.get_count())
+        );
+
+        log(
+            logfrom.c_str(), "Waits: %llu, events: %llu.",
+            ull(counters.waits), ull(counters.events)
+        );
+
+        // The lines above are still stamped with the virtual time.
+
+        active = nullptr;
+
+        return true;
+    }
+
+    inline const KERNEL &get_kernel() const {
+        static const KERNEL kernel{
+            sim_accept4, sim_read, sim_write, sim_epoll_create1, sim_epoll_ctl,
+            sim_epoll_pwait, sim_socket, sim_bind, sim_listen, sim_connect,
+            sim_shutdown, sim_open, sim_close, sim_getsockopt, sim_setsockopt,
+            sim_clock_gettime, sim_setitimer
+        };
+
+        return kernel;
+    }
+
+    private:
+    static constexpr const int FIRST_DESCRIPTOR = 3;
+    static constexpr const uint64_t LOAD_ID_BASE = uint64_t(1) << 62;
+    static constexpr const uint32_t NO_CLIENT = UINT32_MAX;
+
+    enum class EVENT : uint8_t {
+        CONNECT = 0,
+        SEND,
+        CLOSE,
+        SPAWN,
+        SUPPLY,
+        END
+    };
+
+    enum class KIND : uint8_t {
+        NONE = 0,
+        EPOLL,
+        SOCKET,
+        LISTENER,
+        CONNECTION,
+        FILE
+    };
+
+    struct event_type {
+        long long time;
+        uint64_t sequence; // Keeps the events of the same time in order.
+        uint64_t client;   // Number of the client, or index of the load.
+        uint64_t arg;      // Port, bytes or index of the load.
+        EVENT type;
+    };
+
+    struct later_type {
+        bool operator()(const event_type &a, const event_type &b) const {
+            return a.time != b.time ? a.time > b.time : a.sequence > b.sequence;
+        }
+    };
+
+    struct descriptor_type {
+        uint32_t client;
+        uint32_t interest; // Events the epoll instance waits for.
+        uint32_t pending;  // Events waiting to be reported.
+        uint16_t port;
+        KIND kind;
+        bool queued;       // Whether the descriptor is in the ready queue.
+    };
+
+    struct client_type {
+        uint64_t id;
+        long long connected;
+        size_t unread;     // Bytes sent but not yet read by the proxy.
+        size_t received;   // Bytes delivered to the client.
+        size_t expect;     // Bytes completing the session once delivered.
+        size_t reply;      // Bytes echoed back once expect is delivered.
+        long long hold;    // Time to keep the completed session open.
+        int descriptor;    // Descriptor of the proxy, once accepted.
+        uint16_t port;
+        bool closed;
+        bool completed;
+    };
+
+    struct load_type {
+        uint64_t count;
+        uint64_t started;
+        long long interval;
+        long long hold;
+        long long lag;     // Time from the demand to the supply connecting.
+        size_t bytes;
+        uint16_t supply_port;
+        uint16_t demand_port;
+    };
+
+    struct counters_type {
+        uint64_t connected;
+        uint64_t refused;
+        uint64_t dropped;   // Clients disconnected by the proxy.
+        uint64_t sessions;
+        uint64_t sent;
+        uint64_t delivered;
+        uint64_t waits;
+        uint64_t events;
+    };
+
+    static void drop_log(const char *, const char *, ...) {}
+
+    static inline unsigned long long ull(uint64_t value) {
+        return (unsigned long long) value;
+    }
+
+    static inline long long get_wall_usec() {
+        struct timespec ts;
+
+        if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0) return 0;
+
+        return (long long)(ts.tv_sec) * 1000000LL + ts.tv_nsec / 1000;
+    }
+
+    static inline bool parse_time(const char *text, long long &usec) {
+        char *end = nullptr;
+        double value = strtod(text, &end);
+
+        if (end == text || value < 0.0) return false;
+
+        if      (!strcmp(end, "s" )) value *= 1000000.0;
+        else if (!strcmp(end, "ms")) value *= 1000.0;
+        else if (!strcmp(end, "us") || *end == '\0') {}
+        else return false;
+
+        usec = (long long) value;
+
+        return true;
+    }
+
+    static inline bool parse_number(const char *text, uint64_t &number) {
+        char *end = nullptr;
+
+        if (!text || *text == '-') return false;
+
+        number = strtoull(text, &end, 10);
+
+        return end != text && *end == '\0';
+    }
+
+    static inline bool parse_port(const char *text, uint16_t &port) {
+        uint64_t number;
+
+        if (!parse_number(text, number) || !number || number > UINT16_MAX) {
+            return false;
+        }
+
+        port = uint16_t(number);
+
+        return true;
+    }
+
+    inline bool load_script(const char *script_file) {
+        FILE *fp = fopen(script_file, "r");
+
+        if (!fp) {
+            log(
+                logfrom.c_str(), "%s: %s", script_file, strerror(errno)
+            );
+
+            return false;
+        }
+
+        char line[1024];
+        size_t line_number = 0;
+        bool success = true;
+        long long time = 0;
+
+        while (success && fgets(line, sizeof(line), fp)) {
+            ++line_number;
+
+            char *comment = strchr(line, '#');
+
+            if (comment) *comment = '\0';
+
+            std::vector<char *> words;
+            char *saved = nullptr;
+
+            for (char *word = strtok_r(line, " \t\r\n", &saved); word;
+                word = strtok_r(nullptr, " \t\r\n", &saved)) {
+                words.emplace_back(word);
+            }
+
+            if (words.empty()) continue;
+
+            long long at = 0;
+            bool relative = words[0][0] == '+';
+
+            if (!parse_time(words[0] + (relative ? 1 : 0), at)
+            ||  words.size() < 2) {
+                success = false;
+                break;
+            }
+
+            time = relative ? time + at : at;
+
+            success = parse_directive(
+                time, words[1], words.data() + 2, words.size() - 2
+            );
+        }
+
+        fclose(fp);
+
+        if (!success) {
+            log(
+                logfrom.c_str(), "%s:%lu: invalid directive",
+                script_file, (unsigned long) line_number
+            );
+
+            return false;
+        }
+
+        last_at = time;
+
+        return true;
+    }
+
+    inline bool parse_directive(
+        long long time, const char *verb, char **args, size_t count
+    ) {
+        uint64_t id = 0;
+        uint64_t number = 0;
+        uint16_t port = 0;
+
+        if (!strcmp(verb, "connect")) {
+            if (count != 2 || !parse_number(args[0], id)
+            ||  id >= LOAD_ID_BASE || !parse_port(args[1], port)) {
+                return false;
+            }
+
+            schedule(time, EVENT::CONNECT, id, port);
+        }
+        else if (!strcmp(verb, "send")) {
+            if (count != 2 || !parse_number(args[0], id)
+            ||  !parse_number(args[1], number)) {
+                return false;
+            }
+
+            schedule(time, EVENT::SEND, id, number);
+        }
+        else if (!strcmp(verb, "close")) {
+            if (count != 1 || !parse_number(args[0], id)) return false;
+
+            schedule(time, EVENT::CLOSE, id, 0);
+        }
+        else if (!strcmp(verb, "load")) {
+            load_type load{};
+
+            if (count < 6 || count > 7 || !parse_number(args[0], load.count)
+            ||  !parse_time(args[1], load.interval)
+            ||  !parse_port(args[2], load.supply_port)
+            ||  !parse_port(args[3], load.demand_port)
+            ||  !parse_number(args[4], number)
+            ||  !parse_time(args[5], load.hold)
+            ||  (count == 7 && !parse_time(args[6], load.lag))) {
+                return false;
+            }
+
+            load.bytes = size_t(number);
+            loads.emplace_back(load);
+
+            if (load.count) {
+                schedule(time, EVENT::SPAWN, loads.size() - 1, 0);
+            }
+        }
+        else if (!strcmp(verb, "end")) {
+            if (count != 0) return false;
+
+            schedule(time, EVENT::END, 0, 0);
+        }
+        else return false;
+
+        return true;
+    }
+
+    inline void schedule(
+        long long time, EVENT type, uint64_t client, uint64_t arg
+    ) {
+        events.push(event_type{time, sequence++, client, arg, type});
+    }
+
+    inline void play(const event_type &event) {
+        switch (event.type) {
+            case EVENT::CONNECT: {
+                client_connect(event.client, uint16_t(event.arg), 0, 0, 0);
+                break;
+            }
+            case EVENT::SEND: {
+                auto it = ids.find(event.client);
+
+                if (it != ids.end()) client_send(it->second, event.arg);
+
+                break;
+            }
+            case EVENT::CLOSE: {
+                auto it = ids.find(event.client);
+
+                if (it != ids.end()) client_close(it->second);
+
+                break;
+            }
+            case EVENT::SPAWN: {
+                load_type &load = loads[event.client];
+                uint64_t supply = next_load_id++;
+                uint64_t demand = next_load_id++;
+
+                ++counters.sessions;
+
+                uint32_t slot = client_connect(
+                    demand, load.demand_port, load.bytes, 0, load.hold
+                );
+
+                if (slot != NO_CLIENT) client_send(slot, load.bytes);
+
+                schedule(now + load.lag, EVENT::SUPPLY, supply, event.client);
+
+                if (++load.started < load.count) {
+                    schedule(
+                        now + load.interval, EVENT::SPAWN, event.client, 0
+                    );
+
+                    if (now + load.interval > last_at) {
+                        last_at = now + load.interval;
+                    }
+                }
+
+                break;
+            }
+            case EVENT::SUPPLY: {
+                const load_type &load = loads[event.arg];
+
+                client_connect(
+                    event.client, load.supply_port, load.bytes, load.bytes, 0
+                );
+
+                break;
+            }
+            case EVENT::END: {
+                end_at = now;
+                break;
+            }
+        }
+    }
+
+    inline uint32_t client_connect(
+        uint64_t id, uint16_t port, size_t expect, size_t reply, long long hold
+    ) {
+        auto listener = listeners.find(port);
+
+        if (listener == listeners.end() || ids.count(id)) {
+            ++counters.refused;
+            return NO_CLIENT;
+        }
+
+        uint32_t slot;
+
+        if (free_clients.empty()) {
+            slot = uint32_t(clients.size());
+            clients.emplace_back();
+        }
+        else {
+            slot = free_clients.back();
+            free_clients.pop_back();
+        }
+
+        clients[slot] = client_type{
+            id, now, 0, 0, expect, reply, hold, -1, port, false, false
+        };
+
+        ids[id] = slot;
+        ++live;
+        ++counters.connected;
+
+        backlogs[port].emplace_back(slot);
+        notify(listener->second, EPOLLIN);
+
+        return slot;
+    }
+
+    inline void client_send(uint32_t slot, uint64_t bytes) {
+        client_type &client = clients[slot];
+
+        if (client.closed || bytes == 0) return;
+
+        client.unread += size_t(bytes);
+        counters.sent += bytes;
+
+        if (client.descriptor >= 0) notify(client.descriptor, EPOLLIN);
+    }
+
+    inline void client_close(uint32_t slot) {
+        client_type &client = clients[slot];
+
+        if (client.closed) return;
+
+        client.closed = true;
+
+        if (client.descriptor >= 0) {
+            notify(client.descriptor, EPOLLIN|EPOLLRDHUP);
+        }
+    }
+
+    inline void client_receive(uint32_t slot, size_t bytes) {
+        client_type &client = clients[slot];
+
+        if (client.received == 0) {
+            first_byte.record(uint64_t(now - client.connected));
+        }
+
+        client.received += bytes;
+        counters.delivered += bytes;
+
+        if (client.completed || !client.expect
+        ||  client.received < client.expect) {
+            return;
+        }
+
+        client.completed = true;
+
+        if (client.reply) {
+            schedule(now, EVENT::SEND, client.id, client.reply);
+        }
+        else {
+            completion.record(uint64_t(now - client.connected));
+            schedule(now + client.hold, EVENT::CLOSE, client.id, 0);
+        }
+    }
+
+    inline void retire(uint32_t slot) {
+        ids.erase(clients[slot].id);
+        free_clients.emplace_back(slot);
+        --live;
+    }
+
+    inline int open_descriptor(KIND kind) {
+        int descriptor;
+
+        if (released.empty()) descriptor = next_descriptor++;
+        else {
+            descriptor = released.top();
+            released.pop();
+        }
+
+        if (size_t(descriptor) >= descriptors.size()) {
+            descriptors.resize(size_t(descriptor) + 1, descriptor_type{});
+        }
+
+        descriptor_type &entry = descriptors[size_t(descriptor)];
+        bool queued = entry.queued;
+
+        entry = descriptor_type{NO_CLIENT, 0, 0, 0, kind, queued};
+
+        return descriptor;
+    }
+
+    inline descriptor_type *find(int descriptor, KIND kind) {
+        if (descriptor < 0 || size_t(descriptor) >= descriptors.size()) {
+            return nullptr;
+        }
+
+        descriptor_type *entry = &descriptors[size_t(descriptor)];
+
+        if (entry->kind == KIND::NONE
+        ||  (kind != KIND::NONE && entry->kind != kind)) {
+            return nullptr;
+        }
+
+        return entry;
+    }
+
+    inline void notify(int descriptor, uint32_t events) {
+        // Like epoll in the edge triggered mode, the events are only reported
+        // as they happen. Hang-ups and errors are reported regardless of the
+        // interest.
+
+        descriptor_type &entry = descriptors[size_t(descriptor)];
+
+        events &= entry.interest | EPOLLHUP | EPOLLERR;
+
+        if (!events || entry.interest == 0) return;
+
+        entry.pending |= events;
+
+        if (!entry.queued) {
+            entry.queued = true;
+            ready.emplace_back(descriptor);
+        }
+    }
+
+    inline uint32_t readiness(int descriptor) {
+        const descriptor_type &entry = descriptors[size_t(descriptor)];
+
+        if (entry.kind == KIND::LISTENER) {
+            auto it = backlogs.find(entry.port);
+
+            if (it == backlogs.end() || it->second.empty()) return 0;
+
+            return EPOLLIN;
+        }
+
+        if (entry.kind != KIND::CONNECTION) return 0;
+
+        const client_type &client = clients[entry.client];
+        uint32_t events = EPOLLOUT;
+
+        if (client.unread) events |= EPOLLIN;
+        if (client.closed) events |= EPOLLIN|EPOLLRDHUP;
+
+        return events;
+    }
+
+    inline void finish() {
+        finished = true;
+        raise(SIGTERM);
+    }
+
+    inline int accept4(int descriptor, sockaddr *addr, socklen_t *len) {
+        descriptor_type *listener = find(descriptor, KIND::LISTENER);
+
+        if (!listener) {
+            errno = EBADF;
+            return -1;
+        }
+
+        std::deque<uint32_t> &backlog = backlogs[listener->port];
+
+        if (backlog.empty()) {
+            errno = EAGAIN;
+            return -1;
+        }
+
+        uint32_t slot = backlog.front();
+        backlog.pop_front();
+
+        int accepted = open_descriptor(KIND::CONNECTION);
+        client_type &client = clients[slot];
+
+        descriptors[size_t(accepted)].client = slot;
+        descriptors[size_t(accepted)].port = client.port;
+        client.descriptor = accepted;
+
+        if (addr && len && *len >= sizeof(sockaddr_in)) {
+            // Every client appears to connect from an address of its own in
+            // the 10.0.0.0/8 network.
+
+            sockaddr_in in{};
+
+            in.sin_family = AF_INET;
+            in.sin_port = htons(uint16_t(1024 + client.id % 64000));
+            in.sin_addr.s_addr = htonl(
+                (10U << 24) | uint32_t(client.id & 0xffffff)
+            );
+
+            std::memcpy(addr, &in, sizeof(in));
+            *len = sizeof(in);
+        }
+
+        return accepted;
+    }
+
+    inline ssize_t read(int descriptor, void *buf, size_t count) {
+        descriptor_type *entry = find(descriptor, KIND::CONNECTION);
+
+        if (!entry) {
+            errno = EBADF;
+            return -1;
+        }
+
+        client_type &client = clients[entry->client];
+
+        if (client.unread == 0) {
+            if (client.closed) return 0;
+
+            errno = EAGAIN;
+            return -1;
+        }
+
+        size_t length = client.unread < count ? client.unread : count;
+
+        std::memset(buf, 'x', length);
+        client.unread -= length;
+
+        return ssize_t(length);
+    }
+
+    inline ssize_t write(int descriptor, size_t count) {
+        descriptor_type *entry = find(descriptor, KIND::CONNECTION);
+
+        if (!entry) {
+            errno = EBADF;
+            return -1;
+        }
+
+        if (clients[entry->client].closed) {
+            errno = EPIPE;
+            return -1;
+        }
+
+        client_receive(entry->client, count);
+
+        return ssize_t(count);
+    }
+
+    inline int epoll_ctl(int descriptor, int op, int fd, epoll_event *event) {
+        if (!find(descriptor, KIND::EPOLL)) {
+            errno = EBADF;
+            return -1;
+        }
+
+        descriptor_type *entry = find(fd, KIND::NONE);
+
+        if (!entry) {
+            errno = EBADF;
+            return -1;
+        }
+
+        if (op == EPOLL_CTL_DEL) {
+            entry->interest = 0;
+            entry->pending = 0;
+            return 0;
+        }
+
+        if (!event) {
+            errno = EINVAL;
+            return -1;
+        }
+
+        // Whatever the descriptor is ready for is reported right away, just
+        // like epoll does when a descriptor is added or modified.
+
+        entry->interest = event->events;
+        entry->pending = 0;
+        notify(fd, readiness(fd));
+
+        return 0;
+    }
+
+    inline int epoll_pwait(int descriptor, epoll_event *out, int max, int ms) {
+        if (!find(descriptor, KIND::EPOLL) || max <= 0) {
+            errno = EINVAL;
+            return -1;
+        }
+
+        ++counters.waits;
+
+        for (;;) {
+            int count = 0;
+
+            while (!ready.empty() && count < max) {
+                int fd = ready.front();
+                descriptor_type &entry = descriptors[size_t(fd)];
+
+                ready.pop_front();
+                entry.queued = false;
+
+                if (entry.kind == KIND::NONE || !entry.pending) continue;
+
+                out[count].events = entry.pending;
+                out[count].data.fd = fd;
+                entry.pending = 0;
+                ++count;
+            }
+
+            if (count) {
+                counters.events += uint64_t(count);
+                return count;
+            }
+
+            if (ms == 0) return 0;
+
+            if (finished) {
+                errno = EINTR;
+                return -1;
+            }
+
+            if ((end_at && now >= end_at)
+            ||  (events.empty() && (live == 0 || now >= last_at + LINGER_USEC))
+            ||  (events.empty() && alarm_at == 0)) {
+                finish();
+                errno = EINTR;
+                return -1;
+            }
+
+            long long wake = events.empty() ? last_at + LINGER_USEC : (
+                events.top().time
+            );
+
+            if (alarm_at && alarm_at < wake) wake = alarm_at;
+
+            if (ms > 0 && now + ms * 1000LL < wake) {
+                now += ms * 1000LL;
+                return 0;
+            }
+
+            if (wake > now) now = wake;
+
+            if (alarm_at && alarm_at <= now) {
+                alarm_at = 0;
+                raise(SIGALRM);
+                errno = EINTR;
+                return -1;
+            }
+
+            while (!events.empty() && events.top().time <= now) {
+                event_type event = events.top();
+
+                events.pop();
+                play(event);
+            }
+        }
+    }
+
+    inline int bind(int descriptor, const sockaddr *addr) {
+        descriptor_type *entry = find(descriptor, KIND::SOCKET);
+
+        if (!entry || !addr) {
+            errno = EBADF;
+            return -1;
+        }
+
+        uint16_t port = 0;
+
+        if (addr->sa_family == AF_INET) {
+            port = ntohs(reinterpret_cast<const sockaddr_in *>(addr)->sin_port);
+        }
+        else if (addr->sa_family == AF_INET6) {
+            port = ntohs(
+                reinterpret_cast<const sockaddr_in6 *>(addr)->sin6_port
+            );
+        }
+
+        if (listeners.count(port)) {
+            errno = EADDRINUSE;
+            return -1;
+        }
+
+        entry->port = port;
+
+        return 0;
+    }
+
+    inline int listen(int descriptor) {
+        descriptor_type *entry = find(descriptor, KIND::SOCKET);
+
+        if (!entry || !entry->port) {
+            errno = EINVAL;
+            return -1;
+        }
+
+        entry->kind = KIND::LISTENER;
+        listeners[entry->port] = descriptor;
+
+        return 0;
+    }
+
+    inline int shutdown(int descriptor) {
+        // The simulated clients close their end as soon as they see the end
+        // of the stream.
+
+        descriptor_type *entry = find(descriptor, KIND::CONNECTION);
+
+        if (!entry) {
+            errno = ENOTCONN;
+            return -1;
+        }
+
+        if (!clients[entry->client].closed) ++counters.dropped;
+
+        client_close(entry->client);
+
+        return 0;
+    }
+
+    inline int close(int descriptor) {
+        descriptor_type *entry = find(descriptor, KIND::NONE);
+
+        if (!entry) {
+            errno = EBADF;
+            return -1;
+        }
+
+        if (entry->kind == KIND::CONNECTION) {
+            client_type &client = clients[entry->client];
+
+            if (!client.closed) ++counters.dropped;
+
+            client.descriptor = -1;
+            retire(entry->client);
+        }
+        else if (entry->kind == KIND::LISTENER) {
+            std::deque<uint32_t> &backlog = backlogs[entry->port];
+
+            for (uint32_t slot : backlog) {
+                ++counters.dropped;
+                retire(slot);
+            }
+
+            backlogs.erase(entry->port);
+            listeners.erase(entry->port);
+        }
+
+        entry->kind = KIND::NONE;
+        entry->interest = 0;
+        entry->pending = 0;
+        released.push(descriptor);
+
+        return 0;
+    }
+
+    static int sim_accept4(int fd, sockaddr *addr, socklen_t *len, int) {
+        return active->accept4(fd, addr, len);
+    }
+
+    static ssize_t sim_read(int fd, void *buf, size_t count) {
+        return active->read(fd, buf, count);
+    }
+
+    static ssize_t sim_write(int fd, const void *, size_t count) {
+        return active->write(fd, count);
+    }
+
+    static int sim_epoll_create1(int) {
+        if (active->epoll_descriptor >= 0) {
+            errno = EMFILE;
+            return -1;
+        }
+
+        active->epoll_descriptor = active->open_descriptor(KIND::EPOLL);
+
+        return active->epoll_descriptor;
+    }
+
+    static int sim_epoll_ctl(int epfd, int op, int fd, epoll_event *event) {
+        return active->epoll_ctl(epfd, op, fd, event);
+    }
+
+    static int sim_epoll_pwait(
+        int epfd, epoll_event *events, int max, int ms, const sigset_t *
+    ) {
+        return active->epoll_pwait(epfd, events, max, ms);
+    }
+
+    static int sim_socket(int, int, int) {
+        return active->open_descriptor(KIND::SOCKET);
+    }
+
+    static int sim_bind(int fd, const sockaddr *addr, socklen_t) {
+        return active->bind(fd, addr);
+    }
+
+    static int sim_listen(int fd, int) {
+        return active->listen(fd);
+    }
+
+    static int sim_connect(int, const sockaddr *, socklen_t) {
+        // Only the clients of the script may connect.
+
+        errno = ECONNREFUSED;
+        return -1;
+    }
+
+    static int sim_shutdown(int fd, int) {
+        return active->shutdown(fd);
+    }
+
+    static int sim_open(const char *, int, mode_t) {
+        // Files only take up a descriptor.
+
+        return active->open_descriptor(KIND::FILE);
+    }
+
+    static int sim_close(int fd) {
+        if (fd == active->epoll_descriptor) active->epoll_descriptor = -1;
+
+        return active->close(fd);
+    }
+
+    static int sim_getsockopt(int, int level, int name, void *value,
+        socklen_t *length
+    ) {
+        if (level != SOL_SOCKET || name != SO_ERROR || !value || !length
+        ||  *length < sizeof(int)) {
+            errno = ENOPROTOOPT;
+            return -1;
+        }
+
+        *static_cast<int *>(value) = 0;
+
+        return 0;
+    }
+
+    static int sim_setsockopt(int, int, int, const void *, socklen_t) {
+        return 0;
+    }
+
+    static int sim_clock_gettime(clockid_t, timespec *ts) {
+        // Every clock shows the same virtual time.
+
+        long long usec = EPOCH_USEC + active->now;
+
+        ts->tv_sec = time_t(usec / 1000000);
+        ts->tv_nsec = long(usec % 1000000) * 1000L;
+
+        return 0;
+    }
+
+    static int sim_setitimer(int, const itimerval *value, itimerval *) {
+        long long usec = (
+            (long long) value->it_value.tv_sec * 1000000LL +
+            (long long) value->it_value.tv_usec
+        );
+
+        active->alarm_at = usec > 0 ? active->now + usec : 0;
+
+        return 0;
+    }
+
+    static SIMNET *active;
+
+    std::string logfrom;
+    void (*log)(const char *, const char *p_fmt, ...);
+    long long now;       // Virtual microseconds since the start.
+    long long alarm_at;  // When the interval timer expires, if armed.
+    long long end_at;    // When the script ends the simulation, if it does.
+    long long last_at;   // Time of the last directive.
+    uint64_t sequence;
+    int next_descriptor;
+    int epoll_descriptor;
+    uint64_t next_load_id;
+    uint64_t live;       // Clients that have not been retired.
+    bool finished;
+    long long started_usec;
+    counters_type counters;
+    HISTOGRAM completion;
+    HISTOGRAM first_byte;
+    std::priority_queue<event_type, std::vector<event_type>, later_type> events;
+    std::priority_queue<int, std::vector<int>, std::greater<int>> released;
+    std::vector<descriptor_type> descriptors;
+    std::vector<client_type> clients;
+    std::vector<uint32_t> free_clients;
+    std::vector<load_type> loads;
+    std::deque<int> ready;
+    std::unordered_map<uint64_t, uint32_t> ids;
+    std::unordered_map<uint16_t, int> listeners;
+    std::unordered_map<uint16_t, std::deque<uint32_t>> backlogs;
+};
+
+#endif
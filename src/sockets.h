@@ -5,18 +5,34 @@
 #include <array>
 #include <vector>
 #include <algorithm>
+#include <limits>
 #include <netdb.h>
+#include <fcntl.h>
 #include <sys/epoll.h>
+#include <sys/resource.h>
 #include <unordered_map>
 #include <signal.h>
 #include <string.h>
 #include <stdarg.h>
 #include <unistd.h>
+#include <time.h>
+
+#include "admission.h"
+#include "histogram.h"
+#include "hitters.h"
+#include "hyperloglog.h"
+#include "kernel.h"
+#include "phases.h"
+#include "probes.h"
+#include "trace.h"
 
 class SOCKETS {
     public:
     static const int EPOLL_MAX_EVENTS = 64;
     static const int NO_DESCRIPTOR = -1;
+    static const size_t MIN_BUFFER_SIZE = 4096;
+    static const long long MIN_ACCEPT_BACKOFF = 10000;   // Microseconds.
+    static const long long MAX_ACCEPT_BACKOFF = 1000000; // Microseconds.
 
     enum class FLAG : uint8_t {
         NONE           =  0,
@@ -34,19 +50,63 @@ class SOCKETS {
         CONNECTING     = 12,
         TRIED_IPV4     = 13,
         TRIED_IPV6     = 14,
+        PAUSED         = 15,
+        THROTTLED      = 16,
         // Do not change the order of these flags:
-        EPOLL          = 15,
-        MAX_FLAGS      = 16
+        EPOLL          = 17,
+        MAX_FLAGS      = 18
+    };
+
+    struct memory_type {
+        size_t records;  // Bytes reserved for the records of descriptors.
+        size_t buffers;  // Bytes reserved for the incoming and outgoing bytes.
+        size_t flags;    // Bytes reserved for the flag vectors.
+        size_t groups;   // Bytes reserved for the sizes of the groups.
+        size_t count;    // Number of records.
+    };
+
+    struct exhaustion_type {
+        size_t limit;      // Descriptors the process is allowed to open.
+        size_t headroom;   // Descriptors left, apart from the other files.
+        size_t shed;       // Clients closed right after accepting them.
+        size_t pauses;     // Times a listener stopped accepting.
+        size_t paused;     // Listeners not accepting at the moment.
+        long long backoff; // Microseconds of the ongoing pause.
+    };
+
+    struct queue_type {
+        size_t size;     // Bytes waiting to be written.
+        size_t growth;   // Bytes queued during the last period.
+        size_t drain;    // Bytes written during the last period.
+        long long age;   // Microseconds since the queue was last empty.
+        long long growing; // Microseconds of growing faster than draining.
     };
 
     private:
+    struct chunk_type {
+        uint64_t end;   // Bytes appended to the outgoing queue up to its end.
+        long long usec; // When it was appended.
+    };
+
     struct record_type {
         std::array<uint32_t, static_cast<size_t>(FLAG::MAX_FLAGS)> flags;
         epoll_event *events;
         std::vector<uint8_t> *incoming;
         std::vector<uint8_t> *outgoing;
+        std::vector<chunk_type> *chunks; // Forwarded chunks not yet written.
         std::array<char, NI_MAXHOST> host;
         std::array<char, NI_MAXSERV> port;
+        long long outgoing_since;
+        long long growing_since;
+        uint64_t appended; // Bytes ever appended to the outgoing queue.
+        uint64_t written;  // Bytes ever written from the outgoing queue.
+        size_t first_chunk;
+        size_t queued;
+        size_t drained;
+        size_t growth;
+        size_t drain;
+        uint64_t period; // Period of the queued and drained bytes.
+        uint64_t source; // Key of the admitted source, zero if not counted.
         int descriptor;
         int parent;
         int group;
@@ -57,6 +117,12 @@ class SOCKETS {
         FLAG index;
     };
 
+    struct rates_type {
+        size_t growth;
+        size_t drain;
+        long long growing_since;
+    };
+
     static constexpr record_type make_record(
         int descriptor, int parent, int group
     ) {
@@ -68,8 +134,20 @@ class SOCKETS {
             .events     = nullptr,
             .incoming   = nullptr,
             .outgoing   = nullptr,
+            .chunks     = nullptr,
             .host       = {'\0'},
             .port       = {'\0'},
+            .outgoing_since = 0,
+            .growing_since  = 0,
+            .appended   = 0,
+            .written    = 0,
+            .first_chunk = 0,
+            .queued     = 0,
+            .drained    = 0,
+            .growth     = 0,
+            .drain      = 0,
+            .period     = 0,
+            .source     = 0,
             .descriptor = descriptor,
             .parent     = parent,
             .group      = group
@@ -101,6 +179,26 @@ class SOCKETS {
         const char *log_src ="Sockets"
     ) : logfrom(log_src)
       , log    (log_fun)
+      , kernel (&KERNEL::native())
+      , latency(nullptr)
+      , trace  (nullptr)
+      , phases (nullptr)
+      , hitters(nullptr)
+      , clients(nullptr)
+      , admission(nullptr)
+      , reserve_descriptor(NO_DESCRIPTOR)
+      , descriptor_limit(0)
+      , accept_backoff(0)
+      , accept_resume (0)
+      , accept_shed   (0)
+      , accept_pauses (0)
+      , rates_period  (0)
+      , rates_since   (0)
+      , rates_before  (0)
+      , incoming_total(0)
+      , outgoing_total(0)
+      , buffer_total  (0)
+      , record_count  (0)
     {}
     ~SOCKETS() {}
 
@@ -147,12 +245,33 @@ class SOCKETS {
             return false;
         }
 
+        raise_descriptor_limit();
+
+        // One descriptor is held in reserve, so that there would always be
+        // one left for turning a client away when the others have run out.
+
+        reserve_descriptor = open_reserve();
+
+        if (reserve_descriptor == NO_DESCRIPTOR) {
+            log(
+                logfrom.c_str(), "open: %s (%s:%d)", strerror(errno),
+                __FILE__, __LINE__
+            );
+
+            return false;
+        }
+
         return true;
     }
 
     inline bool deinit() {
         bool success = true;
 
+        if (reserve_descriptor != NO_DESCRIPTOR) {
+            kernel->close(reserve_descriptor);
+            reserve_descriptor = NO_DESCRIPTOR;
+        }
+
         for (size_t key_hash=0; key_hash<descriptors.size(); ++key_hash) {
             while (!descriptors[key_hash].empty()) {
                 int descriptor = descriptors[key_hash].back().descriptor;
@@ -270,21 +389,178 @@ class SOCKETS {
         return record ? record->port.data() : "";
     }
 
+    inline size_t get_incoming_size(int descriptor) const {
+        const record_type *record = find_record(descriptor);
+        return record && record->incoming ? record->incoming->size() : 0;
+    }
+
+    inline size_t get_outgoing_size(int descriptor) const {
+        const record_type *record = find_record(descriptor);
+        return record && record->outgoing ? record->outgoing->size() : 0;
+    }
+
+    inline bool get_outgoing_queue(int descriptor, queue_type &queue) const {
+        const record_type *record = find_record(descriptor);
+
+        if (!record || !record->outgoing) return false;
+
+        rates_type rates = rates_of(*record);
+
+        queue.size = record->outgoing->size();
+        queue.growth = rates.growth;
+        queue.drain = rates.drain;
+        long long now = get_usec();
+
+        queue.age = record->outgoing_since ? now - record->outgoing_since : 0;
+        queue.growing = rates.growing_since ? now - rates.growing_since : 0;
+
+        return true;
+    }
+
+    inline void roll_outgoing_rates() {
+        // Ends the current period of measuring the growth and the drain of
+        // the outgoing queues. When called periodically, the reported growth
+        // and drain are the rates of the queues per that period. A queue that
+        // grows faster than it drains is considered growing since the start
+        // of the first such period in a row. The records themselves are only
+        // rolled over when their queue is next touched or looked at.
+
+        long long now = get_usec();
+
+        rates_before = rates_since ? rates_since : now;
+        rates_since = now;
+        ++rates_period;
+    }
+
+    inline size_t get_incoming_total() const {
+        return incoming_total;
+    }
+
+    inline size_t get_outgoing_total() const {
+        return outgoing_total;
+    }
+
+    inline void get_memory(memory_type &memory) const {
+        // Estimates the memory reserved by the containers from their
+        // capacities, leaving out the overhead of the allocator. The buffers
+        // are accounted for as they change, so that the cost of the estimate
+        // does not depend on the number of descriptors.
+
+        memory = {};
+        memory.buffers = buffer_total;
+        memory.count = record_count;
+
+        for (size_t key=0; key<descriptors.size(); ++key) {
+            memory.records += descriptors[key].capacity() * sizeof(record_type);
+        }
+
+        for (const std::vector<flag_type> &flag : flags) {
+            memory.flags += flag.capacity() * sizeof(flag_type);
+        }
+
+        memory.groups = groups.size() * (
+            sizeof(void *) + sizeof(decltype(groups)::value_type)
+        ) + groups.bucket_count() * sizeof(void *);
+    }
+
+    inline void get_exhaustion(exhaustion_type &exhaustion) const {
+        // The headroom leaves out the files that were opened outside of this
+        // class, such as the standard streams and the log files.
+
+        size_t used = record_count + (
+            reserve_descriptor != NO_DESCRIPTOR ? 1 : 0
+        );
+
+        exhaustion = {};
+        exhaustion.limit = descriptor_limit;
+        exhaustion.headroom = (
+            descriptor_limit > used ? descriptor_limit - used : 0
+        );
+        exhaustion.shed = accept_shed;
+        exhaustion.pauses = accept_pauses;
+        exhaustion.paused = flags[static_cast<size_t>(FLAG::THROTTLED)].size();
+        exhaustion.backoff = exhaustion.paused ? accept_backoff : 0;
+    }
+
     inline void freeze(int descriptor) {
         set_flag(descriptor, FLAG::FROZEN);
+
+        if (trace) trace->record(TRACE::TYPE::FREEZE, descriptor);
     }
 
     inline void unfreeze(int descriptor) {
         if (!has_flag(descriptor, FLAG::DISCONNECT)
         &&  !has_flag(descriptor, FLAG::CLOSE)) {
             rem_flag(descriptor, FLAG::FROZEN);
+
+            if (trace) trace->record(TRACE::TYPE::UNFREEZE, descriptor);
         }
     }
 
+    inline void set_kernel(const KERNEL *calls) {
+        // Once set, the system calls are made through the given table, which
+        // may stand for a simulated network. It must be set before anything
+        // is opened.
+
+        kernel = calls;
+    }
+
+    inline void set_latency_histogram(HISTOGRAM *histogram) {
+        // Once set, the time it takes for every forwarded chunk to be written
+        // in full is recorded in the given histogram in microseconds.
+
+        latency = histogram;
+    }
+
+    inline void set_trace(TRACE *ring) {
+        // Once set, the notable events of every descriptor are recorded in the
+        // given trace ring.
+
+        trace = ring;
+    }
+
+    inline void set_phases(PHASES *accounting) {
+        // Once set, the time spent waiting for events is accounted for as the
+        // wait phase of the given phase accounting.
+
+        phases = accounting;
+    }
+
+    inline void set_accept_sketches(HITTERS *hosts, HYPERLOGLOG *distinct) {
+        // Once set, the host of every accepted connection is counted in the
+        // given sketches.
+
+        hitters = hosts;
+        clients = distinct;
+    }
+
+    inline void set_admission(ADMISSION *control) {
+        // Once set, every accepted connection has to be admitted by the given
+        // admission control before a record is made for it.
+
+        admission = control;
+    }
+
     inline bool is_frozen(int descriptor) {
         return has_flag(descriptor, FLAG::FROZEN);
     }
 
+    inline void pause(int descriptor) {
+        // Unlike a frozen descriptor, a paused descriptor keeps writing its
+        // outgoing bytes. Only reading from it is postponed until it is
+        // resumed.
+
+        set_flag(descriptor, FLAG::PAUSED);
+    }
+
+    inline void resume(int descriptor) {
+        rem_flag(descriptor, FLAG::PAUSED);
+    }
+
+    inline bool is_paused(int descriptor) const {
+        return has_flag(descriptor, FLAG::PAUSED);
+    }
+
     inline bool connect(
         const char *host, const char *port, int group =0
     ) {
@@ -322,7 +598,7 @@ class SOCKETS {
                 handle_write(descriptor);
             }
 
-            int retval = shutdown(descriptor, SHUT_WR);
+            int retval = kernel->shutdown(descriptor, SHUT_WR);
             if (retval == -1) {
                 int code = errno;
 
@@ -357,31 +633,64 @@ class SOCKETS {
 
     inline bool swap_incoming(int descriptor, std::vector<uint8_t> &bytes) {
         const record_type *record = find_record(descriptor);
-        if (record && record->incoming) record->incoming->swap(bytes);
+        if (record && record->incoming) {
+            account(*record, false);
+            record->incoming->swap(bytes);
+            account(*record, true);
+        }
         else return false;
 
         return true;
     }
 
     inline bool swap_outgoing(int descriptor, std::vector<uint8_t> &bytes) {
-        const record_type *record = find_record(descriptor);
-        if (record && record->outgoing) record->outgoing->swap(bytes);
+        // The forwarded chunks are forgotten since the queue is replaced.
+
+        record_type *record = find_record(descriptor);
+        if (record && record->outgoing) {
+            account(*record, false);
+            record->outgoing->swap(bytes);
+            account(*record, true);
+        }
         else return false;
 
+        record->appended = record->written + record->outgoing->size();
+
+        if (record->chunks) {
+            record->chunks->clear();
+            record->first_chunk = 0;
+        }
+
         return true;
     }
 
     inline bool append_outgoing(
         int descriptor, const std::vector<uint8_t> &bytes
     ) {
-        const record_type *record = find_record(descriptor);
+        record_type *record = find_record(descriptor);
 
         if (record && record->outgoing) {
             if (!bytes.empty()) {
+                if (record->outgoing->empty()) {
+                    record->outgoing_since = get_usec();
+                }
+
+                size_t capacity = record->outgoing->capacity();
+
+                reserve(
+                    *record->outgoing, record->outgoing->size() + bytes.size()
+                );
+
                 record->outgoing->insert(
                     record->outgoing->end(), bytes.begin(), bytes.end()
                 );
 
+                buffer_total += record->outgoing->capacity() - capacity;
+                outgoing_total += bytes.size();
+                roll_rates(*record);
+                record->queued += bytes.size();
+                record->appended += bytes.size();
+
                 set_flag(descriptor, FLAG::WRITE);
             }
         }
@@ -390,6 +699,50 @@ class SOCKETS {
         return true;
     }
 
+    inline bool forward_outgoing(
+        int descriptor, const std::vector<uint8_t> &bytes
+    ) {
+        // Appends a forwarded chunk to the outgoing queue. Unlike the other
+        // bytes, the chunk is timestamped so that its latency could be
+        // recorded once all of it has been written.
+
+        if (!append_outgoing(descriptor, bytes)) return false;
+
+        if (!latency || bytes.empty()) return true;
+
+        record_type *record = find_record(descriptor);
+
+        if (!record->chunks) {
+            record->chunks = new (std::nothrow) std::vector<chunk_type>;
+
+            if (!record->chunks) return true;
+
+            buffer_total += sizeof(*record->chunks);
+        }
+
+        std::vector<chunk_type> &chunks = *record->chunks;
+        size_t capacity = chunks.capacity();
+
+        if (chunks.size() == chunks.capacity()) {
+            // The chunks already written are only removed when they take up
+            // at least half of the room.
+
+            if (record->first_chunk >= chunks.size() / 2) {
+                chunks.erase(
+                    chunks.begin(), chunks.begin() + record->first_chunk
+                );
+
+                record->first_chunk = 0;
+            }
+        }
+
+        chunks.push_back(chunk_type{record->appended, get_usec()});
+
+        buffer_total += (chunks.capacity() - capacity) * sizeof(chunk_type);
+
+        return true;
+    }
+
     inline bool serve(int timeout =-1) {
         static constexpr const size_t flg_connect_index{
             static_cast<size_t>(FLAG::NEW_CONNECTION)
@@ -406,7 +759,13 @@ class SOCKETS {
             return true;
         }
 
-        std::vector<int> recbuf;
+        if (!flags[static_cast<size_t>(FLAG::THROTTLED)].empty()) {
+            resume_accepting(timeout);
+        }
+
+        // The buffer keeps its capacity between the calls, so that serving
+        // the descriptors would not allocate once the traffic has settled.
+        recbuf.clear();
 
         for (size_t i=0; i<flags.size(); ++i) {
             FLAG flag = static_cast<FLAG>(i);
@@ -417,6 +776,8 @@ class SOCKETS {
                 case FLAG::TRIED_IPV6:
                 case FLAG::LISTENER:
                 case FLAG::FROZEN:
+                case FLAG::PAUSED:
+                case FLAG::THROTTLED:
                 case FLAG::INCOMING:
                 case FLAG::NEW_CONNECTION:
                 case FLAG::DISCONNECT:
@@ -499,7 +860,8 @@ class SOCKETS {
                         break;
                     }
                     case FLAG::READ: {
-                        if (has_flag(d, FLAG::FROZEN)) {
+                        if (has_flag(d, FLAG::FROZEN)
+                        ||  has_flag(d, FLAG::PAUSED)) {
                             set_flag(d, flag);
                             continue;
                         }
@@ -546,13 +908,23 @@ class SOCKETS {
             return;
         }
 
-        const record_type *record = find_record(descriptor);
+        record_type *record = find_record(descriptor);
 
         if (record && record->outgoing) {
+            if (record->outgoing->empty()) {
+                record->outgoing_since = get_usec();
+            }
+
+            size_t capacity = record->outgoing->capacity();
+
             if (size_t(retval) < sizeof(stackbuf)) {
                 record->outgoing->insert(
                     record->outgoing->end(), stackbuf, stackbuf + retval
                 );
+                outgoing_total += size_t(retval);
+                roll_rates(*record);
+                record->queued += size_t(retval);
+                record->appended += size_t(retval);
                 set_flag(descriptor, FLAG::WRITE);
             }
             else {
@@ -584,6 +956,10 @@ class SOCKETS {
                     record->outgoing->insert(
                         record->outgoing->end(), heapbuf, heapbuf + retval
                     );
+                    outgoing_total += size_t(retval);
+                    roll_rates(*record);
+                    record->queued += size_t(retval);
+                    record->appended += size_t(retval);
                     set_flag(descriptor, FLAG::WRITE);
                 }
                 else {
@@ -596,15 +972,159 @@ class SOCKETS {
 
                 delete [] heapbuf;
             }
+
+            buffer_total += record->outgoing->capacity() - capacity;
         }
     }
 
     private:
+    // The microbenchmarks in bench/sockets.cpp drive the internals directly
+    // on records that have no kernel descriptor behind them.
+    friend class SOCKETS_BENCH;
+
     static void drop_log(const char *, const char *, ...) {}
 
+    static inline void reserve(std::vector<uint8_t> &bytes, size_t size) {
+        // The buffers grow in powers of two, so that a connection would stop
+        // reallocating after its first few chunks rather than every time it
+        // sees a chunk larger than any before it.
+
+        if (size <= bytes.capacity()) return;
+
+        size_t capacity = MIN_BUFFER_SIZE;
+
+        while (capacity < size) capacity *= 2;
+
+        bytes.reserve(capacity);
+    }
+
+    inline int open_reserve() const {
+        int descriptor = kernel->open("/dev/null", O_RDONLY|O_CLOEXEC, 0);
+
+        return descriptor == -1 ? NO_DESCRIPTOR : descriptor;
+    }
+
+    inline void raise_descriptor_limit() {
+        // The soft limit on the open files is raised as far as the hard limit
+        // allows, since every connection takes a descriptor.
+
+        struct rlimit limit;
+
+        if (getrlimit(RLIMIT_NOFILE, &limit) != 0) {
+            log(
+                logfrom.c_str(), "getrlimit: %s (%s:%d)", strerror(errno),
+                __FILE__, __LINE__
+            );
+
+            return;
+        }
+
+        if (limit.rlim_cur < limit.rlim_max) {
+            rlim_t soft = limit.rlim_cur;
+
+            limit.rlim_cur = limit.rlim_max;
+
+            if (setrlimit(RLIMIT_NOFILE, &limit) != 0) {
+                log(
+                    logfrom.c_str(), "setrlimit: %s (%s:%d)", strerror(errno),
+                    __FILE__, __LINE__
+                );
+
+                limit.rlim_cur = soft;
+            }
+        }
+
+        descriptor_limit = (
+            limit.rlim_cur == RLIM_INFINITY ?
+            std::numeric_limits<size_t>::max() : size_t(limit.rlim_cur)
+        );
+    }
+
+    inline void shed(int listener) {
+        // The reserved descriptor is given up for just long enough to accept
+        // the waiting clients one by one and close them. The clients then
+        // learn that they were turned away rather than waiting in the backlog
+        // for the pause to end.
+
+        if (reserve_descriptor == NO_DESCRIPTOR) {
+            reserve_descriptor = open_reserve();
+            return;
+        }
+
+        kernel->close(reserve_descriptor);
+
+        for (int i=0; i<EPOLL_MAX_EVENTS; ++i) {
+            int client = kernel->accept4(
+                listener, nullptr, nullptr, SOCK_CLOEXEC
+            );
+
+            if (client < 0) break;
+
+            kernel->close(client);
+            ++accept_shed;
+        }
+
+        reserve_descriptor = open_reserve();
+    }
+
+    inline void throttle(int listener) {
+        // The pause doubles for as long as the listeners keep failing to
+        // accept, and is over for all of them at the same time.
+
+        accept_backoff = (
+            accept_backoff ? accept_backoff * 2 : MIN_ACCEPT_BACKOFF
+        );
+
+        if (accept_backoff > MAX_ACCEPT_BACKOFF) {
+            accept_backoff = MAX_ACCEPT_BACKOFF;
+        }
+
+        accept_resume = get_usec() + accept_backoff;
+
+        set_flag(listener, FLAG::THROTTLED);
+        ++accept_pauses;
+    }
+
+    inline void resume_accepting(int &timeout) {
+        static constexpr const size_t flg_throttled_index{
+            static_cast<size_t>(FLAG::THROTTLED)
+        };
+
+        long long usec = get_usec();
+
+        if (usec < accept_resume) {
+            // The wait for events must not outlast the pause.
+
+            long long msec = (accept_resume - usec + 999) / 1000;
+
+            if (timeout < 0 || timeout > msec) timeout = int(msec);
+
+            return;
+        }
+
+        while (!flags[flg_throttled_index].empty()) {
+            int descriptor = flags[flg_throttled_index].back().descriptor;
+
+            rem_flag(descriptor, FLAG::THROTTLED);
+            set_flag(descriptor, FLAG::ACCEPT);
+        }
+    }
+
+    inline long long get_usec() const {
+        struct timespec ts;
+
+        if (kernel->clock_gettime(CLOCK_MONOTONIC, &ts) != 0) return 0;
+
+        return (long long)(ts.tv_sec) * 1000000LL + ts.tv_nsec / 1000;
+    }
+
     inline bool handle_close(int descriptor) {
         bool success = true;
 
+        if (trace) trace->record(TRACE::TYPE::CLOSE, descriptor);
+
+        PROBE1(close, descriptor);
+
         if (has_flag(descriptor, FLAG::RECONNECT)) {
             int family = AF_UNSPEC;
 
@@ -667,10 +1187,16 @@ class SOCKETS {
         record_type *record = find_record(epoll_descriptor);
         epoll_event *events = &(record->events[1]);
 
-        int pending = epoll_pwait(
+        PHASES::PHASE phase = (
+            phases ? phases->enter(PHASES::PHASE::WAIT) : PHASES::PHASE::OTHER
+        );
+
+        int pending = kernel->epoll_pwait(
             epoll_descriptor, events, EPOLL_MAX_EVENTS, timeout, &sigset_none
         );
 
+        if (phases) phases->enter(phase);
+
         if (pending == -1) {
             int code = errno;
 
@@ -704,7 +1230,7 @@ class SOCKETS {
                 socklen_t socket_errlen = sizeof(socket_error);
 
                 if (events[i].events & EPOLLERR) {
-                    int retval = getsockopt(
+                    int retval = kernel->getsockopt(
                         d, SOL_SOCKET, SO_ERROR, (void *) &socket_error,
                         &socket_errlen
                     );
@@ -772,7 +1298,9 @@ class SOCKETS {
             }
 
             if (is_listener(d)) {
-                set_flag(d, FLAG::ACCEPT);
+                // A throttled listener is left alone until its pause is over.
+
+                if (!has_flag(d, FLAG::THROTTLED)) set_flag(d, FLAG::ACCEPT);
             }
             else {
                 if (events[i].events & EPOLLIN) {
@@ -795,12 +1323,16 @@ class SOCKETS {
             ssize_t count;
             char buf[65536];
 
-            count = ::read(descriptor, buf, sizeof(buf));
+            count = kernel->read(descriptor, buf, sizeof(buf));
             if (count < 0) {
                 if (count == -1) {
                     int code = errno;
 
                     if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                        if (trace) {
+                            trace->record(TRACE::TYPE::AGAIN, descriptor, 0);
+                        }
+
                         return true;
                     }
 
@@ -827,7 +1359,22 @@ class SOCKETS {
                 break;
             }
 
+            if (trace) {
+                trace->record(TRACE::TYPE::READ, descriptor, uint64_t(count));
+            }
+
+            PROBE2(read, descriptor, count);
+
+            size_t capacity = record->incoming->capacity();
+
+            reserve(
+                *record->incoming, record->incoming->size() + size_t(count)
+            );
+
             record->incoming->insert(record->incoming->end(), buf, buf+count);
+
+            buffer_total += record->incoming->capacity() - capacity;
+            incoming_total += size_t(count);
             set_flag(descriptor, FLAG::READ);
             set_flag(descriptor, FLAG::INCOMING);
 
@@ -867,7 +1414,7 @@ class SOCKETS {
             size_t buf = length - istart;
             size_t nblock = (buf < 4096 ? buf : 4096);
 
-            nwrite = write(descriptor, bytes+istart, nblock);
+            nwrite = kernel->write(descriptor, bytes+istart, nblock);
 
             if (nwrite < 0) {
                 int code = errno;
@@ -876,6 +1423,10 @@ class SOCKETS {
                     if (code == EAGAIN || code == EWOULDBLOCK) {
                         // Let's start expecting EPOLLOUT.
                         try_again_later = false;
+
+                        if (trace) {
+                            trace->record(TRACE::TYPE::AGAIN, descriptor, 1);
+                        }
                     }
                     else {
                         log(
@@ -892,8 +1443,20 @@ class SOCKETS {
             }
         }
 
+        if (trace && istart > 0) {
+            trace->record(TRACE::TYPE::WRITE, descriptor, istart);
+        }
+
+        roll_rates(*record);
+        record->drained += istart;
+        record->written += istart;
+        outgoing_total -= istart;
+
+        long long usec = istart > 0 ? written_chunks(record) : 0;
+
         if (istart == length) {
             outgoing->clear();
+            record->outgoing_since = 0;
         }
         else if (istart > 0) {
             outgoing->erase(outgoing->begin(), outgoing->begin()+istart);
@@ -903,6 +1466,8 @@ class SOCKETS {
             }
         }
 
+        PROBE3(write, descriptor, istart, usec);
+
         if (try_again_later) {
             return modify_epoll(descriptor, EPOLLIN|EPOLLET|EPOLLRDHUP);
         }
@@ -910,8 +1475,128 @@ class SOCKETS {
         return modify_epoll(descriptor, EPOLLIN|EPOLLOUT|EPOLLET|EPOLLRDHUP);
     }
 
+    inline void account(const record_type &record, bool add) {
+        // Adds the buffers of the given record to the running totals or
+        // takes them away.
+
+        size_t incoming = 0;
+        size_t outgoing = 0;
+        size_t buffers = 0;
+
+        if (record.incoming) {
+            incoming = record.incoming->size();
+            buffers += sizeof(*record.incoming) + record.incoming->capacity();
+        }
+
+        if (record.outgoing) {
+            outgoing = record.outgoing->size();
+            buffers += sizeof(*record.outgoing) + record.outgoing->capacity();
+        }
+
+        if (record.chunks) {
+            buffers += sizeof(*record.chunks) + (
+                record.chunks->capacity() * sizeof(chunk_type)
+            );
+        }
+
+        if (add) {
+            incoming_total += incoming;
+            outgoing_total += outgoing;
+            buffer_total += buffers;
+        }
+        else {
+            incoming_total -= incoming;
+            outgoing_total -= outgoing;
+            buffer_total -= buffers;
+        }
+    }
+
+    inline rates_type rates_of(const record_type &record) const {
+        // Returns the rates of the given record as they would be after rolling
+        // them over to the current period. The bytes queued and drained in a
+        // period that ended before the last one were followed by a period of
+        // no traffic at all.
+
+        rates_type rates{record.growth, record.drain, record.growing_since};
+
+        if (record.period == rates_period) return rates;
+
+        if (record.period + 1 == rates_period) {
+            if (record.queued <= record.drained) rates.growing_since = 0;
+            else if (!record.growing_since) rates.growing_since = rates_before;
+
+            rates.growth = record.queued;
+            rates.drain = record.drained;
+        }
+        else {
+            rates = {0, 0, 0};
+        }
+
+        return rates;
+    }
+
+    inline void roll_rates(record_type &record) const {
+        if (record.period == rates_period) return;
+
+        rates_type rates = rates_of(record);
+
+        record.growth = rates.growth;
+        record.drain = rates.drain;
+        record.growing_since = rates.growing_since;
+        record.queued = 0;
+        record.drained = 0;
+        record.period = rates_period;
+    }
+
+    inline long long written_chunks(record_type *record) {
+        // Records the latency of every forwarded chunk that has now been
+        // written in full and returns that of the oldest one, if any.
+
+        if (!record->chunks) return 0;
+
+        std::vector<chunk_type> &chunks = *record->chunks;
+        size_t &first = record->first_chunk;
+        long long oldest = 0;
+        long long now = 0;
+
+        for (; first < chunks.size(); ++first) {
+            const chunk_type &chunk = chunks[first];
+
+            if (chunk.end > record->written) break;
+
+            if (!now) now = get_usec();
+
+            long long usec = now > chunk.usec ? now - chunk.usec : 0;
+
+            if (usec > oldest) oldest = usec;
+
+            if (latency) latency->record(uint64_t(usec));
+        }
+
+        if (first == chunks.size()) {
+            chunks.clear();
+            first = 0;
+        }
+
+        return oldest;
+    }
+
     inline bool handle_accept(int descriptor) {
-        // New incoming connection detected.
+        // New incoming connection detected. Since there may be thousands of
+        // clients waiting, we keep accepting them in a loop rather than
+        // recursively until we fail to accept any new connections.
+        bool more = true;
+
+        while (more) {
+            if (!accept_client(descriptor, more)) return false;
+        }
+
+        return true;
+    }
+
+    inline bool accept_client(int descriptor, bool &more) {
+        more = false;
+
         record_type *epoll_record = find_epoll_record();
 
         if (!epoll_record) {
@@ -923,14 +1608,18 @@ class SOCKETS {
             return false;
         }
 
+        // The epoll record may share its bucket with the accepted client, in
+        // which case pushing the new record would invalidate the pointer.
         int epoll_descriptor = epoll_record->descriptor;
+        epoll_event *event = &(epoll_record->events[0]);
 
-        struct sockaddr in_addr;
-        socklen_t in_len = sizeof(in_addr);
+        struct sockaddr_storage in_storage;
+        struct sockaddr *in_addr = reinterpret_cast<sockaddr *>(&in_storage);
+        socklen_t in_len = sizeof(in_storage);
 
         int client_descriptor{
-            accept4(
-                descriptor, &in_addr, &in_len, SOCK_CLOEXEC|SOCK_NONBLOCK
+            kernel->accept4(
+                descriptor, in_addr, &in_len, SOCK_CLOEXEC|SOCK_NONBLOCK
             )
         };
 
@@ -943,7 +1632,10 @@ class SOCKETS {
                     case EAGAIN:
 #endif
                     case EWOULDBLOCK: {
-                        // Everything is normal.
+                        // Everything is normal. Having caught up with the
+                        // backlog, the listeners are no longer backing off.
+
+                        accept_backoff = 0;
 
                         return true;
                     }
@@ -971,6 +1663,28 @@ class SOCKETS {
 
                         return true;
                     }
+                    case EMFILE:
+                    case ENFILE:
+                    case ENOBUFS:
+                    case ENOMEM: {
+                        // The process or the system has run out of resources,
+                        // which is no reason to close the listener. Instead,
+                        // it stops accepting for a while.
+
+                        if (accept_backoff == 0) {
+                            log(
+                                logfrom.c_str(),
+                                "accept4: %s, throttling (%s:%d)",
+                                strerror(code), __FILE__, __LINE__
+                            );
+                        }
+
+                        if (code == EMFILE || code == ENFILE) shed(descriptor);
+
+                        throttle(descriptor);
+
+                        return true;
+                    }
                     default: {
                         // These errors are fatal.
 
@@ -1000,13 +1714,45 @@ class SOCKETS {
             return false;
         }
 
+        uint64_t source = 0;
+
+        if (admission
+        && !admission->admit(descriptor, in_addr, get_usec(), source)) {
+            // The client is turned away before anything is allocated for it.
+            // Lingering for no time at all resets the connection instead of
+            // closing it gracefully.
+
+            struct linger linger{1, 0};
+
+            kernel->setsockopt(
+                client_descriptor, SOL_SOCKET, SO_LINGER, &linger,
+                sizeof(linger)
+            );
+            kernel->close(client_descriptor);
+
+            more = true;
+
+            return true;
+        }
+
         push(make_record(client_descriptor, descriptor, 0));
 
+        if (trace) {
+            trace->record(
+                TRACE::TYPE::ACCEPT, client_descriptor, uint64_t(descriptor)
+            );
+        }
+
+        PROBE2(accept, client_descriptor, descriptor);
+
         record_type *client_record = find_record(client_descriptor);
 
+        client_record->source = source;
         client_record->incoming = new (std::nothrow) std::vector<uint8_t>;
         client_record->outgoing = new (std::nothrow) std::vector<uint8_t>;
 
+        account(*client_record, true);
+
         if (!client_record->incoming
         ||  !client_record->outgoing) {
             log(
@@ -1022,7 +1768,7 @@ class SOCKETS {
         }
 
         int retval = getnameinfo(
-            &in_addr, in_len,
+            in_addr, in_len,
             client_record->host.data(), socklen_t(client_record->host.size()),
             client_record->port.data(), socklen_t(client_record->port.size()),
             NI_NUMERICHOST|NI_NUMERICSERV
@@ -1037,13 +1783,18 @@ class SOCKETS {
             client_record->host[0] = '\0';
             client_record->port[0] = '\0';
         }
+        else if (hitters || clients) {
+            const char *host = client_record->host.data();
+            uint64_t hash = HITTERS::hash_of(host);
 
-        epoll_event *event = &(epoll_record->events[0]);
+            if (hitters) hitters->update(hash, host);
+            if (clients) clients->insert(hash);
+        }
 
         event->data.fd = client_descriptor;
         event->events = EPOLLIN|EPOLLET|EPOLLRDHUP;
 
-        retval = epoll_ctl(
+        retval = kernel->epoll_ctl(
             epoll_descriptor, EPOLL_CTL_ADD, client_descriptor, event
         );
 
@@ -1073,11 +1824,12 @@ class SOCKETS {
             set_flag(client_descriptor, FLAG::MAY_SHUTDOWN);
         }
 
-        // We successfully accepted one client, but since there may be more of
-        // them waiting we should recursively retry until we fail to accept any
-        // new connections.
+        // We successfully accepted one client, but there may be more of them
+        // waiting.
 
-        return handle_accept(descriptor);
+        more = true;
+
+        return true;
     }
 
     inline int connect(
@@ -1132,6 +1884,8 @@ class SOCKETS {
         record->incoming = incoming;
         record->outgoing = outgoing;
 
+        account(*record, true);
+
         if (record->host.front() == '\0') {
             strncpy(record->host.data(), host, record->host.size()-1);
             record->host.back() = '\0';
@@ -1185,7 +1939,7 @@ class SOCKETS {
 
         if (descriptor == NO_DESCRIPTOR) return NO_DESCRIPTOR;
 
-        int retval = ::listen(descriptor, SOMAXCONN);
+        int retval = kernel->listen(descriptor, SOMAXCONN);
         if (retval != 0) {
             if (retval == -1) {
                 int code = errno;
@@ -1225,7 +1979,7 @@ class SOCKETS {
     }
 
     inline int create_epoll() {
-        int epoll_descriptor = epoll_create1(0);
+        int epoll_descriptor = kernel->epoll_create1(0);
 
         if (epoll_descriptor < 0) {
             if (epoll_descriptor == -1) {
@@ -1281,7 +2035,9 @@ class SOCKETS {
         event->events = EPOLLIN|EPOLLET|EPOLLRDHUP;
 
         int retval{
-            epoll_ctl(epoll_descriptor, EPOLL_CTL_ADD, descriptor, event)
+            kernel->epoll_ctl(
+                epoll_descriptor, EPOLL_CTL_ADD, descriptor, event
+            )
         };
 
         if (retval != 0) {
@@ -1339,7 +2095,7 @@ class SOCKETS {
         }
 
         for (struct addrinfo *next = info; next; next = next->ai_next) {
-            descriptor = socket(
+            descriptor = kernel->socket(
                 next->ai_family,
                 next->ai_socktype|SOCK_NONBLOCK|SOCK_CLOEXEC,
                 next->ai_protocol
@@ -1360,7 +2116,7 @@ class SOCKETS {
 
             if (host == nullptr) {
                 int optval = 1;
-                retval = setsockopt(
+                retval = kernel->setsockopt(
                     descriptor, SOL_SOCKET, SO_REUSEADDR,
                     (const void *) &optval, sizeof(optval)
                 );
@@ -1383,7 +2139,9 @@ class SOCKETS {
                     }
                 }
                 else {
-                    retval = bind(descriptor, next->ai_addr, next->ai_addrlen);
+                    retval = kernel->bind(
+                        descriptor, next->ai_addr, next->ai_addrlen
+                    );
 
                     if (retval) {
                         if (retval == -1) {
@@ -1428,7 +2186,7 @@ class SOCKETS {
                 else {
                     bool success = false;
 
-                    retval = ::connect(
+                    retval = kernel->connect(
                         descriptor, next->ai_addr, next->ai_addrlen
                     );
 
@@ -1536,7 +2294,7 @@ class SOCKETS {
         }
 
         size_t closed = 0;
-        retval = close(descriptor);
+        retval = kernel->close(descriptor);
 
         if (retval) {
             if (retval == -1) {
@@ -1594,7 +2352,7 @@ class SOCKETS {
                     to_be_closed.begin(),
                     to_be_closed.end(),
                     [&](int d) {
-                        retval = close(d);
+                        retval = kernel->close(d);
 
                         if (retval == -1) {
                             int code = errno;
@@ -1660,6 +2418,7 @@ class SOCKETS {
         };
 
         descriptors[descriptor_key].emplace_back(record);
+        ++record_count;
 
         set_group(descriptor, group);
     }
@@ -1678,6 +2437,10 @@ class SOCKETS {
 
             int parent_descriptor = rec.parent;
 
+            if (admission && parent_descriptor != NO_DESCRIPTOR) {
+                admission->release(parent_descriptor, rec.source);
+            }
+
             // First, let's free the flags.
             for (size_t j=0, fsz=flags.size(); j<fsz; ++j) {
                 rem_flag(rec.descriptor, static_cast<FLAG>(j));
@@ -1688,14 +2451,18 @@ class SOCKETS {
                 delete [] rec.events;
             }
 
+            account(rec, false);
+
             if (rec.incoming) delete rec.incoming;
             if (rec.outgoing) delete rec.outgoing;
+            if (rec.chunks) delete rec.chunks;
 
             rem_group(descriptor);
 
             // Finally, we remove the record.
             descriptors[key_hash][i] = descriptors[key_hash].back();
             descriptors[key_hash].pop_back();
+            --record_count;
 
             return make_record(descriptor, parent_descriptor, 0);
         }
@@ -1761,7 +2528,7 @@ class SOCKETS {
         event->data.fd = descriptor;
         event->events = events;
 
-        int retval = epoll_ctl(
+        int retval = kernel->epoll_ctl(
             epoll_descriptor, EPOLL_CTL_MOD, descriptor, event
         );
 
@@ -1907,7 +2674,28 @@ class SOCKETS {
 
     std::string logfrom;
     void (*log)(const char *, const char *p_fmt, ...);
+    const KERNEL *kernel;
+    HISTOGRAM *latency;
+    TRACE *trace;
+    PHASES *phases;
+    HITTERS *hitters;
+    HYPERLOGLOG *clients;
+    ADMISSION *admission;
     std::unordered_map<int, size_t> groups;
+    std::vector<int> recbuf;
+    int reserve_descriptor;
+    size_t descriptor_limit;
+    long long accept_backoff; // Microseconds, or 0 while accepting normally.
+    long long accept_resume;  // Time when the throttled listeners resume.
+    size_t accept_shed;
+    size_t accept_pauses;
+    uint64_t rates_period;  // Periods of queue rates ended so far.
+    long long rates_since;  // Start of the current period of queue rates.
+    long long rates_before; // Start of the period ended last.
+    size_t incoming_total; // Bytes in the incoming buffers.
+    size_t outgoing_total; // Bytes in the outgoing buffers.
+    size_t buffer_total;   // Bytes reserved for the buffers.
+    size_t record_count;
     std::array<std::vector<record_type>, 1024> descriptors;
     std::array<
         std::vector<flag_type>,
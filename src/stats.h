@@ -0,0 +1,870 @@
+// SPDX-License-Identifier: MIT
+#ifndef STATS_H_17_10_2026
+#define STATS_H_17_10_2026
+
+#include <string>
+#include <vector>
+#include <array>
+#include <cstdio>
+#include <cstdint>
+
+#include "histogram.h"
+#include "hitters.h"
+#include "hyperloglog.h"
+#include "phases.h"
+#include "sampler.h"
+#include "segment.h"
+
+class STATS {
+    public:
+    struct listener_type {
+        uint64_t accepted;
+        uint64_t closed;
+        uint64_t over_total;  // Rejected by the cap of the listener.
+        uint64_t over_source; // Rejected by the cap of a single source.
+        uint64_t over_rate;   // Rejected by the rate of a single source.
+    };
+
+    struct consumer_type {
+        uint64_t detected; // Times a connection went over its queue budget.
+        uint64_t paused;   // Times the peer of a connection was paused.
+        uint64_t dropped;  // Connections disconnected for being slow.
+        uint64_t slow;     // Connections currently over their queue budget.
+    };
+
+    struct queue_type {
+        const char *side;
+        size_t size;
+        size_t growth; // Bytes queued during the last second.
+        size_t drain;  // Bytes written during the last second.
+        double age;    // Seconds since the queue was last empty.
+        std::string peer;
+    };
+
+    static constexpr const size_t TOP_QUEUES = 10;
+    static constexpr const size_t TOP_HOSTS  = 10;
+    static constexpr const size_t PUBLISHED  = 46;
+
+    STATS()
+    : supply          {0, 0, 0, 0, 0}
+    , demand          {0, 0, 0, 0, 0}
+    , driver          {0, 0, 0, 0, 0}
+    , scraper         {0, 0, 0, 0, 0}
+    , pairs           (0)
+    , supply_bytes    (0)
+    , demand_bytes    (0)
+    , supply_chunks   (0)
+    , demand_chunks   (0)
+    , driver_messages (0)
+    , timeouts        (0)
+    , scrapes         (0)
+    , unmet_supply    (0)
+    , unmet_demand    (0)
+    , paired          (0)
+    , incoming_bytes  (0)
+    , outgoing_bytes  (0)
+    , log_dropped     (0)
+    , log_failed      (0)
+    , allocations     (0)
+    , descriptors     (0)
+    , memory_records  (0)
+    , memory_buffers  (0)
+    , memory_flags    (0)
+    , memory_maps     (0)
+    , memory_heap     (0)
+    , descriptor_limit(0)
+    , descriptor_headroom(0)
+    , accept_shed     (0)
+    , accept_pauses   (0)
+    , accept_paused   (0)
+    , admitted_sources(0)
+    , rate_evictions  (0)
+    , slow_supply     {0, 0, 0, 0}
+    , slow_demand     {0, 0, 0, 0} {}
+
+    ~STATS() {}
+
+    // The counters below are updated on the hot path as plain integers. They
+    // are only ever formatted when the statistics are being scraped.
+
+    listener_type supply;
+    listener_type demand;
+    listener_type driver;
+    listener_type scraper;
+    uint64_t pairs;
+    uint64_t supply_bytes; // Bytes forwarded from supply to demand.
+    uint64_t demand_bytes; // Bytes forwarded from demand to supply.
+    uint64_t supply_chunks;
+    uint64_t demand_chunks;
+    uint64_t driver_messages;
+    uint64_t timeouts;
+    uint64_t scrapes;
+
+    // The gauges below are refreshed by the application as it sees fit.
+
+    uint64_t unmet_supply;
+    uint64_t unmet_demand;
+    uint64_t paired;
+    uint64_t incoming_bytes;
+    uint64_t outgoing_bytes;
+    uint64_t log_dropped;
+    uint64_t log_failed;
+    uint64_t allocations;     // Counted only if TCPHERALD_COUNT_ALLOCS.
+
+    // The memory estimates below are derived from the capacities of the
+    // containers and leave out the overhead of the allocator.
+
+    uint64_t descriptors;
+    uint64_t memory_records;
+    uint64_t memory_buffers;
+    uint64_t memory_flags;
+    uint64_t memory_maps;
+    uint64_t memory_heap;     // Bytes in use according to the allocator.
+
+    // When the descriptors run out, the listeners turn the waiting clients
+    // away and stop accepting for a while.
+
+    uint64_t descriptor_limit;
+    uint64_t descriptor_headroom;
+    uint64_t accept_shed;     // Clients closed right after accepting them.
+    uint64_t accept_pauses;   // Times a listener stopped accepting.
+    uint64_t accept_paused;   // Listeners not accepting at the moment.
+    uint64_t admitted_sources;// Sources counted against their caps.
+    uint64_t rate_evictions;  // Token buckets taken over by other sources.
+
+    // Slow consumers are the connections that do not read their outgoing
+    // bytes as fast as their peers send them.
+
+    consumer_type slow_supply;
+    consumer_type slow_demand;
+
+    // The deepest outgoing queues in descending order of their size.
+
+    std::vector<queue_type> top_queues;
+
+    // The histograms below are kept at the resolution of microseconds.
+
+    HISTOGRAM demand_wait;   // From accepting a demand until it is paired.
+    HISTOGRAM supply_wait;   // From accepting a supply until it is paired.
+    HISTOGRAM pair_lifetime; // From pairing until either side disconnects.
+    HISTOGRAM write_latency; // From queueing a chunk until it is written.
+
+    PHASES phases;
+    SAMPLER tcp;
+
+    // The sketches below count the client hosts in bounded memory.
+
+    HITTERS connecting_hosts; // Connections accepted per host.
+    HITTERS forwarding_hosts; // Bytes forwarded from each host.
+    HYPERLOGLOG distinct_hosts;
+
+    void describe(SEGMENT &segment) const {
+        // Adds the fields that are published to the given shared memory
+        // segment in the order of their values in the publish method.
+
+        static constexpr const SEGMENT::KIND C = SEGMENT::KIND::COUNTER;
+        static constexpr const SEGMENT::KIND G = SEGMENT::KIND::GAUGE;
+
+        static constexpr const struct {
+            const char *name;
+            SEGMENT::KIND kind;
+        } fields[]{
+            { "accepted_supply",      C }, { "accepted_demand",      C },
+            { "accepted_driver",      C }, { "accepted_stats",       C },
+            { "closed_supply",        C }, { "closed_demand",        C },
+            { "closed_driver",        C }, { "closed_stats",         C },
+            { "pairs",                C }, { "supply_bytes",         C },
+            { "demand_bytes",         C }, { "supply_chunks",        C },
+            { "demand_chunks",        C }, { "driver_messages",      C },
+            { "timeouts",             C }, { "scrapes",              C },
+            { "slow_supply_detected", C }, { "slow_demand_detected", C },
+            { "slow_supply_dropped",  C }, { "slow_demand_dropped",  C },
+            { "loop_iterations",      C }, { "unmet_supply",         G },
+            { "unmet_demand",         G }, { "paired",               G },
+            { "incoming_bytes",       G }, { "outgoing_bytes",       G },
+            { "slow_supply",          G }, { "slow_demand",          G },
+            { "distinct_hosts",       G }, { "descriptors",          G },
+            { "memory_records",       G }, { "memory_buffers",       G },
+            { "memory_flags",         G }, { "memory_maps",          G },
+            { "memory_heap",          G }, { "allocations",          C },
+            { "descriptor_limit",     G }, { "descriptor_headroom",  G },
+            { "accept_shed",          C }, { "accept_pauses",        C },
+            { "accept_paused",        G }, { "rejected_over_total",  C },
+            { "rejected_over_source", C }, { "admitted_sources",     G },
+            { "rejected_over_rate",   C }, { "rate_evictions",       C }
+        };
+
+        static_assert(
+            sizeof(fields) / sizeof(fields[0]) == PUBLISHED,
+            "fields and values must match"
+        );
+
+        for (const auto &field : fields) {
+            segment.add_field(field.name, field.kind);
+        }
+    }
+
+    void publish(SEGMENT &segment) const {
+        const uint64_t values[]{
+            supply.accepted,      demand.accepted,
+            driver.accepted,      scraper.accepted,
+            supply.closed,        demand.closed,
+            driver.closed,        scraper.closed,
+            pairs,                supply_bytes,
+            demand_bytes,         supply_chunks,
+            demand_chunks,        driver_messages,
+            timeouts,             scrapes,
+            slow_supply.detected, slow_demand.detected,
+            slow_supply.dropped,  slow_demand.dropped,
+            phases.get_iterations(), unmet_supply,
+            unmet_demand,         paired,
+            incoming_bytes,       outgoing_bytes,
+            slow_supply.slow,     slow_demand.slow,
+            distinct_hosts.estimate(), descriptors,
+            memory_records,       memory_buffers,
+            memory_flags,         memory_maps,
+            memory_heap,          allocations,
+            descriptor_limit,     descriptor_headroom,
+            accept_shed,          accept_pauses,
+            accept_paused,
+            supply.over_total + demand.over_total +
+            driver.over_total + scraper.over_total,
+            supply.over_source + demand.over_source +
+            driver.over_source + scraper.over_source,
+            admitted_sources,
+            supply.over_rate + demand.over_rate +
+            driver.over_rate + scraper.over_rate,
+            rate_evictions
+        };
+
+        static_assert(
+            sizeof(values) / sizeof(values[0]) == PUBLISHED,
+            "fields and values must match"
+        );
+
+        segment.begin();
+
+        for (size_t i=0; i<PUBLISHED; ++i) segment.set(i, values[i]);
+
+        segment.end();
+    }
+
+    void render(std::string &out) const {
+        family(
+            out, "tcpherald_accepted_total", "counter",
+            "Connections accepted per listener."
+        );
+        sample(
+            out, "tcpherald_accepted_total", supply.accepted,
+            "listener=\"supply\""
+        );
+        sample(
+            out, "tcpherald_accepted_total", demand.accepted,
+            "listener=\"demand\""
+        );
+        sample(
+            out, "tcpherald_accepted_total", driver.accepted,
+            "listener=\"driver\""
+        );
+        sample(
+            out, "tcpherald_accepted_total", scraper.accepted,
+            "listener=\"stats\""
+        );
+
+        family(
+            out, "tcpherald_closed_total", "counter",
+            "Connections closed per listener."
+        );
+        sample(
+            out, "tcpherald_closed_total", supply.closed,
+            "listener=\"supply\""
+        );
+        sample(
+            out, "tcpherald_closed_total", demand.closed,
+            "listener=\"demand\""
+        );
+        sample(
+            out, "tcpherald_closed_total", driver.closed,
+            "listener=\"driver\""
+        );
+        sample(
+            out, "tcpherald_closed_total", scraper.closed,
+            "listener=\"stats\""
+        );
+
+        family(
+            out, "tcpherald_pairs_total", "counter",
+            "Supply and demand connections joined together."
+        );
+        sample(out, "tcpherald_pairs_total", pairs);
+
+        family(
+            out, "tcpherald_forwarded_bytes_total", "counter",
+            "Bytes forwarded per direction."
+        );
+        sample(
+            out, "tcpherald_forwarded_bytes_total", supply_bytes,
+            "direction=\"supply_to_demand\""
+        );
+        sample(
+            out, "tcpherald_forwarded_bytes_total", demand_bytes,
+            "direction=\"demand_to_supply\""
+        );
+
+        family(
+            out, "tcpherald_forwarded_chunks_total", "counter",
+            "Chunks forwarded per direction."
+        );
+        sample(
+            out, "tcpherald_forwarded_chunks_total", supply_chunks,
+            "direction=\"supply_to_demand\""
+        );
+        sample(
+            out, "tcpherald_forwarded_chunks_total", demand_chunks,
+            "direction=\"demand_to_supply\""
+        );
+
+        family(
+            out, "tcpherald_driver_messages_total", "counter",
+            "Messages sent to the driver clients."
+        );
+        sample(out, "tcpherald_driver_messages_total", driver_messages);
+
+        family(
+            out, "tcpherald_timeouts_total", "counter",
+            "Connections disconnected for being idle."
+        );
+        sample(out, "tcpherald_timeouts_total", timeouts);
+
+        family(
+            out, "tcpherald_scrapes_total", "counter",
+            "Requests served by the statistics port."
+        );
+        sample(out, "tcpherald_scrapes_total", scrapes);
+
+        family(
+            out, "tcpherald_log_lines_dropped_total", "counter",
+            "Log lines dropped because the output could not keep up."
+        );
+        sample(out, "tcpherald_log_lines_dropped_total", log_dropped);
+
+        family(
+            out, "tcpherald_log_lines_failed_total", "counter",
+            "Log lines lost because they failed to be written out."
+        );
+        sample(out, "tcpherald_log_lines_failed_total", log_failed);
+
+        family(
+            out, "tcpherald_allocations_total", "counter",
+            "Heap allocations, if counted by the build."
+        );
+        sample(out, "tcpherald_allocations_total", allocations);
+
+        family(
+            out, "tcpherald_unmet_supply", "gauge",
+            "Supply connections waiting for demand."
+        );
+        sample(out, "tcpherald_unmet_supply", unmet_supply);
+
+        family(
+            out, "tcpherald_unmet_demand", "gauge",
+            "Demand connections waiting for supply."
+        );
+        sample(out, "tcpherald_unmet_demand", unmet_demand);
+
+        family(
+            out, "tcpherald_paired", "gauge",
+            "Supply and demand connections currently joined together."
+        );
+        sample(out, "tcpherald_paired", paired);
+
+        family(
+            out, "tcpherald_buffered_bytes", "gauge",
+            "Bytes waiting in the connection buffers."
+        );
+        sample(
+            out, "tcpherald_buffered_bytes", incoming_bytes,
+            "buffer=\"incoming\""
+        );
+        sample(
+            out, "tcpherald_buffered_bytes", outgoing_bytes,
+            "buffer=\"outgoing\""
+        );
+
+        family(
+            out, "tcpherald_descriptors", "gauge",
+            "Descriptors kept track of, including the listeners."
+        );
+        sample(out, "tcpherald_descriptors", descriptors);
+
+        family(
+            out, "tcpherald_memory_bytes", "gauge",
+            "Estimated memory reserved by the internal structures."
+        );
+        sample(
+            out, "tcpherald_memory_bytes", memory_records, "part=\"records\""
+        );
+        sample(
+            out, "tcpherald_memory_bytes", memory_buffers, "part=\"buffers\""
+        );
+        sample(out, "tcpherald_memory_bytes", memory_flags, "part=\"flags\"");
+        sample(out, "tcpherald_memory_bytes", memory_maps, "part=\"maps\"");
+
+        family(
+            out, "tcpherald_heap_bytes", "gauge",
+            "Heap memory in use according to the allocator, if known."
+        );
+        sample(out, "tcpherald_heap_bytes", memory_heap);
+
+        family(
+            out, "tcpherald_descriptor_limit", "gauge",
+            "Descriptors the process is allowed to open."
+        );
+        sample(out, "tcpherald_descriptor_limit", descriptor_limit);
+
+        family(
+            out, "tcpherald_descriptor_headroom", "gauge",
+            "Descriptors left before the limit, apart from the other files."
+        );
+        sample(out, "tcpherald_descriptor_headroom", descriptor_headroom);
+
+        family(
+            out, "tcpherald_accept_shed_total", "counter",
+            "Clients closed right after accepting them for want of descriptors."
+        );
+        sample(out, "tcpherald_accept_shed_total", accept_shed);
+
+        family(
+            out, "tcpherald_accept_pauses_total", "counter",
+            "Times a listener stopped accepting for want of resources."
+        );
+        sample(out, "tcpherald_accept_pauses_total", accept_pauses);
+
+        family(
+            out, "tcpherald_accept_paused", "gauge",
+            "Listeners not accepting at the moment."
+        );
+        sample(out, "tcpherald_accept_paused", accept_paused);
+
+        family(
+            out, "tcpherald_rejected_total", "counter",
+            "Connections rejected by the admission control per listener."
+        );
+
+        const struct {
+            const char *labels;
+            uint64_t count;
+        } rejected[]{
+            { "listener=\"supply\",cap=\"total\"",  supply.over_total   },
+            { "listener=\"supply\",cap=\"source\"", supply.over_source  },
+            { "listener=\"supply\",cap=\"rate\"",   supply.over_rate    },
+            { "listener=\"demand\",cap=\"total\"",  demand.over_total   },
+            { "listener=\"demand\",cap=\"source\"", demand.over_source  },
+            { "listener=\"demand\",cap=\"rate\"",   demand.over_rate    },
+            { "listener=\"driver\",cap=\"total\"",  driver.over_total   },
+            { "listener=\"driver\",cap=\"source\"", driver.over_source  },
+            { "listener=\"driver\",cap=\"rate\"",   driver.over_rate    },
+            { "listener=\"stats\",cap=\"total\"",   scraper.over_total  },
+            { "listener=\"stats\",cap=\"source\"",  scraper.over_source },
+            { "listener=\"stats\",cap=\"rate\"",    scraper.over_rate   }
+        };
+
+        for (const auto &row : rejected) {
+            sample(out, "tcpherald_rejected_total", row.count, row.labels);
+        }
+
+        family(
+            out, "tcpherald_admitted_sources", "gauge",
+            "Sources counted against their connection caps."
+        );
+        sample(out, "tcpherald_admitted_sources", admitted_sources);
+
+        family(
+            out, "tcpherald_rate_bucket_evictions_total", "counter",
+            "Token buckets of sources taken over by other sources."
+        );
+        sample(out, "tcpherald_rate_bucket_evictions_total", rate_evictions);
+
+        render_consumers(out);
+
+        family(
+            out, "tcpherald_demand_wait_seconds", "histogram",
+            "Time a demand connection waits until it is paired."
+        );
+        histogram(out, "tcpherald_demand_wait_seconds", demand_wait);
+
+        family(
+            out, "tcpherald_supply_wait_seconds", "histogram",
+            "Time a supply connection waits until it is paired."
+        );
+        histogram(out, "tcpherald_supply_wait_seconds", supply_wait);
+
+        family(
+            out, "tcpherald_pair_lifetime_seconds", "histogram",
+            "Time from pairing until either side disconnects."
+        );
+        histogram(out, "tcpherald_pair_lifetime_seconds", pair_lifetime);
+
+        family(
+            out, "tcpherald_write_latency_seconds", "histogram",
+            "Time from queueing a forwarded chunk until all of it is written."
+        );
+        histogram(out, "tcpherald_write_latency_seconds", write_latency);
+
+        render_tcp(out);
+        render_hosts(out);
+
+        family(
+            out, "tcpherald_loop_iterations_total", "counter",
+            "Iterations of the event loop."
+        );
+        sample(out, "tcpherald_loop_iterations_total", phases.get_iterations());
+
+        family(
+            out, "tcpherald_phase_seconds_total", "counter",
+            "Time spent in each phase of the event loop."
+        );
+
+        for (size_t i=0; i<PHASES::COUNT; ++i) {
+            PHASES::PHASE phase = static_cast<PHASES::PHASE>(i);
+
+            sample(
+                out, "tcpherald_phase_seconds_total", phases.get_total(phase),
+                "phase", PHASES::phase_name(phase)
+            );
+        }
+
+        family(
+            out, "tcpherald_phase_max_seconds", "gauge",
+            "Longest time spent in each phase during a single iteration."
+        );
+
+        for (size_t i=0; i<PHASES::COUNT; ++i) {
+            PHASES::PHASE phase = static_cast<PHASES::PHASE>(i);
+
+            sample(
+                out, "tcpherald_phase_max_seconds", phases.get_max(phase),
+                "phase", PHASES::phase_name(phase)
+            );
+        }
+    }
+
+    static void family(
+        std::string &out, const char *name, const char *type, const char *help
+    ) {
+        out.append("# HELP ").append(name).append(" ").append(help);
+        out.append("\n# TYPE ").append(name).append(" ").append(type);
+        out.append("\n");
+    }
+
+    void render_consumers(std::string &out) const {
+        struct {
+            const char *name;
+            const char *type;
+            const char *help;
+            uint64_t consumer_type::*value;
+        } const table[]{
+            {
+                "tcpherald_slow_consumers_total", "counter",
+                "Times a connection went over its outgoing queue budget.",
+                &consumer_type::detected
+            },
+            {
+                "tcpherald_slow_consumer_pauses_total", "counter",
+                "Times the peer of a slow consumer was paused.",
+                &consumer_type::paused
+            },
+            {
+                "tcpherald_slow_consumer_drops_total", "counter",
+                "Slow consumers disconnected.",
+                &consumer_type::dropped
+            },
+            {
+                "tcpherald_slow_consumers", "gauge",
+                "Connections currently over their outgoing queue budget.",
+                &consumer_type::slow
+            }
+        };
+
+        for (const auto &row : table) {
+            family(out, row.name, row.type, row.help);
+            sample(
+                out, row.name, slow_supply.*(row.value), "side=\"supply\""
+            );
+            sample(
+                out, row.name, slow_demand.*(row.value), "side=\"demand\""
+            );
+        }
+
+        if (top_queues.empty()) return;
+
+        family(
+            out, "tcpherald_top_queue_bytes", "gauge",
+            "Deepest outgoing queues of the paired connections."
+        );
+        family(
+            out, "tcpherald_top_queue_growth_bytes", "gauge",
+            "Bytes queued during the last second to the deepest queues."
+        );
+        family(
+            out, "tcpherald_top_queue_drain_bytes", "gauge",
+            "Bytes written during the last second from the deepest queues."
+        );
+        family(
+            out, "tcpherald_top_queue_age_seconds", "gauge",
+            "Time since the deepest queues were last empty."
+        );
+
+        char labels[160];
+        char line[256];
+
+        for (size_t i=0; i<top_queues.size(); ++i) {
+            const queue_type &queue = top_queues[i];
+
+            std::snprintf(
+                labels, sizeof(labels), "rank=\"%lu\",side=\"%s\",peer=\"%s\"",
+                i + 1, queue.side, queue.peer.c_str()
+            );
+
+            sample(out, "tcpherald_top_queue_bytes", queue.size, labels);
+            sample(
+                out, "tcpherald_top_queue_growth_bytes", queue.growth, labels
+            );
+            sample(
+                out, "tcpherald_top_queue_drain_bytes", queue.drain, labels
+            );
+
+            std::snprintf(
+                line, sizeof(line), "%s{%s} %.6f\n",
+                "tcpherald_top_queue_age_seconds", labels, queue.age
+            );
+
+            out.append(line);
+        }
+    }
+
+    void render_hosts(std::string &out) const {
+        family(
+            out, "tcpherald_distinct_hosts", "gauge",
+            "Estimated number of distinct client hosts ever connected."
+        );
+        sample(out, "tcpherald_distinct_hosts", distinct_hosts.estimate());
+
+        struct {
+            const char *name;
+            const char *help;
+            const HITTERS *hitters;
+        } const table[]{
+            {
+                "tcpherald_top_host_connections",
+                "Connections accepted from the most connecting hosts.",
+                &connecting_hosts
+            },
+            {
+                "tcpherald_top_host_bytes",
+                "Bytes forwarded from the most sending hosts.",
+                &forwarding_hosts
+            }
+        };
+
+        std::array<HITTERS::entry_type, TOP_HOSTS> top;
+        char labels[128];
+
+        for (const auto &row : table) {
+            // The counts may overestimate the true values by at most the
+            // error that is exported alongside them.
+
+            size_t count = row.hitters->top(top.data(), top.size());
+
+            if (count == 0) continue;
+
+            std::string error(row.name);
+
+            error.append("_error");
+
+            family(out, row.name, "gauge", row.help);
+            family(
+                out, error.c_str(), "gauge",
+                "Largest possible overestimation of the top host counts."
+            );
+
+            for (size_t i=0; i<count; ++i) {
+                std::snprintf(
+                    labels, sizeof(labels), "rank=\"%lu\",host=\"%s\"",
+                    i + 1, top[i].key.data()
+                );
+
+                sample(out, row.name, top[i].count, labels);
+                sample(out, error.c_str(), top[i].error, labels);
+            }
+        }
+    }
+
+    void render_tcp(std::string &out) const {
+        struct {
+            const char *name;
+            const char *help;
+            HISTOGRAM SAMPLER::side_type::*hist;
+            double unit;
+        } const table[]{
+            {
+                "tcpherald_tcp_rtt_seconds",
+                "Smoothed round-trip time of the sampled connections.",
+                &SAMPLER::side_type::rtt, 1e-6
+            },
+            {
+                "tcpherald_tcp_rttvar_seconds",
+                "Round-trip time variance of the sampled connections.",
+                &SAMPLER::side_type::rttvar, 1e-6
+            },
+            {
+                "tcpherald_tcp_retransmits",
+                "Segments retransmitted in total by the sampled connections.",
+                &SAMPLER::side_type::retransmits, 1.0
+            },
+            {
+                "tcpherald_tcp_cwnd_segments",
+                "Congestion window of the sampled connections.",
+                &SAMPLER::side_type::cwnd, 1.0
+            },
+            {
+                "tcpherald_tcp_delivery_rate_bytes",
+                "Delivery rate per second of the sampled connections.",
+                &SAMPLER::side_type::delivery_rate, 1.0
+            },
+            {
+                "tcpherald_tcp_unacked_segments",
+                "Unacknowledged segments of the sampled connections.",
+                &SAMPLER::side_type::unacked, 1.0
+            }
+        };
+
+        family(
+            out, "tcpherald_tcp_info_samples_total", "counter",
+            "Connections sampled for their TCP_INFO."
+        );
+        sample(
+            out, "tcpherald_tcp_info_samples_total", tcp.supply.samples,
+            "side=\"supply\""
+        );
+        sample(
+            out, "tcpherald_tcp_info_samples_total", tcp.demand.samples,
+            "side=\"demand\""
+        );
+
+        family(
+            out, "tcpherald_tcp_info_failures_total", "counter",
+            "Connections whose TCP_INFO could not be sampled."
+        );
+        sample(
+            out, "tcpherald_tcp_info_failures_total", tcp.supply.failures,
+            "side=\"supply\""
+        );
+        sample(
+            out, "tcpherald_tcp_info_failures_total", tcp.demand.failures,
+            "side=\"demand\""
+        );
+
+        for (const auto &row : table) {
+            family(out, row.name, "histogram", row.help);
+            histogram(
+                out, row.name, tcp.supply.*(row.hist), row.unit,
+                "side=\"supply\""
+            );
+            histogram(
+                out, row.name, tcp.demand.*(row.hist), row.unit,
+                "side=\"demand\""
+            );
+        }
+    }
+
+    static void histogram(
+        std::string &out, const char *name, const HISTOGRAM &hist,
+        double unit =1e-6, const char *labels =nullptr
+    ) {
+        // The buckets are exported just below every power of two up to a
+        // fixed limit, so that the same series exist in every scrape. A power
+        // of two always starts a bucket, so each exported bound is the
+        // highest value of a bucket.
+
+        static constexpr const size_t MAX_BOUND_BIT = 36;
+
+        char line[256];
+        const char *separator = labels && *labels ? "," : "";
+
+        if (!labels) labels = "";
+
+        uint64_t cumulative = 0;
+        size_t index = 0;
+
+        for (size_t bit=0; bit<=MAX_BOUND_BIT; ++bit) {
+            size_t end = HISTOGRAM::index_of((uint64_t(1) << bit) - 1) + 1;
+            uint64_t bound = HISTOGRAM::highest_of(end - 1);
+
+            for (; index<end; ++index) {
+                cumulative += hist.get_bucket(index);
+            }
+
+            std::snprintf(
+                line, sizeof(line), "%s_bucket{%s%sle=\"%.12g\"} %llu\n",
+                name, labels, separator, double(bound) * unit,
+                (unsigned long long) cumulative
+            );
+
+            out.append(line);
+        }
+
+        std::snprintf(
+            line, sizeof(line), "%s_bucket{%s%sle=\"+Inf\"} %llu\n", name,
+            labels, separator, (unsigned long long) hist.get_count()
+        );
+
+        out.append(line);
+
+        const char *open = *labels ? "{" : "";
+        const char *close = *labels ? "}" : "";
+
+        std::snprintf(
+            line, sizeof(line), "%s_sum%s%s%s %.9g\n%s_count%s%s%s %llu\n",
+            name, open, labels, close, double(hist.get_sum()) * unit,
+            name, open, labels, close, (unsigned long long) hist.get_count()
+        );
+
+        out.append(line);
+    }
+
+    static void sample(
+        std::string &out, const char *name, double value,
+        const char *label, const char *label_value
+    ) {
+        char line[256];
+
+        std::snprintf(
+            line, sizeof(line), "%s{%s=\"%s\"} %.9f\n", name, label,
+            label_value, value
+        );
+
+        out.append(line);
+    }
+
+    static void sample(
+        std::string &out, const char *name, uint64_t value,
+        const char *labels =nullptr
+    ) {
+        char number[24];
+
+        std::snprintf(
+            number, sizeof(number), "%llu", (unsigned long long) value
+        );
+
+        out.append(name);
+
+        if (labels && *labels) {
+            out.append("{").append(labels).append("}");
+        }
+
+        out.append(" ").append(number).append("\n");
+    }
+};
+
+#endif
@@ -0,0 +1,304 @@
+// SPDX-License-Identifier: MIT
+// Checks that a tcpherald instance forwards between established pairs without
+// allocating from the heap.
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <getopt.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include "segment.h"
+
+struct settings_type {
+    std::string host;
+    std::string supply_port;
+    std::string demand_port;
+    std::string stats_file;
+    size_t pairs;       // Pairs forwarding at the same time.
+    size_t rounds;      // Measured round trips per pair.
+    size_t warmup;      // Round trips per pair before measuring.
+    size_t max_size;    // Largest chunk in bytes.
+};
+
+struct pair_type {
+    int supply;
+    int demand;
+};
+
+struct counts_type {
+    uint64_t allocations;
+    uint64_t chunks;
+};
+
+static void print_usage(const char *name) {
+    fprintf(
+        stderr,
+        "Usage: %s [options] supply-port demand-port\n"
+        "Options:\n"
+        "  -f  --stats-file    Statistics file of the herald (required).\n"
+        "  -H  --host          Address of the herald (127.0.0.1).\n"
+        "  -h  --help          Display this usage information.\n"
+        "  -n  --pairs         Pairs forwarding at the same time (16).\n"
+        "  -r  --rounds        Measured round trips per pair (2000).\n"
+        "  -s  --size          Largest chunk in bytes (4096).\n"
+        "  -w  --warmup        Round trips per pair before measuring (200).\n"
+        "\n"
+        "The herald has to be built with\n"
+        "make DEFINES=-DTCPHERALD_COUNT_ALLOCS and started with the\n"
+        "stats-file option. The chunks vary in size up to the largest one,\n"
+        "and the check fails if the herald allocates any memory while the\n"
+        "measured round trips are forwarded. Chunks larger than the 4096\n"
+        "byte writes of the herald are slowed down by Nagle's algorithm.\n",
+        name
+    );
+}
+
+static int connect_to(const settings_type &settings, const std::string &port) {
+    struct addrinfo hints{};
+    struct addrinfo *info = nullptr;
+
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    int error = getaddrinfo(
+        settings.host.c_str(), port.c_str(), &hints, &info
+    );
+
+    if (error) {
+        fprintf(stderr, "getaddrinfo: %s\n", gai_strerror(error));
+        return -1;
+    }
+
+    int descriptor = socket(
+        info->ai_family, info->ai_socktype|SOCK_CLOEXEC, info->ai_protocol
+    );
+
+    if (descriptor != -1
+    &&  connect(descriptor, info->ai_addr, info->ai_addrlen) == -1) {
+        fprintf(stderr, "connect: %s\n", strerror(errno));
+        close(descriptor);
+        descriptor = -1;
+    }
+
+    freeaddrinfo(info);
+
+    if (descriptor == -1) return -1;
+
+    int flag = 1;
+
+    setsockopt(descriptor, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+
+    return descriptor;
+}
+
+static bool send_all(int descriptor, const uint8_t *data, size_t size) {
+    while (size) {
+        ssize_t count = write(descriptor, data, size);
+
+        if (count <= 0) {
+            if (count < 0 && errno == EINTR) continue;
+
+            fprintf(stderr, "write: %s\n", strerror(errno));
+            return false;
+        }
+
+        data += count;
+        size -= size_t(count);
+    }
+
+    return true;
+}
+
+static bool receive_all(int descriptor, uint8_t *data, size_t size) {
+    while (size) {
+        ssize_t count = read(descriptor, data, size);
+
+        if (count <= 0) {
+            if (count < 0 && errno == EINTR) continue;
+
+            fprintf(
+                stderr, "read: %s\n", count ? strerror(errno) : "closed"
+            );
+            return false;
+        }
+
+        data += count;
+        size -= size_t(count);
+    }
+
+    return true;
+}
+
+static bool exchange(
+    const settings_type &settings, const std::vector<pair_type> &pairs,
+    size_t rounds, uint32_t &seed, std::vector<uint8_t> &buffer
+) {
+    // Every round sends a chunk from each demand client to its supply agent
+    // and the same number of bytes back.
+
+    for (size_t round=0; round<rounds; ++round) {
+        for (const pair_type &pair : pairs) {
+            seed = seed * 1103515245 + 12345;
+
+            size_t size = 1 + (seed >> 8) % settings.max_size;
+
+            if (!send_all(pair.demand, buffer.data(), size)
+            ||  !receive_all(pair.supply, buffer.data(), size)
+            ||  !send_all(pair.supply, buffer.data(), size)
+            ||  !receive_all(pair.demand, buffer.data(), size)) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+static bool read_counts(
+    const SEGMENT::layout_type *segment, counts_type &counts
+) {
+    // The statistics are published once per second, which is why they are
+    // waited for before they are read.
+
+    SEGMENT::layout_type layout;
+
+    usleep(1100000);
+
+    if (!SEGMENT::read(segment, layout)) return false;
+
+    size_t allocations = SEGMENT::index_of(segment, "allocations");
+    size_t supply = SEGMENT::index_of(segment, "supply_chunks");
+    size_t demand = SEGMENT::index_of(segment, "demand_chunks");
+
+    if (allocations >= SEGMENT::MAX_FIELDS
+    ||  supply >= SEGMENT::MAX_FIELDS || demand >= SEGMENT::MAX_FIELDS) {
+        fprintf(stderr, "the statistics file has no allocation count\n");
+        return false;
+    }
+
+    counts.allocations = layout.values[allocations];
+    counts.chunks = layout.values[supply] + layout.values[demand];
+
+    return true;
+}
+
+int main(int argc, char **argv) {
+    settings_type settings{
+        "127.0.0.1", "", "", "", 16, 2000, 200, 4096
+    };
+
+    static struct option long_options[] = {
+        {"stats-file",  required_argument, 0,        'f' },
+        {"host",        required_argument, 0,        'H' },
+        {"help",        no_argument,       0,        'h' },
+        {"pairs",       required_argument, 0,        'n' },
+        {"rounds",      required_argument, 0,        'r' },
+        {"size",        required_argument, 0,        's' },
+        {"warmup",      required_argument, 0,        'w' },
+        {0,             0,                 0,          0 }
+    };
+
+    int c;
+    while ((c = getopt_long(
+        argc, argv, "f:H:hn:r:s:w:", long_options, nullptr
+    )) != -1) {
+        switch (c) {
+            case 'f': settings.stats_file = optarg; break;
+            case 'H': settings.host = optarg; break;
+            case 'n': settings.pairs = size_t(atol(optarg)); break;
+            case 'r': settings.rounds = size_t(atol(optarg)); break;
+            case 's': settings.max_size = size_t(atol(optarg)); break;
+            case 'w': settings.warmup = size_t(atol(optarg)); break;
+            default : print_usage(argv[0]); return c == 'h' ? 0 : 1;
+        }
+    }
+
+    if (argc - optind != 2 || settings.stats_file.empty()
+    ||  settings.pairs == 0 || settings.rounds == 0
+    ||  settings.max_size == 0) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    settings.supply_port = argv[optind];
+    settings.demand_port = argv[optind + 1];
+
+    const SEGMENT::layout_type *segment = SEGMENT::attach(
+        settings.stats_file.c_str()
+    );
+
+    if (!segment) {
+        fprintf(
+            stderr, "%s: %s\n", settings.stats_file.c_str(), strerror(errno)
+        );
+        return 1;
+    }
+
+    // The pairs are established one at a time, so that every demand client
+    // is known to have been paired with the supply agent that connected
+    // right before it.
+
+    std::vector<pair_type> pairs;
+    std::vector<uint8_t> buffer(settings.max_size, uint8_t('x'));
+    uint32_t seed = 1;
+    bool success = true;
+
+    for (size_t i=0; i<settings.pairs && success; ++i) {
+        pair_type pair{
+            connect_to(settings, settings.supply_port),
+            connect_to(settings, settings.demand_port)
+        };
+
+        pairs.push_back(pair);
+
+        success = pair.supply != -1 && pair.demand != -1 && exchange(
+            settings, std::vector<pair_type>{pair}, 1, seed, buffer
+        );
+    }
+
+    counts_type before{};
+    counts_type after{};
+
+    success = success && exchange(
+        settings, pairs, settings.warmup, seed, buffer
+    ) && read_counts(segment, before) && exchange(
+        settings, pairs, settings.rounds, seed, buffer
+    ) && read_counts(segment, after);
+
+    for (const pair_type &pair : pairs) {
+        if (pair.demand != -1) close(pair.demand);
+        if (pair.supply != -1) close(pair.supply);
+    }
+
+    SEGMENT::detach(segment);
+
+    if (!success) return 1;
+
+    if (before.allocations == 0) {
+        fprintf(
+            stderr, "the herald does not count its allocations, build it with "
+            "make DEFINES=-DTCPHERALD_COUNT_ALLOCS\n"
+        );
+        return 1;
+    }
+
+    uint64_t allocations = after.allocations - before.allocations;
+    uint64_t chunks = after.chunks - before.chunks;
+
+    printf(
+        "Chunks:      %llu forwarded in %zu pairs\n"
+        "Allocations: %llu (%.4f per chunk)\n",
+        (unsigned long long) chunks, pairs.size(),
+        (unsigned long long) allocations,
+        chunks ? double(allocations) / double(chunks) : 0.0
+    );
+
+    return allocations == 0 ? 0 : 1;
+}
@@ -0,0 +1,914 @@
+// SPDX-License-Identifier: MIT
+// Generates supply, demand and driver load against a tcpherald instance.
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cstdarg>
+#include <cerrno>
+#include <csignal>
+#include <deque>
+#include <queue>
+#include <tuple>
+#include <functional>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <getopt.h>
+#include <sys/resource.h>
+
+#include "capture.h"
+#include "histogram.h"
+#include "procstat.h"
+#include "sockets.h"
+
+enum class ROLE : int {
+    NONE   = 0,
+    DEMAND = 1,
+    SUPPLY = 2,
+    DRIVER = 3
+};
+
+struct settings_type {
+    std::string host;
+    std::string supply_port;
+    std::string demand_port;
+    std::string driver_port;
+    size_t clients;       // Demand clients connected at the same time.
+    size_t rounds;        // Requests per pair.
+    size_t request_size;  // Bytes sent by the demand client per request.
+    size_t response_size; // Bytes sent by the supply agent per request.
+    double rate;          // New pairs per second, zero for no limit.
+    unsigned duration;    // Seconds to keep starting new pairs.
+    int pid;              // Process id of the herald, zero if unknown.
+    bool verbose;
+    std::string replay;   // Capture file to replay instead of the mode.
+    double speed;         // Factor by which the replay is accelerated.
+};
+
+struct step_type {
+    long long at;         // Microseconds since the pair began.
+    uint32_t size;
+    bool from_supply;
+};
+
+struct trace_pair_type {
+    long long start;      // Microseconds since the first pair began.
+    long long end;        // Microseconds since the pair began.
+    uint64_t supply_bytes;
+    std::vector<step_type> steps;
+};
+
+struct connection_type {
+    ROLE role;
+    long long since;     // When the connection was established.
+    size_t received;     // Bytes of the current request or response.
+    size_t rounds;       // Responses received or requests answered.
+    size_t owed;         // Bytes still to be queued for sending.
+    bool paired;         // The supply agent has received its first bytes.
+    bool stamped;        // The demand client has queued its first bytes.
+    bool ended;          // The replayed pair has reached its recorded end.
+    size_t pair;         // Index of the replayed pair.
+    size_t step;         // Next step of the replayed pair.
+    long long base;      // When the replay of the pair began.
+    uint64_t serial;     // Tells apart the connections of a descriptor.
+    std::array<uint8_t, 16> header;
+};
+
+struct totals_type {
+    uint64_t pairs;
+    uint64_t failed;
+    uint64_t demand_started;
+    uint64_t supply_started;
+    uint64_t demand_bytes; // Received by the demand clients.
+    uint64_t supply_bytes; // Received by the supply agents.
+    uint64_t driver_messages;
+    HISTOGRAM pairing;     // Microseconds.
+    HISTOGRAM lifetime;    // Microseconds.
+};
+
+static constexpr const size_t CHUNK_SIZE = 64 * 1024;
+static constexpr const size_t GRACE_SECONDS = 5;
+static constexpr const size_t NO_PAIR = size_t(-1);
+static volatile sig_atomic_t interrupted = 0;
+
+static void print_usage(const char *name) {
+    fprintf(
+        stderr,
+        "Usage: %s [options] supply-port demand-port [driver-port]\n"
+        "Options:\n"
+        "  -c  --clients       Concurrent demand clients (100).\n"
+        "  -d  --duration      Seconds to keep starting new pairs (10).\n"
+        "  -H  --host          Address of the herald (127.0.0.1).\n"
+        "  -h  --help          Display this usage information.\n"
+        "  -k  --rounds        Requests per pair.\n"
+        "  -m  --mode          Traffic pattern: rr, bulk or churn (rr).\n"
+        "  -P  --pid           Process id of the herald to measure.\n"
+        "  -q  --request       Request size in bytes.\n"
+        "  -Q  --response      Response size in bytes.\n"
+        "  -r  --rate          New pairs per second, 0 for no limit (0).\n"
+        "  -R  --replay        Replay the pairs of the given capture file.\n"
+        "  -v  --verbose       Print progress once per second.\n"
+        "  -x  --speed         Acceleration of the replay (1).\n"
+        "\n"
+        "Modes:\n"
+        "  rr     10 rounds of 64 byte requests and 1024 byte responses.\n"
+        "  bulk   A single request answered by a 16 MiB stream.\n"
+        "  churn  A single 8 byte request and response per pair.\n"
+        "\n"
+        "Without a driver port, a supply agent is started for every demand\n"
+        "client. Otherwise supply agents are started as the herald asks.\n"
+        "\n"
+        "A replay starts the captured pairs at their recorded times and\n"
+        "sends their chunks in the recorded directions, ignoring the mode,\n"
+        "the sizes, the clients and the rate. It lasts as long as the\n"
+        "capture unless the duration is given.\n",
+        name
+    );
+}
+
+static void print_log(const char *origin, const char *fmt, ...) {
+    va_list ap;
+
+    if (origin && *origin) fprintf(stderr, "%s: ", origin);
+
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+
+    fprintf(stderr, "\n");
+}
+
+static void interrupt(int) {
+    interrupted = 1;
+}
+
+static bool parse_mode(const char *mode, settings_type &settings) {
+    if (!strcmp(mode, "rr")) {
+        settings.rounds = 10;
+        settings.request_size = 64;
+        settings.response_size = 1024;
+    }
+    else if (!strcmp(mode, "bulk")) {
+        settings.rounds = 1;
+        settings.request_size = 8;
+        settings.response_size = 16 * 1024 * 1024;
+    }
+    else if (!strcmp(mode, "churn")) {
+        settings.rounds = 1;
+        settings.request_size = 8;
+        settings.response_size = 8;
+    }
+    else return false;
+
+    return true;
+}
+
+static bool load_trace(const char *path, std::vector<trace_pair_type> &trace) {
+    // The records of the pairs are interleaved in the capture, so the pairs
+    // that are still open are looked up by their sequence numbers. A sequence
+    // number that begins again belongs to a new session of the herald.
+
+    FILE *fp = fopen(path, "rb");
+
+    if (!fp) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    CAPTURE::header_type header;
+    CAPTURE::record_type record;
+    std::unordered_map<uint32_t, size_t> open;
+    long long clock = 0;
+    bool valid = fread(&header, sizeof(header), 1, fp) == 1 && !std::memcmp(
+        header.magic, CAPTURE::MAGIC, sizeof(header.magic)
+    ) && header.version == CAPTURE::VERSION
+      && header.record_size == sizeof(record);
+
+    while (valid && fread(&record, sizeof(record), 1, fp) == 1) {
+        CAPTURE::TYPE type = static_cast<CAPTURE::TYPE>(record.type);
+
+        if (type == CAPTURE::TYPE::BEGIN) {
+            clock += record.delay;
+            open[record.pair] = trace.size();
+            trace.push_back(trace_pair_type{clock, 0, 0, {}});
+            continue;
+        }
+
+        auto found = open.find(record.pair);
+
+        if (found == open.end()) continue;
+
+        trace_pair_type &pair = trace[found->second];
+
+        pair.end += record.delay;
+
+        if (type == CAPTURE::TYPE::SUPPLY || type == CAPTURE::TYPE::DEMAND) {
+            bool from_supply = type == CAPTURE::TYPE::SUPPLY;
+
+            pair.steps.push_back(step_type{pair.end, record.size, from_supply});
+
+            if (from_supply) pair.supply_bytes += record.size;
+        }
+        else if (type == CAPTURE::TYPE::END) open.erase(found);
+    }
+
+    if (!valid) fprintf(stderr, "%s: not a capture file\n", path);
+
+    fclose(fp);
+
+    return valid;
+}
+
+static void raise_file_limit() {
+    struct rlimit limit;
+
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0
+    &&  limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+static void pump(
+    SOCKETS &sockets, std::unordered_map<int, connection_type> &connections,
+    std::unordered_set<int> &owing, std::vector<uint8_t> &chunk
+) {
+    // The bytes owed are queued a chunk at a time whenever the previous chunk
+    // has been mostly sent, so that large streams would not be held in memory.
+
+    for (auto it = owing.begin(); it != owing.end();) {
+        int d = *it;
+        connection_type &connection = connections[d];
+
+        if (sockets.get_outgoing_size(d) < CHUNK_SIZE / 2) {
+            size_t size = std::min(connection.owed, CHUNK_SIZE);
+
+            chunk.assign(size, uint8_t('x'));
+
+            if (connection.role == ROLE::DEMAND && !connection.stamped) {
+                // The first bytes of the first request carry the time when
+                // the demand connection was established.
+
+                std::memcpy(
+                    chunk.data(), &connection.since,
+                    std::min(size, sizeof(connection.since))
+                );
+
+                connection.stamped = true;
+            }
+
+            sockets.append_outgoing(d, chunk);
+            connection.owed -= size;
+        }
+
+        if (connection.owed == 0) it = owing.erase(it);
+        else ++it;
+    }
+}
+
+static void print_histogram(const char *title, const HISTOGRAM &hist) {
+    printf(
+        "%-18s p50 %llu, p90 %llu, p99 %llu, p99.9 %llu, max %llu us\n",
+        title,
+        (unsigned long long) hist.value_at(0.5),
+        (unsigned long long) hist.value_at(0.9),
+        (unsigned long long) hist.value_at(0.99),
+        (unsigned long long) hist.value_at(0.999),
+        (unsigned long long) hist.get_max()
+    );
+}
+
+int main(int argc, char **argv) {
+    settings_type settings{
+        "127.0.0.1", "", "", "", 100, 0, 0, 0, 0.0, 10, 0, false, "", 1.0
+    };
+
+    static struct option long_options[] = {
+        {"clients",     required_argument, 0,        'c' },
+        {"duration",    required_argument, 0,        'd' },
+        {"host",        required_argument, 0,        'H' },
+        {"help",        no_argument,       0,        'h' },
+        {"rounds",      required_argument, 0,        'k' },
+        {"mode",        required_argument, 0,        'm' },
+        {"pid",         required_argument, 0,        'P' },
+        {"request",     required_argument, 0,        'q' },
+        {"response",    required_argument, 0,        'Q' },
+        {"rate",        required_argument, 0,        'r' },
+        {"replay",      required_argument, 0,        'R' },
+        {"verbose",     no_argument,       0,        'v' },
+        {"speed",       required_argument, 0,        'x' },
+        {0,             0,                 0,          0 }
+    };
+
+    // The sizes given explicitly override the ones of the mode regardless of
+    // the order of the options.
+
+    const char *mode = "rr";
+    long rounds = -1;
+    long request_size = -1;
+    long response_size = -1;
+    long duration = -1;
+
+    int c;
+    while ((c = getopt_long(
+        argc, argv, "c:d:H:hk:m:P:q:Q:r:R:vx:", long_options, nullptr
+    )) != -1) {
+        switch (c) {
+            case 'c': settings.clients = size_t(atol(optarg)); break;
+            case 'd': duration = atol(optarg); break;
+            case 'H': settings.host = optarg; break;
+            case 'k': rounds = atol(optarg); break;
+            case 'm': mode = optarg; break;
+            case 'P': settings.pid = atoi(optarg); break;
+            case 'q': request_size = atol(optarg); break;
+            case 'Q': response_size = atol(optarg); break;
+            case 'r': settings.rate = atof(optarg); break;
+            case 'R': settings.replay = optarg; break;
+            case 'v': settings.verbose = true; break;
+            case 'x': settings.speed = atof(optarg); break;
+            default : print_usage(argv[0]); return c == 'h' ? 0 : 1;
+        }
+    }
+
+    if (!parse_mode(mode, settings)) {
+        fprintf(stderr, "invalid mode: %s\n", mode);
+        return 1;
+    }
+
+    if (rounds >= 0) settings.rounds = size_t(rounds);
+    if (request_size >= 0) settings.request_size = size_t(request_size);
+    if (response_size >= 0) settings.response_size = size_t(response_size);
+    if (duration >= 0) settings.duration = unsigned(duration);
+
+    if (argc - optind < 2 || argc - optind > 3
+    ||  settings.clients == 0 || settings.rounds == 0
+    ||  settings.request_size < sizeof(long long)
+    ||  settings.response_size == 0 || !(settings.speed > 0.0)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    std::vector<trace_pair_type> trace;
+    bool replaying = !settings.replay.empty();
+
+    if (replaying) {
+        if (!load_trace(settings.replay.c_str(), trace)) return 1;
+
+        if (trace.empty()) {
+            fprintf(
+                stderr, "%s: no pairs to replay\n", settings.replay.c_str()
+            );
+            return 1;
+        }
+
+        // A replayed pair is complete once its demand client has received
+        // everything that was sent by the supply side of the recorded pair.
+
+        settings.rounds = 1;
+
+        if (duration < 0) {
+            long long length = 0;
+
+            for (const trace_pair_type &pair : trace) {
+                length = std::max(length, pair.start + pair.end);
+            }
+
+            settings.duration = unsigned(
+                double(length) / settings.speed / 1000000.0
+            ) + 1;
+        }
+    }
+
+    settings.supply_port = argv[optind];
+    settings.demand_port = argv[optind + 1];
+
+    if (argc - optind == 3) settings.driver_port = argv[optind + 2];
+
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, interrupt);
+    raise_file_limit();
+
+    SOCKETS sockets(print_log);
+
+    if (!sockets.init()) return 1;
+
+    std::unordered_map<int, connection_type> connections;
+    std::unordered_set<int> owing;
+    std::vector<uint8_t> buffer;
+    std::vector<uint8_t> chunk;
+    totals_type totals{};
+    size_t demand_active = 0;
+    size_t demand_pending = 0;
+    size_t supply_pending = 0;
+    size_t next_pair = 0;
+    uint64_t serial = 0;
+    bool driven = !settings.driver_port.empty();
+
+    // The captured pairs are handed to the demand clients in the order they
+    // were started, and the chunks of the replayed pairs are sent when their
+    // wake-ups come due.
+
+    std::deque<size_t> pending_pairs;
+    std::unordered_set<int> finishing;
+    std::priority_queue<
+        std::tuple<long long, uint64_t, int>,
+        std::vector<std::tuple<long long, uint64_t, int>>,
+        std::greater<std::tuple<long long, uint64_t, int>>
+    > wakes;
+
+    auto schedule = [&](int d, connection_type &connection) {
+        // Skips the chunks of the other side and wakes the connection up when
+        // its next chunk is due, or when the pair has reached its end.
+
+        const trace_pair_type &pair = trace[connection.pair];
+        bool supply = connection.role == ROLE::SUPPLY;
+
+        while (connection.step < pair.steps.size()
+        &&  pair.steps[connection.step].from_supply != supply) {
+            ++connection.step;
+        }
+
+        long long at = connection.step < pair.steps.size() ? (
+            pair.steps[connection.step].at
+        ) : pair.end;
+
+        if (connection.step == pair.steps.size() && supply) return;
+
+        wakes.emplace(
+            connection.base + (long long) (double(at) / settings.speed),
+            connection.serial, d
+        );
+    };
+
+    auto complete = [&](int d, connection_type &connection, long long now) {
+        if (connection.ended && connection.owed == 0 && connection.rounds == 0
+        &&  connection.received >= trace[connection.pair].supply_bytes) {
+            connection.rounds = 1;
+            ++totals.pairs;
+            totals.lifetime.record(uint64_t(now - connection.since));
+            finishing.erase(d);
+            sockets.disconnect(d);
+        }
+    };
+    const char *host = settings.host.c_str();
+
+    if (driven && !sockets.connect(
+        host, settings.driver_port.c_str(), int(ROLE::DRIVER)
+    )) {
+        sockets.deinit();
+        return 1;
+    }
+
+    PROCSTAT::sample_type herald_start{};
+    PROCSTAT::sample_type herald_last{};
+    size_t herald_max_rss = 0;
+    bool measured = settings.pid > 0 && PROCSTAT::sample(
+        settings.pid, herald_start
+    );
+
+    herald_last = herald_start;
+    herald_max_rss = herald_start.rss;
+
+    PROCSTAT::sample_type bench_start{};
+
+    PROCSTAT::sample(getpid(), bench_start);
+
+    long long start = PROCSTAT::get_usec();
+    long long stop = start + (long long) settings.duration * 1000000LL;
+    long long last_report = start;
+    uint64_t last_pairs = 0;
+    bool started_supply = false;
+
+    while (!interrupted) {
+        long long now = PROCSTAT::get_usec();
+
+        if (replaying && now < stop && next_pair < trace.size()) {
+            while (next_pair < trace.size() && (long long) (
+                double(trace[next_pair].start) / settings.speed
+            ) <= now - start) {
+                size_t index = next_pair++;
+
+                if (!sockets.connect(
+                    host, settings.demand_port.c_str(), int(ROLE::DEMAND)
+                )) {
+                    ++totals.failed;
+                    continue;
+                }
+
+                pending_pairs.push_back(index);
+                ++demand_pending;
+                ++totals.demand_started;
+
+                if (!driven) {
+                    if (sockets.connect(
+                        host, settings.supply_port.c_str(), int(ROLE::SUPPLY)
+                    )) {
+                        ++supply_pending;
+                        ++totals.supply_started;
+                    }
+                }
+            }
+        }
+        else if (!replaying && now < stop) {
+            double elapsed = double(now - start) / 1000000.0;
+
+            while (demand_active + demand_pending < settings.clients
+            && (settings.rate <= 0.0
+            ||  double(totals.demand_started) < settings.rate * elapsed)) {
+                if (!sockets.connect(
+                    host, settings.demand_port.c_str(), int(ROLE::DEMAND)
+                )) {
+                    ++totals.failed;
+                    break;
+                }
+
+                ++demand_pending;
+                ++totals.demand_started;
+
+                if (!driven) {
+                    if (sockets.connect(
+                        host, settings.supply_port.c_str(), int(ROLE::SUPPLY)
+                    )) {
+                        ++supply_pending;
+                        ++totals.supply_started;
+                    }
+                }
+            }
+        }
+        else if ((demand_active == 0 && demand_pending == 0
+        &&  (!replaying || now >= stop || next_pair == trace.size()))
+        ||  now > stop + (long long) GRACE_SECONDS * 1000000LL) {
+            break;
+        }
+
+        int timeout = owing.empty() ? 10 : 0;
+
+        if (!wakes.empty() && timeout) {
+            long long wait = (std::get<0>(wakes.top()) - now) / 1000;
+
+            timeout = int(std::max(0LL, std::min(wait, (long long) timeout)));
+        }
+
+        if (!sockets.serve(timeout)) {
+            fprintf(stderr, "failed to serve the sockets\n");
+            break;
+        }
+
+        now = PROCSTAT::get_usec();
+
+        int d;
+
+        while ((d = sockets.next_connection()) != SOCKETS::NO_DESCRIPTOR) {
+            ROLE role = static_cast<ROLE>(sockets.get_group(d));
+            connection_type &connection = connections[d];
+
+            connection = connection_type{
+                role, now, 0, 0, 0, false, false, false, NO_PAIR, 0, now,
+                ++serial, {}
+            };
+
+            if (role == ROLE::DEMAND) {
+                if (demand_pending) --demand_pending;
+
+                ++demand_active;
+
+                if (replaying) {
+                    // The first bytes tell the supply agent when the demand
+                    // client connected and which pair it is to replay.
+
+                    uint64_t index = NO_PAIR;
+
+                    if (!pending_pairs.empty()) {
+                        index = pending_pairs.front();
+                        pending_pairs.pop_front();
+                    }
+
+                    chunk.resize(sizeof(connection.header));
+                    std::memcpy(chunk.data(), &now, sizeof(now));
+                    std::memcpy(chunk.data() + 8, &index, sizeof(index));
+                    sockets.append_outgoing(d, chunk);
+                    connection.stamped = true;
+
+                    if (index != NO_PAIR) {
+                        connection.pair = size_t(index);
+                        schedule(d, connection);
+                    }
+                }
+                else {
+                    connection.owed = settings.request_size;
+                    owing.insert(d);
+                }
+            }
+            else if (role == ROLE::SUPPLY) {
+                if (supply_pending) --supply_pending;
+
+                started_supply = true;
+            }
+        }
+
+        while ((d = sockets.next_disconnection()) != SOCKETS::NO_DESCRIPTOR) {
+            auto found = connections.find(d);
+
+            if (found == connections.end()) continue;
+
+            const connection_type &connection = found->second;
+
+            if (connection.role == ROLE::DEMAND) {
+                --demand_active;
+
+                if (connection.rounds < settings.rounds) ++totals.failed;
+            }
+            else if (connection.role == ROLE::DRIVER) {
+                fprintf(stderr, "the driver connection was closed\n");
+                driven = false;
+            }
+
+            owing.erase(d);
+            finishing.erase(d);
+            connections.erase(found);
+        }
+
+        while ((d = sockets.next_incoming()) != SOCKETS::NO_DESCRIPTOR) {
+            sockets.swap_incoming(d, buffer);
+
+            auto found = connections.find(d);
+
+            if (found == connections.end()) {
+                buffer.clear();
+                continue;
+            }
+
+            connection_type &connection = found->second;
+
+            if (connection.role == ROLE::DRIVER) {
+                // The herald reports the number of demand clients waiting,
+                // one number per line, and every one of them is answered by
+                // starting that many supply agents.
+
+                std::string text(buffer.begin(), buffer.end());
+                size_t begin = 0;
+
+                for (size_t end; (end = text.find('\n', begin))
+                != std::string::npos; begin = end + 1) {
+                    long count = atol(text.substr(begin, end - begin).c_str());
+
+                    ++totals.driver_messages;
+
+                    for (long i=0; i<count; ++i) {
+                        if (sockets.connect(
+                            host, settings.supply_port.c_str(),
+                            int(ROLE::SUPPLY)
+                        )) {
+                            ++supply_pending;
+                            ++totals.supply_started;
+                        }
+                    }
+                }
+
+                // An incomplete line is kept until the rest of it arrives.
+
+                buffer.assign(text.begin() + long(begin), text.end());
+                sockets.swap_incoming(d, buffer);
+                buffer.clear();
+                continue;
+            }
+
+            if (connection.role == ROLE::SUPPLY) {
+                totals.supply_bytes += buffer.size();
+
+                size_t offset = 0;
+
+                if (!connection.paired) {
+                    // The first bytes received tell when the demand client
+                    // that was paired with this supply agent connected.
+
+                    size_t header_size = replaying ? (
+                        sizeof(connection.header)
+                    ) : sizeof(long long);
+                    size_t need = header_size - connection.received;
+                    size_t take = std::min(need, buffer.size());
+
+                    std::memcpy(
+                        connection.header.data() + connection.received,
+                        buffer.data(), take
+                    );
+
+                    connection.received += take;
+                    offset = take;
+
+                    if (connection.received < header_size) {
+                        buffer.clear();
+                        continue;
+                    }
+
+                    long long since;
+
+                    std::memcpy(
+                        &since, connection.header.data(), sizeof(since)
+                    );
+
+                    if (now >= since) {
+                        totals.pairing.record(uint64_t(now - since));
+                    }
+
+                    connection.paired = true;
+
+                    if (replaying) {
+                        connection.received = 0;
+
+                        uint64_t index;
+
+                        std::memcpy(
+                            &index, connection.header.data() + 8,
+                            sizeof(index)
+                        );
+
+                        if (index < trace.size()) {
+                            connection.pair = size_t(index);
+                            connection.base = now;
+                            schedule(d, connection);
+                        }
+                    }
+                }
+
+                connection.received += buffer.size() - offset;
+
+                while (!replaying
+                &&  connection.received >= settings.request_size) {
+                    connection.received -= settings.request_size;
+                    ++connection.rounds;
+                    connection.owed += settings.response_size;
+                    owing.insert(d);
+                }
+            }
+            else if (connection.role == ROLE::DEMAND) {
+                totals.demand_bytes += buffer.size();
+
+                connection.received += buffer.size();
+
+                if (connection.pair != NO_PAIR) {
+                    complete(d, connection, now);
+                }
+
+                while (!replaying
+                &&  connection.received >= settings.response_size
+                &&  connection.rounds < settings.rounds) {
+                    connection.received -= settings.response_size;
+                    ++connection.rounds;
+
+                    if (connection.rounds == settings.rounds) {
+                        ++totals.pairs;
+                        totals.lifetime.record(
+                            uint64_t(now - connection.since)
+                        );
+                        sockets.disconnect(d);
+                    }
+                    else {
+                        connection.owed += settings.request_size;
+                        owing.insert(d);
+                    }
+                }
+            }
+
+            buffer.clear();
+        }
+
+        while (!wakes.empty() && std::get<0>(wakes.top()) <= now) {
+            uint64_t wake_serial = std::get<1>(wakes.top());
+            int wake_descriptor = std::get<2>(wakes.top());
+
+            wakes.pop();
+
+            auto found = connections.find(wake_descriptor);
+
+            if (found == connections.end()
+            ||  found->second.serial != wake_serial) {
+                continue;
+            }
+
+            connection_type &connection = found->second;
+            const trace_pair_type &pair = trace[connection.pair];
+
+            if (connection.step < pair.steps.size()) {
+                connection.owed += pair.steps[connection.step++].size;
+                owing.insert(wake_descriptor);
+                schedule(wake_descriptor, connection);
+            }
+            else {
+                connection.ended = true;
+                finishing.insert(wake_descriptor);
+            }
+        }
+
+        pump(sockets, connections, owing, chunk);
+
+        // The pairs that have ended may still be waiting for their last bytes
+        // to be queued or received.
+
+        for (auto it = finishing.begin(); it != finishing.end();) {
+            int f = *it++;
+
+            complete(f, connections[f], now);
+        }
+
+        if (now - last_report >= 1000000) {
+            PROCSTAT::sample_type sample{};
+
+            if (measured && PROCSTAT::sample(settings.pid, sample)) {
+                herald_max_rss = std::max(herald_max_rss, sample.rss);
+            }
+
+            if (settings.verbose) {
+                printf(
+                    "%6.1f s: %llu pairs/s, %zu active, %zu pending",
+                    double(now - start) / 1000000.0,
+                    (unsigned long long) (totals.pairs - last_pairs),
+                    demand_active, demand_pending
+                );
+
+                if (measured && sample.usec) {
+                    printf(
+                        ", herald %.1f%% CPU, %zu KiB RSS",
+                        PROCSTAT::cpu_share(herald_last, sample) * 100.0,
+                        sample.rss / 1024
+                    );
+
+                    herald_last = sample;
+                }
+
+                printf("\n");
+                fflush(stdout);
+            }
+
+            last_pairs = totals.pairs;
+            last_report = now;
+        }
+    }
+
+    long long end = PROCSTAT::get_usec();
+    double seconds = double(std::max(end - start, 1LL)) / 1000000.0;
+    PROCSTAT::sample_type bench_end{};
+
+    PROCSTAT::sample(getpid(), bench_end);
+
+    printf(
+        "Pairs:             %llu completed, %llu failed, %zu unfinished, "
+        "%.1f/s\n",
+        (unsigned long long) totals.pairs, (unsigned long long) totals.failed,
+        demand_active + demand_pending,
+        double(totals.pairs) / seconds
+    );
+
+    printf(
+        "Connections:       %llu demand, %llu supply, %zu supply open\n",
+        (unsigned long long) totals.demand_started,
+        (unsigned long long) totals.supply_started,
+        connections.size() - demand_active - (driven ? 1 : 0)
+    );
+
+    if (!settings.driver_port.empty()) {
+        printf(
+            "Driver messages:   %llu\n",
+            (unsigned long long) totals.driver_messages
+        );
+    }
+
+    printf(
+        "Throughput:        %.2f MiB/s (%.2f MiB to demand, %.2f MiB to "
+        "supply)\n",
+        double(totals.demand_bytes + totals.supply_bytes) / seconds / 1048576.0,
+        double(totals.demand_bytes) / 1048576.0,
+        double(totals.supply_bytes) / 1048576.0
+    );
+
+    print_histogram("Pairing latency:", totals.pairing);
+    print_histogram("Pair lifetime:", totals.lifetime);
+
+    if (measured) {
+        PROCSTAT::sample_type herald_end{};
+
+        if (PROCSTAT::sample(settings.pid, herald_end)) {
+            herald_max_rss = std::max(herald_max_rss, herald_end.rss);
+
+            printf(
+                "Herald:            %.1f%% CPU, %zu KiB RSS (max %zu KiB)\n",
+                PROCSTAT::cpu_share(herald_start, herald_end) * 100.0,
+                herald_end.rss / 1024, herald_max_rss / 1024
+            );
+        }
+    }
+
+    printf(
+        "Bench:             %.1f%% CPU\n",
+        PROCSTAT::cpu_share(bench_start, bench_end) * 100.0
+    );
+
+    if (!started_supply && totals.demand_started) {
+        fprintf(stderr, "no supply agent could connect\n");
+    }
+
+    sockets.deinit();
+
+    return totals.pairs ? 0 : 1;
+}
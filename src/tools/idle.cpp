@@ -0,0 +1,506 @@
+// SPDX-License-Identifier: MIT
+// Measures what idle connections waiting in a tcpherald instance cost.
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <csignal>
+#include <string>
+#include <vector>
+#include <getopt.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+#include "procstat.h"
+#include "segment.h"
+
+struct settings_type {
+    std::string host;
+    std::string port;
+    std::string stats_file;
+    size_t count;       // Connections to open.
+    size_t addresses;   // Loopback source addresses, zero for automatic.
+    size_t pending;     // Connections being established at the same time.
+    unsigned idle;      // Seconds to measure the idle instance.
+    int pid;
+    bool json;
+    bool verbose;
+};
+
+struct snapshot_type {
+    PROCSTAT::sample_type process;
+    SEGMENT::layout_type values;
+    bool has_values;
+};
+
+static constexpr const size_t PORTS_PER_ADDRESS = 28000;
+static constexpr const uint32_t FIRST_ADDRESS = 0x7f010001; // 127.1.0.1
+
+static const char *const breakdown[]{
+    "memory_records", "memory_buffers", "memory_flags", "memory_maps"
+};
+
+static volatile sig_atomic_t interrupted = 0;
+
+static void print_usage(const char *name) {
+    fprintf(
+        stderr,
+        "Usage: %s [options] port\n"
+        "Options:\n"
+        "  -a  --addresses     Loopback source addresses (automatic).\n"
+        "  -c  --pending       Connections being established at once (1000).\n"
+        "  -f  --stats-file    Statistics file of the herald for a breakdown.\n"
+        "  -H  --host          IPv4 address of the herald (127.0.0.1).\n"
+        "  -h  --help          Display this usage information.\n"
+        "  -i  --idle          Seconds to measure the idle herald (5).\n"
+        "  -j  --json          Print the results as a JSON object.\n"
+        "  -n  --count         Connections to open (100000).\n"
+        "  -P  --pid           Process id of the herald.\n"
+        "  -v  --verbose       Print progress once per second.\n"
+        "\n"
+        "The herald should be started with --timeout 0 so that it would not\n"
+        "disconnect the idle connections, and with a sufficient limit of open\n"
+        "files (ulimit -n).\n",
+        name
+    );
+}
+
+static void interrupt(int) {
+    interrupted = 1;
+}
+
+static bool raise_file_limit(size_t needed) {
+    struct rlimit limit;
+
+    if (getrlimit(RLIMIT_NOFILE, &limit) != 0) return false;
+
+    if (limit.rlim_max < needed) {
+        // Only a privileged process can raise the hard limit.
+
+        limit.rlim_max = needed;
+    }
+
+    limit.rlim_cur = limit.rlim_max;
+
+    if (setrlimit(RLIMIT_NOFILE, &limit) == 0) return true;
+
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+
+    return limit.rlim_cur >= needed;
+}
+
+static uint64_t value_of(
+    const SEGMENT::layout_type *segment, const snapshot_type &snapshot,
+    const char *name
+) {
+    // The fields are named in the mapped segment while the snapshot only
+    // holds the values, in the same order.
+
+    if (!segment || !snapshot.has_values) return 0;
+
+    size_t index = SEGMENT::index_of(segment, name);
+
+    return index < SEGMENT::MAX_FIELDS ? snapshot.values.values[index] : 0;
+}
+
+static void take_snapshot(
+    const settings_type &settings, const SEGMENT::layout_type *segment,
+    snapshot_type &snapshot
+) {
+    snapshot.process = {};
+    snapshot.has_values = false;
+
+    if (settings.pid > 0) PROCSTAT::sample(settings.pid, snapshot.process);
+
+    if (segment) snapshot.has_values = SEGMENT::read(segment, snapshot.values);
+}
+
+static size_t ramp_up(
+    const settings_type &settings, const struct sockaddr_in &target,
+    std::vector<int> &descriptors, size_t &failed
+) {
+    // Opens the connections while keeping a limited number of them being
+    // established at once, so that the accept queue of the herald would not
+    // overflow. Returns the number of connections opened.
+
+    int epoll = epoll_create1(EPOLL_CLOEXEC);
+
+    if (epoll == -1) {
+        fprintf(stderr, "epoll_create1: %s\n", strerror(errno));
+        return 0;
+    }
+
+    std::vector<struct epoll_event> events(1024);
+    size_t started = 0;
+    size_t pending = 0;
+    size_t goal = settings.count;
+    long long last_report = PROCSTAT::get_usec();
+
+    while (!interrupted && (started < goal || pending)) {
+        while (started < goal && pending < settings.pending) {
+            int d = socket(
+                AF_INET, SOCK_STREAM|SOCK_NONBLOCK|SOCK_CLOEXEC, 0
+            );
+
+            if (d == -1) {
+                fprintf(stderr, "socket: %s\n", strerror(errno));
+                goal = started;
+                break;
+            }
+
+            // The port is only chosen upon connecting, which lets every
+            // source address use the whole range of ephemeral ports.
+
+            int flag = 1;
+            struct sockaddr_in source{};
+
+            setsockopt(
+                d, IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT, &flag, sizeof(flag)
+            );
+
+            source.sin_family = AF_INET;
+            source.sin_addr.s_addr = htonl(
+                FIRST_ADDRESS + uint32_t(started % settings.addresses)
+            );
+
+            ++started;
+
+            if (bind(d, (struct sockaddr *) &source, sizeof(source)) == -1) {
+                fprintf(stderr, "bind: %s\n", strerror(errno));
+                close(d);
+                ++failed;
+                continue;
+            }
+
+            if (connect(
+                d, (const struct sockaddr *) &target, sizeof(target)
+            ) == 0) {
+                descriptors.push_back(d);
+                continue;
+            }
+
+            if (errno != EINPROGRESS) {
+                close(d);
+                ++failed;
+                continue;
+            }
+
+            struct epoll_event event{};
+
+            event.events = EPOLLOUT;
+            event.data.fd = d;
+
+            if (epoll_ctl(epoll, EPOLL_CTL_ADD, d, &event) == -1) {
+                close(d);
+                ++failed;
+                continue;
+            }
+
+            ++pending;
+        }
+
+        int count = epoll_wait(epoll, events.data(), int(events.size()), 100);
+
+        for (int i=0; i<count; ++i) {
+            int d = events[i].data.fd;
+            int error = 0;
+            socklen_t length = sizeof(error);
+
+            getsockopt(d, SOL_SOCKET, SO_ERROR, &error, &length);
+            epoll_ctl(epoll, EPOLL_CTL_DEL, d, nullptr);
+            --pending;
+
+            if (error == 0) descriptors.push_back(d);
+            else {
+                close(d);
+                ++failed;
+            }
+        }
+
+        long long now = PROCSTAT::get_usec();
+
+        if (settings.verbose && now - last_report >= 1000000) {
+            fprintf(
+                stderr, "%zu opened, %zu failed, %zu pending\n",
+                descriptors.size(), failed, pending
+            );
+
+            last_report = now;
+        }
+    }
+
+    close(epoll);
+
+    return descriptors.size();
+}
+
+static int run(
+    const settings_type &settings, const struct sockaddr_in &target,
+    const SEGMENT::layout_type *segment
+) {
+    std::vector<int> descriptors;
+    snapshot_type before;
+    snapshot_type ramped;
+    snapshot_type idle;
+    size_t failed = 0;
+
+    descriptors.reserve(settings.count);
+    take_snapshot(settings, segment, before);
+
+    long long start = PROCSTAT::get_usec();
+    size_t opened = ramp_up(settings, target, descriptors, failed);
+    long long end = PROCSTAT::get_usec();
+
+    if (opened == 0) {
+        fprintf(stderr, "no connections could be opened\n");
+        return 1;
+    }
+
+    // The herald may still be accepting the connections. Its statistics are
+    // published once per second, which is why they are waited for.
+
+    uint64_t expected = value_of(segment, before, "descriptors") + opened;
+
+    for (size_t i=0; segment && i<30 && !interrupted; ++i) {
+        take_snapshot(settings, segment, ramped);
+
+        if (value_of(segment, ramped, "descriptors") >= expected) break;
+
+        usleep(500000);
+    }
+
+    long long accepted = PROCSTAT::get_usec();
+
+    usleep(1100000);
+    take_snapshot(settings, segment, ramped);
+
+    for (unsigned i=0; i<settings.idle && !interrupted; ++i) sleep(1);
+
+    take_snapshot(settings, segment, idle);
+
+    double per_connection = 1.0 / double(opened);
+    double ramp_seconds = double(end - start) / 1000000.0;
+    double accept_seconds = double(accepted - start) / 1000000.0;
+    double cpu_per_accept = 0.0;
+    double rss_per_connection = 0.0;
+    double idle_cpu = 0.0;
+    double idle_iterations = 0.0;
+    bool measured = settings.pid > 0 && ramped.process.usec != 0;
+
+    if (measured) {
+        cpu_per_accept = double(
+            ramped.process.cpu_ticks - before.process.cpu_ticks
+        ) / double(sysconf(_SC_CLK_TCK)) * per_connection;
+
+        rss_per_connection = (
+            double(ramped.process.rss) - double(before.process.rss)
+        ) * per_connection;
+
+        idle_cpu = PROCSTAT::cpu_share(ramped.process, idle.process);
+    }
+
+    if (segment && idle.process.usec > ramped.process.usec) {
+        idle_iterations = double(
+            value_of(segment, idle, "loop_iterations") -
+            value_of(segment, ramped, "loop_iterations")
+        ) * 1000000.0 / double(idle.process.usec - ramped.process.usec);
+    }
+
+    double parts[sizeof(breakdown) / sizeof(breakdown[0])]{};
+    double other = rss_per_connection;
+
+    for (size_t i=0; segment && i<sizeof(parts) / sizeof(parts[0]); ++i) {
+        parts[i] = (
+            double(value_of(segment, ramped, breakdown[i])) -
+            double(value_of(segment, before, breakdown[i]))
+        ) * per_connection;
+
+        other -= parts[i];
+    }
+
+    if (settings.json) {
+        printf(
+            "{\"connections\":%zu,\"failed\":%zu,\"addresses\":%zu,"
+            "\"ramp_seconds\":%.3f,\"accept_seconds\":%.3f,"
+            "\"usec_per_connection\":%.3f",
+            opened, failed, settings.addresses, ramp_seconds, accept_seconds,
+            accept_seconds * 1000000.0 * per_connection
+        );
+
+        if (measured) {
+            printf(
+                ",\"cpu_usec_per_accept\":%.3f,\"rss_bytes\":%zu,"
+                "\"rss_bytes_per_connection\":%.1f,\"idle_cpu\":%.5f",
+                cpu_per_accept * 1000000.0, ramped.process.rss,
+                rss_per_connection, idle_cpu
+            );
+        }
+
+        if (segment) {
+            printf(
+                ",\"idle_loop_iterations_per_second\":%.2f,"
+                "\"bytes_per_connection\":{", idle_iterations
+            );
+
+            for (size_t i=0; i<sizeof(parts) / sizeof(parts[0]); ++i) {
+                printf(
+                    "%s\"%s\":%.1f", i ? "," : "", breakdown[i] + 7, parts[i]
+                );
+            }
+
+            if (measured) printf(",\"other\":%.1f", other);
+
+            printf("}");
+        }
+
+        printf("}\n");
+    }
+    else {
+        printf(
+            "Connections:       %zu opened, %zu failed, %zu source "
+            "address%s\n", opened, failed, settings.addresses,
+            settings.addresses == 1 ? "" : "es"
+        );
+        printf(
+            "Ramp:              %.2f s, %.1f us per connection\n",
+            accept_seconds, accept_seconds * 1000000.0 * per_connection
+        );
+
+        if (measured) {
+            printf(
+                "Herald CPU:        %.2f us per accept, %.3f%% while idle\n",
+                cpu_per_accept * 1000000.0, idle_cpu * 100.0
+            );
+            printf(
+                "Herald RSS:        %zu KiB, %.1f bytes per connection\n",
+                ramped.process.rss / 1024, rss_per_connection
+            );
+        }
+
+        if (segment) {
+            for (size_t i=0; i<sizeof(parts) / sizeof(parts[0]); ++i) {
+                printf(
+                    "  %-17s%8.1f bytes per connection\n", breakdown[i] + 7,
+                    parts[i]
+                );
+            }
+
+            if (measured) {
+                printf(
+                    "  %-17s%8.1f bytes per connection\n", "other", other
+                );
+            }
+
+            printf(
+                "Idle loop:         %.2f iterations per second\n",
+                idle_iterations
+            );
+        }
+    }
+
+    for (int d : descriptors) close(d);
+
+    if (segment) SEGMENT::detach(segment);
+
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    settings_type settings{
+        "127.0.0.1", "", "", 100000, 0, 1000, 5, 0, false, false
+    };
+
+    static struct option long_options[] = {
+        {"addresses",   required_argument, 0,        'a' },
+        {"pending",     required_argument, 0,        'c' },
+        {"stats-file",  required_argument, 0,        'f' },
+        {"host",        required_argument, 0,        'H' },
+        {"help",        no_argument,       0,        'h' },
+        {"idle",        required_argument, 0,        'i' },
+        {"json",        no_argument,       0,        'j' },
+        {"count",       required_argument, 0,        'n' },
+        {"pid",         required_argument, 0,        'P' },
+        {"verbose",     no_argument,       0,        'v' },
+        {0,             0,                 0,          0 }
+    };
+
+    int c;
+    while ((c = getopt_long(
+        argc, argv, "a:c:f:H:hi:jn:P:v", long_options, nullptr
+    )) != -1) {
+        switch (c) {
+            case 'a': settings.addresses = size_t(atol(optarg)); break;
+            case 'c': settings.pending = size_t(atol(optarg)); break;
+            case 'f': settings.stats_file = optarg; break;
+            case 'H': settings.host = optarg; break;
+            case 'i': settings.idle = unsigned(atoi(optarg)); break;
+            case 'j': settings.json = true; break;
+            case 'n': settings.count = size_t(atol(optarg)); break;
+            case 'P': settings.pid = atoi(optarg); break;
+            case 'v': settings.verbose = true; break;
+            default : print_usage(argv[0]); return c == 'h' ? 0 : 1;
+        }
+    }
+
+    if (argc - optind != 1 || settings.count == 0 || settings.pending == 0) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    settings.port = argv[optind];
+
+    struct sockaddr_in target{};
+
+    target.sin_family = AF_INET;
+    target.sin_port = htons(uint16_t(atoi(settings.port.c_str())));
+
+    if (inet_pton(AF_INET, settings.host.c_str(), &target.sin_addr) != 1) {
+        fprintf(stderr, "invalid IPv4 address: %s\n", settings.host.c_str());
+        return 1;
+    }
+
+    if (settings.addresses == 0) {
+        // Every source address can connect to the same destination from a
+        // limited range of ephemeral ports.
+
+        settings.addresses = (
+            settings.count + PORTS_PER_ADDRESS - 1
+        ) / PORTS_PER_ADDRESS;
+    }
+
+    if (!raise_file_limit(settings.count + 64)) {
+        struct rlimit limit;
+
+        getrlimit(RLIMIT_NOFILE, &limit);
+
+        fprintf(
+            stderr, "the limit of open files is %llu, fewer connections than "
+            "asked for can be opened\n", (unsigned long long) limit.rlim_cur
+        );
+    }
+
+    signal(SIGINT, interrupt);
+
+    const SEGMENT::layout_type *segment = nullptr;
+
+    if (!settings.stats_file.empty()) {
+        segment = SEGMENT::attach(settings.stats_file.c_str());
+
+        if (!segment) {
+            fprintf(
+                stderr, "%s: %s\n", settings.stats_file.c_str(),
+                errno == EPROTO ? "not a statistics file" : strerror(errno)
+            );
+            return 1;
+        }
+    }
+
+    return run(settings, target, segment);
+}
@@ -0,0 +1,219 @@
+// SPDX-License-Identifier: MIT
+// Summarizes the pair accounting journal written by tcpherald --journal.
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <getopt.h>
+
+#include "histogram.h"
+#include "journal.h"
+
+struct host_type {
+    uint64_t pairs;
+    uint64_t bytes;
+};
+
+static void print_usage(const char *name) {
+    fprintf(
+        stderr,
+        "Usage: %s [options] journal-file\n"
+        "Options:\n"
+        "  -h  --help          Display this usage information.\n"
+        "  -l  --list          List every entry as tab separated values.\n"
+        "  -n  --top           Number of busiest hosts to show (10).\n",
+        name
+    );
+}
+
+static void print_top(
+    const char *title, const std::unordered_map<std::string, host_type> &hosts,
+    size_t top
+) {
+    std::vector<std::pair<std::string, host_type>> sorted(
+        hosts.begin(), hosts.end()
+    );
+
+    std::sort(
+        sorted.begin(), sorted.end(),
+        [](const std::pair<std::string, host_type> &a,
+           const std::pair<std::string, host_type> &b) {
+            return a.second.bytes > b.second.bytes;
+        }
+    );
+
+    printf("%s:\n", title);
+
+    for (size_t i=0; i<sorted.size() && i<top; ++i) {
+        printf(
+            "  %-46s %10llu pairs %16llu bytes\n", sorted[i].first.c_str(),
+            (unsigned long long) sorted[i].second.pairs,
+            (unsigned long long) sorted[i].second.bytes
+        );
+    }
+}
+
+static void print_histogram(const char *title, const HISTOGRAM &hist) {
+    printf(
+        "%-16s p50 %llu, p90 %llu, p99 %llu, max %llu\n", title,
+        (unsigned long long) hist.value_at(0.5),
+        (unsigned long long) hist.value_at(0.9),
+        (unsigned long long) hist.value_at(0.99),
+        (unsigned long long) hist.get_max()
+    );
+}
+
+int main(int argc, char **argv) {
+    bool list = false;
+    size_t top = 10;
+
+    static struct option long_options[] = {
+        {"help",        no_argument,       0,        'h' },
+        {"list",        no_argument,       0,        'l' },
+        {"top",         required_argument, 0,        'n' },
+        {0,             0,                 0,          0 }
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, "hln:", long_options, nullptr)) != -1) {
+        switch (c) {
+            case 'l': list = true; break;
+            case 'n': top = size_t(std::max(atoi(optarg), 0)); break;
+            default : print_usage(argv[0]); return c == 'h' ? 0 : 1;
+        }
+    }
+
+    if (optind >= argc) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    const char *path = argv[optind];
+    FILE *fp = fopen(path, "rb");
+
+    if (!fp) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return 1;
+    }
+
+    JOURNAL::header_type header;
+
+    if (fread(&header, sizeof(header), 1, fp) != 1
+    ||  memcmp(header.magic, JOURNAL::MAGIC, sizeof(header.magic))
+    ||  header.version != JOURNAL::VERSION
+    ||  header.entry_size != sizeof(JOURNAL::entry_type)) {
+        fprintf(stderr, "%s: not a journal of version %u\n", path,
+            unsigned(JOURNAL::VERSION)
+        );
+        fclose(fp);
+        return 1;
+    }
+
+    static constexpr const size_t reasons{
+        static_cast<size_t>(JOURNAL::REASON::MAX_REASONS)
+    };
+
+    uint64_t pairs = 0;
+    uint64_t supply_bytes = 0;
+    uint64_t demand_bytes = 0;
+    uint64_t supply_chunks = 0;
+    uint64_t demand_chunks = 0;
+    uint64_t first = 0;
+    uint64_t last = 0;
+    uint64_t reason_count[reasons] = {};
+    HISTOGRAM lifetime;
+    HISTOGRAM volume;
+    std::unordered_map<std::string, host_type> supply_hosts;
+    std::unordered_map<std::string, host_type> demand_hosts;
+
+    if (list) {
+        printf(
+            "start\tend\tsupply\tdemand\tsupply_bytes\tdemand_bytes\t"
+            "supply_chunks\tdemand_chunks\treason\n"
+        );
+    }
+
+    JOURNAL::entry_type entry;
+
+    while (fread(&entry, sizeof(entry), 1, fp) == 1) {
+        entry.supply_host[sizeof(entry.supply_host) - 1] = '\0';
+        entry.demand_host[sizeof(entry.demand_host) - 1] = '\0';
+
+        uint64_t bytes = entry.supply_bytes + entry.demand_bytes;
+        uint64_t duration = entry.end > entry.start ? entry.end - entry.start : 0;
+
+        ++pairs;
+        supply_bytes += entry.supply_bytes;
+        demand_bytes += entry.demand_bytes;
+        supply_chunks += entry.supply_chunks;
+        demand_chunks += entry.demand_chunks;
+
+        if (!first || entry.start < first) first = entry.start;
+        if (entry.end > last) last = entry.end;
+
+        ++reason_count[entry.reason < reasons ? entry.reason : 0];
+
+        lifetime.record(duration / 1000);
+        volume.record(bytes);
+
+        host_type &supply = supply_hosts[entry.supply_host];
+        host_type &demand = demand_hosts[entry.demand_host];
+
+        ++supply.pairs;
+        supply.bytes += bytes;
+        ++demand.pairs;
+        demand.bytes += bytes;
+
+        if (list) {
+            printf(
+                "%llu\t%llu\t%s:%u\t%s:%u\t%llu\t%llu\t%llu\t%llu\t%s\n",
+                (unsigned long long) entry.start,
+                (unsigned long long) entry.end,
+                entry.supply_host, unsigned(entry.supply_port),
+                entry.demand_host, unsigned(entry.demand_port),
+                (unsigned long long) entry.supply_bytes,
+                (unsigned long long) entry.demand_bytes,
+                (unsigned long long) entry.supply_chunks,
+                (unsigned long long) entry.demand_chunks,
+                JOURNAL::reason_name(entry.reason)
+            );
+        }
+    }
+
+    fclose(fp);
+
+    if (list) return 0;
+
+    printf("Pairs:           %llu\n", (unsigned long long) pairs);
+    printf(
+        "Period:          %.3f seconds\n",
+        last > first ? double(last - first) / 1000000.0 : 0.0
+    );
+    printf(
+        "Supply to demand %llu bytes in %llu chunks\n",
+        (unsigned long long) supply_bytes, (unsigned long long) supply_chunks
+    );
+    printf(
+        "Demand to supply %llu bytes in %llu chunks\n",
+        (unsigned long long) demand_bytes, (unsigned long long) demand_chunks
+    );
+    printf("Closed by:      ");
+
+    for (size_t i=1; i<reasons; ++i) {
+        printf(
+            " %s %llu", JOURNAL::reason_name(uint8_t(i)),
+            (unsigned long long) reason_count[i]
+        );
+    }
+
+    printf("\n");
+    print_histogram("Lifetime (ms):", lifetime);
+    print_histogram("Volume (bytes):", volume);
+    print_top("Busiest supply hosts", supply_hosts, top);
+    print_top("Busiest demand hosts", demand_hosts, top);
+
+    return 0;
+}
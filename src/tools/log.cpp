@@ -0,0 +1,504 @@
+// SPDX-License-Identifier: MIT
+// Renders the binary log written by tcpherald --binary-log as text or JSON.
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <getopt.h>
+
+#include "binlog.h"
+
+struct format_type {
+    std::string origin;
+    std::string format;
+    std::vector<BINLOG::ARG> args;
+};
+
+struct arg_type {
+    BINLOG::ARG type;
+    uint64_t value;
+    std::string text;
+};
+
+static void print_usage(const char *name) {
+    fprintf(
+        stderr,
+        "Usage: %s [options] log-file [log-file ...]\n"
+        "Options:\n"
+        "  -h  --help          Display this usage information.\n"
+        "  -j  --json          Print every line as a JSON object.\n"
+        "\n"
+        "Rotated files are to be given from the oldest to the newest.\n",
+        name
+    );
+}
+
+static std::string format_time(uint64_t usec, bool iso) {
+    time_t seconds = time_t(usec / 1000000);
+    struct tm tm_time;
+    char text[64] = "";
+
+    if (!gmtime_r(&seconds, &tm_time)) return text;
+
+    if (iso) {
+        size_t length = strftime(
+            text, sizeof(text), "%Y-%m-%dT%H:%M:%S", &tm_time
+        );
+
+        snprintf(
+            text + length, sizeof(text) - length, ".%06uZ",
+            unsigned(usec % 1000000)
+        );
+    }
+    else strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S :: ", &tm_time);
+
+    return text;
+}
+
+static std::string render_arg(const std::string &spec, const arg_type &arg) {
+    char text[1024];
+    int length = -1;
+    const char *fmt = spec.c_str();
+
+    switch (arg.type) {
+        case BINLOG::ARG::INT: {
+            length = snprintf(text, sizeof(text), fmt, int(arg.value));
+            break;
+        }
+        case BINLOG::ARG::UINT: {
+            length = snprintf(text, sizeof(text), fmt, unsigned(arg.value));
+            break;
+        }
+        case BINLOG::ARG::LONG: {
+            length = snprintf(text, sizeof(text), fmt, long(arg.value));
+            break;
+        }
+        case BINLOG::ARG::ULONG: {
+            length = snprintf(
+                text, sizeof(text), fmt, (unsigned long) arg.value
+            );
+            break;
+        }
+        case BINLOG::ARG::LLONG: {
+            length = snprintf(text, sizeof(text), fmt, (long long) arg.value);
+            break;
+        }
+        case BINLOG::ARG::ULLONG: {
+            length = snprintf(
+                text, sizeof(text), fmt, (unsigned long long) arg.value
+            );
+            break;
+        }
+        case BINLOG::ARG::DOUBLE: {
+            double number;
+            std::memcpy(&number, &arg.value, sizeof(number));
+            length = snprintf(text, sizeof(text), fmt, number);
+            break;
+        }
+        case BINLOG::ARG::POINTER: {
+            length = snprintf(
+                text, sizeof(text), fmt, (void *) uintptr_t(arg.value)
+            );
+            break;
+        }
+        case BINLOG::ARG::STRING: {
+            // The strings may be longer than the buffer.
+
+            std::vector<char> buffer(arg.text.size() + spec.size() + 1024);
+
+            length = snprintf(
+                buffer.data(), buffer.size(), fmt, arg.text.c_str()
+            );
+
+            if (length < 0) return "";
+
+            return std::string(
+                buffer.data(), std::min(size_t(length), buffer.size() - 1)
+            );
+        }
+    }
+
+    if (length < 0) return "";
+
+    return std::string(text, std::min(size_t(length), sizeof(text) - 1));
+}
+
+static std::string render(
+    const std::string &format, const std::vector<arg_type> &args
+) {
+    // The format is rendered one conversion at a time, each of them with the
+    // argument that was recorded for it. The widths and precisions given as
+    // arguments are written into the conversions.
+
+    std::string result;
+    size_t next = 0;
+
+    for (size_t i=0; i<format.size(); ++i) {
+        if (format[i] != '%') {
+            result.push_back(format[i]);
+            continue;
+        }
+
+        if (i + 1 < format.size() && format[i + 1] == '%') {
+            result.push_back('%');
+            ++i;
+            continue;
+        }
+
+        std::string spec("%");
+
+        for (++i; i<format.size(); ++i) {
+            char c = format[i];
+
+            if (c == '*') {
+                if (next < args.size()) {
+                    spec.append(std::to_string(int(args[next++].value)));
+                }
+
+                continue;
+            }
+
+            spec.push_back(c);
+
+            if (strchr("diouxXcsfFeEgGaAp", c)) break;
+        }
+
+        if (next < args.size()) result.append(render_arg(spec, args[next++]));
+    }
+
+    return result;
+}
+
+static std::string escape(const std::string &text) {
+    std::string result;
+
+    for (char c : text) {
+        switch (c) {
+            case '"':  result.append("\\\""); break;
+            case '\\': result.append("\\\\"); break;
+            case '\n': result.append("\\n");  break;
+            case '\r': result.append("\\r");  break;
+            case '\t': result.append("\\t");  break;
+            default: {
+                if (uint8_t(c) < 0x20) {
+                    char code[8];
+                    snprintf(code, sizeof(code), "\\u%04x", unsigned(c));
+                    result.append(code);
+                }
+                else result.push_back(c);
+            }
+        }
+    }
+
+    return result;
+}
+
+static std::string json_arg(const arg_type &arg) {
+    switch (arg.type) {
+        case BINLOG::ARG::INT:
+        case BINLOG::ARG::LONG:
+        case BINLOG::ARG::LLONG: {
+            return std::to_string((long long) arg.value);
+        }
+        case BINLOG::ARG::UINT:
+        case BINLOG::ARG::ULONG:
+        case BINLOG::ARG::ULLONG:
+        case BINLOG::ARG::POINTER: {
+            return std::to_string((unsigned long long) arg.value);
+        }
+        case BINLOG::ARG::DOUBLE: {
+            double number;
+            char text[64];
+
+            std::memcpy(&number, &arg.value, sizeof(number));
+            snprintf(text, sizeof(text), "%.17g", number);
+
+            return text;
+        }
+        case BINLOG::ARG::STRING: break;
+    }
+
+    return std::string("\"").append(escape(arg.text)).append("\"");
+}
+
+static bool decode_entry(
+    const char *data, size_t size, const format_type &format,
+    std::vector<arg_type> &args
+) {
+    args.clear();
+
+    for (BINLOG::ARG type : format.args) {
+        arg_type arg{type, 0, ""};
+
+        if (type == BINLOG::ARG::STRING) {
+            uint16_t length;
+
+            if (size < sizeof(length)) return false;
+
+            std::memcpy(&length, data, sizeof(length));
+            data += sizeof(length);
+            size -= sizeof(length);
+
+            if (size < length) return false;
+
+            arg.text.assign(data, length);
+            data += length;
+            size -= length;
+        }
+        else {
+            if (size < sizeof(arg.value)) return false;
+
+            std::memcpy(&arg.value, data, sizeof(arg.value));
+            data += sizeof(arg.value);
+            size -= sizeof(arg.value);
+        }
+
+        args.push_back(arg);
+    }
+
+    return true;
+}
+
+static bool decode_file(
+    const char *path, bool json, uint32_t &pid,
+    std::unordered_map<uint16_t, format_type> &formats
+) {
+    FILE *fp = fopen(path, "rb");
+
+    if (!fp) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    std::vector<char> record(UINT16_MAX);
+    std::vector<arg_type> args;
+    bool success = true;
+    bool first = true;
+
+    while (1) {
+        BINLOG::record_type head;
+
+        if (fread(&head, sizeof(head), 1, fp) != 1) break;
+
+        if (head.size < sizeof(head)) {
+            fprintf(stderr, "%s: corrupt record\n", path);
+            success = false;
+            break;
+        }
+
+        std::memcpy(record.data(), &head, sizeof(head));
+
+        size_t rest = head.size - sizeof(head);
+
+        if (rest && fread(record.data() + sizeof(head), rest, 1, fp) != 1) {
+            fprintf(stderr, "%s: truncated record\n", path);
+            success = false;
+            break;
+        }
+
+        const char *data = record.data();
+        BINLOG::RECORD type = static_cast<BINLOG::RECORD>(head.type);
+
+        if (first && type != BINLOG::RECORD::HEADER) {
+            fprintf(stderr, "%s: not a binary log\n", path);
+            success = false;
+            break;
+        }
+
+        first = false;
+
+        switch (type) {
+            case BINLOG::RECORD::HEADER: {
+                BINLOG::header_type header;
+
+                if (head.size < sizeof(header)) break;
+
+                std::memcpy(&header, data, sizeof(header));
+
+                if (memcmp(header.magic, BINLOG::MAGIC, sizeof(header.magic))
+                ||  header.version != BINLOG::VERSION) {
+                    fprintf(
+                        stderr, "%s: not a binary log of version %u\n", path,
+                        unsigned(BINLOG::VERSION)
+                    );
+                    fclose(fp);
+                    return false;
+                }
+
+                // Another process has appended to the file, so the formats
+                // defined so far no longer apply.
+
+                if (header.pid != pid) formats.clear();
+
+                pid = header.pid;
+                break;
+            }
+            case BINLOG::RECORD::FORMAT: {
+                BINLOG::format_type header;
+
+                if (head.size < sizeof(header)) break;
+
+                std::memcpy(&header, data, sizeof(header));
+
+                if (size_t(head.size) < sizeof(header) + header.arg_count +
+                    header.origin_size + header.format_size) {
+                    break;
+                }
+
+                format_type &format = formats[header.id];
+                const char *at = data + sizeof(header);
+
+                format.args.clear();
+
+                for (size_t i=0; i<header.arg_count; ++i) {
+                    format.args.push_back(static_cast<BINLOG::ARG>(*at++));
+                }
+
+                format.origin.assign(at, header.origin_size);
+                at += header.origin_size;
+                format.format.assign(at, header.format_size);
+                break;
+            }
+            case BINLOG::RECORD::ENTRY: {
+                BINLOG::entry_type entry;
+
+                if (head.size < sizeof(entry)) break;
+
+                std::memcpy(&entry, data, sizeof(entry));
+
+                const auto found = formats.find(entry.id);
+
+                if (found == formats.end()
+                || !decode_entry(
+                    data + sizeof(entry), head.size - sizeof(entry),
+                    found->second, args
+                )) {
+                    if (json) {
+                        printf(
+                            "{\"time\":\"%s\","
+                            "\"error\":\"unknown format %u\"}\n",
+                            format_time(entry.time, true).c_str(),
+                            unsigned(entry.id)
+                        );
+                    }
+                    else {
+                        printf(
+                            "%s<unknown format %u>\n",
+                            format_time(entry.time, false).c_str(),
+                            unsigned(entry.id)
+                        );
+                    }
+
+                    break;
+                }
+
+                const format_type &format = found->second;
+                std::string message(render(format.format, args));
+
+                if (json) {
+                    printf(
+                        "{\"time\":\"%s\",\"origin\":\"%s\",\"message\":\"%s\","
+                        "\"format\":\"%s\",\"args\":[",
+                        format_time(entry.time, true).c_str(),
+                        escape(format.origin).c_str(),
+                        escape(message).c_str(),
+                        escape(format.format).c_str()
+                    );
+
+                    for (size_t i=0; i<args.size(); ++i) {
+                        printf(
+                            "%s%s", i ? "," : "", json_arg(args[i]).c_str()
+                        );
+                    }
+
+                    printf("]}\n");
+                }
+                else {
+                    printf(
+                        "%s%s%s%s\n", format_time(entry.time, false).c_str(),
+                        format.origin.c_str(),
+                        format.origin.empty() ? "" : ": ", message.c_str()
+                    );
+                }
+
+                break;
+            }
+            case BINLOG::RECORD::TEXT: {
+                BINLOG::text_type text;
+
+                if (head.size < sizeof(text)) break;
+
+                std::memcpy(&text, data, sizeof(text));
+
+                std::string line(
+                    data + sizeof(text), head.size - sizeof(text)
+                );
+
+                if (json) {
+                    while (!line.empty() && line.back() == '\n') {
+                        line.pop_back();
+                    }
+
+                    printf(
+                        "{\"time\":\"%s\",\"text\":\"%s\"}\n",
+                        format_time(text.time, true).c_str(),
+                        escape(line).c_str()
+                    );
+                }
+                else fwrite(line.data(), 1, line.size(), stdout);
+
+                break;
+            }
+            default: {
+                // Records of unknown types are skipped by their size.
+
+                break;
+            }
+        }
+    }
+
+    fclose(fp);
+
+    return success;
+}
+
+int main(int argc, char **argv) {
+    bool json = false;
+
+    static struct option long_options[] = {
+        {"help",        no_argument,       0,        'h' },
+        {"json",        no_argument,       0,        'j' },
+        {0,             0,                 0,          0 }
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, "hj", long_options, nullptr)) != -1) {
+        switch (c) {
+            case 'j': json = true; break;
+            default : print_usage(argv[0]); return c == 'h' ? 0 : 1;
+        }
+    }
+
+    if (optind >= argc) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    // Every file defines the formats it uses. They are still carried over from
+    // one file to the next, which is harmless since a definition of the same
+    // id replaces the earlier one.
+
+    std::unordered_map<uint16_t, format_type> formats;
+    uint32_t pid = 0;
+    int status = 0;
+
+    for (int i=optind; i<argc; ++i) {
+        if (!decode_file(argv[i], json, pid, formats)) status = 1;
+    }
+
+    return status;
+}
@@ -0,0 +1,538 @@
+// SPDX-License-Identifier: MIT
+// Measures the round-trip time of small messages sent through a tcpherald
+// instance and compares it to that of direct connections.
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <csignal>
+#include <string>
+#include <vector>
+#include <getopt.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <time.h>
+
+#include "histogram.h"
+
+struct settings_type {
+    std::string host;
+    std::string supply_port;
+    std::string demand_port;
+    std::string label;
+    size_t sessions;  // Pairs of connections measured at the same time.
+    size_t size;      // Bytes per message.
+    double rate;      // Messages per second per session, zero for no pause.
+    unsigned duration;
+    unsigned warmup;  // Seconds of messages left out of the results.
+    bool baseline;
+    bool json;
+};
+
+struct session_type {
+    int demand;         // Sends the messages and receives the echoes.
+    int supply;         // Echoes everything it receives.
+    long long due;      // When the next message is to be sent.
+    long long sent;     // When the message in flight was meant to be sent.
+    size_t received;    // Bytes of the echo received so far.
+    bool waiting;
+    std::vector<uint8_t> echo;
+};
+
+struct result_type {
+    HISTOGRAM rtt; // Nanoseconds.
+    uint64_t messages;
+    double seconds;
+};
+
+static volatile sig_atomic_t interrupted = 0;
+
+static void print_usage(const char *name) {
+    fprintf(
+        stderr,
+        "Usage: %s [options] supply-port demand-port\n"
+        "Options:\n"
+        "  -B  --no-baseline   Skip the measurement of direct connections.\n"
+        "  -d  --duration      Seconds to measure each target (10).\n"
+        "  -H  --host          Address of the herald (127.0.0.1).\n"
+        "  -h  --help          Display this usage information.\n"
+        "  -j  --json          Print the results as a JSON object.\n"
+        "  -l  --label         Name of the build or mode being measured.\n"
+        "  -n  --sessions      Concurrent sessions (1).\n"
+        "  -r  --rate          Messages per second per session, 0 for no\n"
+        "                      pause between the messages (1000).\n"
+        "  -s  --size          Message size in bytes (32).\n"
+        "  -w  --warmup        Seconds left out of the results (1).\n",
+        name
+    );
+}
+
+static void interrupt(int) {
+    interrupted = 1;
+}
+
+static long long get_nsec() {
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0) return 0;
+
+    return (long long)(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+static void set_options(int descriptor) {
+    int flag = 1;
+
+    setsockopt(descriptor, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+}
+
+static int connect_to(const char *host, const char *port) {
+    struct addrinfo hints{};
+    struct addrinfo *info = nullptr;
+
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    int retval = getaddrinfo(host, port, &hints, &info);
+
+    if (retval != 0) {
+        fprintf(stderr, "%s:%s: %s\n", host, port, gai_strerror(retval));
+        return -1;
+    }
+
+    int descriptor = -1;
+
+    for (struct addrinfo *next = info; next; next = next->ai_next) {
+        descriptor = socket(
+            next->ai_family, next->ai_socktype | SOCK_CLOEXEC,
+            next->ai_protocol
+        );
+
+        if (descriptor == -1) continue;
+
+        if (connect(descriptor, next->ai_addr, next->ai_addrlen) == 0) break;
+
+        close(descriptor);
+        descriptor = -1;
+    }
+
+    freeaddrinfo(info);
+
+    if (descriptor == -1) {
+        fprintf(stderr, "%s:%s: %s\n", host, port, strerror(errno));
+        return -1;
+    }
+
+    set_options(descriptor);
+
+    return descriptor;
+}
+
+static bool wait_for_byte(int descriptor, int timeout_ms) {
+    struct pollfd entry{descriptor, POLLIN, 0};
+    uint8_t byte;
+
+    return poll(&entry, 1, timeout_ms) == 1
+        && recv(descriptor, &byte, 1, 0) == 1;
+}
+
+static bool open_herald(
+    const settings_type &settings, std::vector<session_type> &sessions
+) {
+    // The sessions are paired one at a time. A byte sent from the demand side
+    // is waited for on the supply side, which confirms that the herald paired
+    // these two connections with each other.
+
+    const char *host = settings.host.c_str();
+
+    for (session_type &session : sessions) {
+        session.supply = connect_to(host, settings.supply_port.c_str());
+
+        if (session.supply == -1) return false;
+
+        session.demand = connect_to(host, settings.demand_port.c_str());
+
+        if (session.demand == -1) return false;
+
+        uint8_t byte = 0;
+
+        if (send(session.demand, &byte, 1, MSG_NOSIGNAL) != 1
+        || !wait_for_byte(session.supply, 5000)) {
+            fprintf(stderr, "the herald did not pair the connections\n");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool open_direct(
+    const settings_type &settings, std::vector<session_type> &sessions
+) {
+    // The baseline consists of connections accepted by this very process over
+    // the same interface, so that only the herald is left out.
+
+    int listener = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    struct sockaddr_in address{};
+    socklen_t length = sizeof(address);
+
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (listener == -1
+    ||  bind(listener, (struct sockaddr *) &address, sizeof(address)) == -1
+    ||  listen(listener, int(sessions.size())) == -1
+    ||  getsockname(listener, (struct sockaddr *) &address, &length) == -1) {
+        fprintf(stderr, "direct listener: %s\n", strerror(errno));
+
+        if (listener != -1) close(listener);
+
+        return false;
+    }
+
+    std::string port(std::to_string(ntohs(address.sin_port)));
+
+    for (session_type &session : sessions) {
+        session.demand = connect_to("127.0.0.1", port.c_str());
+        session.supply = session.demand == -1 ? -1 : accept4(
+            listener, nullptr, nullptr, SOCK_CLOEXEC
+        );
+
+        if (session.supply == -1) {
+            close(listener);
+            return false;
+        }
+
+        set_options(session.supply);
+    }
+
+    close(listener);
+
+    return true;
+}
+
+static void close_sessions(std::vector<session_type> &sessions) {
+    for (session_type &session : sessions) {
+        if (session.demand != -1) close(session.demand);
+        if (session.supply != -1) close(session.supply);
+
+        session.demand = -1;
+        session.supply = -1;
+    }
+}
+
+static bool measure(
+    const settings_type &settings, std::vector<session_type> &sessions,
+    result_type &result
+) {
+    int epoll = epoll_create1(EPOLL_CLOEXEC);
+
+    if (epoll == -1) {
+        fprintf(stderr, "epoll_create1: %s\n", strerror(errno));
+        return false;
+    }
+
+    for (size_t i=0; i<sessions.size(); ++i) {
+        session_type &session = sessions[i];
+        struct epoll_event event{};
+
+        fcntl(session.demand, F_SETFL, O_NONBLOCK);
+        fcntl(session.supply, F_SETFL, O_NONBLOCK);
+
+        // The data holds the index of the session times two, plus one for
+        // the supply side.
+
+        event.events = EPOLLIN;
+        event.data.u64 = i * 2;
+        epoll_ctl(epoll, EPOLL_CTL_ADD, session.demand, &event);
+
+        event.data.u64 = i * 2 + 1;
+        epoll_ctl(epoll, EPOLL_CTL_ADD, session.supply, &event);
+    }
+
+    long long interval{
+        settings.rate > 0.0 ? (long long) (1000000000.0 / settings.rate) : 0
+    };
+    long long start = get_nsec();
+    long long measured = start + (long long) settings.warmup * 1000000000LL;
+    long long stop = measured + (long long) settings.duration * 1000000000LL;
+    std::vector<uint8_t> message(settings.size, uint8_t('x'));
+    std::vector<uint8_t> buffer(64 * 1024);
+    std::vector<struct epoll_event> events(sessions.size() * 2);
+    bool success = true;
+
+    for (size_t i=0; i<sessions.size(); ++i) {
+        // The sessions are spread evenly over the first interval.
+
+        sessions[i].due = start + interval * (long long) i / (
+            (long long) sessions.size()
+        );
+        sessions[i].waiting = false;
+        sessions[i].received = 0;
+    }
+
+    while (!interrupted && success) {
+        long long now = get_nsec();
+
+        if (now >= stop) break;
+
+        long long next = stop;
+
+        for (session_type &session : sessions) {
+            if (session.waiting) continue;
+
+            if (session.due <= now) {
+                // The time is measured from when the message was meant to be
+                // sent, so that a slow response delaying the next message is
+                // not left out of the results.
+
+                session.sent = session.due;
+                session.waiting = true;
+                session.received = 0;
+
+                if (send(
+                    session.demand, message.data(), message.size(),
+                    MSG_NOSIGNAL
+                ) != ssize_t(message.size())) {
+                    fprintf(stderr, "send: %s\n", strerror(errno));
+                    success = false;
+                    break;
+                }
+            }
+            else if (session.due < next) next = session.due;
+        }
+
+        // The timeout of epoll_wait is in milliseconds and may run late, so
+        // the last millisecond before the next message is spent polling.
+
+        long long wait = (next - get_nsec()) / 1000000;
+        int count = epoll_wait(
+            epoll, events.data(), int(events.size()),
+            wait >= 2 ? int(std::min(wait - 1, 100LL)) : 0
+        );
+
+        if (count == -1 && errno != EINTR) {
+            fprintf(stderr, "epoll_wait: %s\n", strerror(errno));
+            success = false;
+        }
+
+        for (int e=0; e<count; ++e) {
+            session_type &session = sessions[events[e].data.u64 / 2];
+            bool supply = events[e].data.u64 % 2;
+            int descriptor = supply ? session.supply : session.demand;
+
+            while (1) {
+                ssize_t got = recv(descriptor, buffer.data(), buffer.size(), 0);
+
+                if (got == 0) {
+                    fprintf(stderr, "the connection was closed\n");
+                    success = false;
+                    break;
+                }
+
+                if (got < 0) {
+                    if (errno == EINTR) continue;
+                    if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+
+                    fprintf(stderr, "recv: %s\n", strerror(errno));
+                    success = false;
+                    break;
+                }
+
+                if (supply) {
+                    // Messages are small, so the echo practically never
+                    // blocks. Should it, the rest is sent when possible.
+
+                    session.echo.insert(
+                        session.echo.end(), buffer.begin(),
+                        buffer.begin() + got
+                    );
+
+                    continue;
+                }
+
+                session.received += size_t(got);
+
+                if (session.waiting && session.received >= settings.size) {
+                    long long done = get_nsec();
+
+                    if (session.sent >= measured) {
+                        result.rtt.record(uint64_t(done - session.sent));
+                        ++result.messages;
+                    }
+
+                    session.waiting = false;
+                    session.due = interval ? session.sent + interval : done;
+                }
+            }
+
+            if (!session.echo.empty()) {
+                ssize_t sent = send(
+                    session.supply, session.echo.data(), session.echo.size(),
+                    MSG_NOSIGNAL
+                );
+
+                if (sent > 0) {
+                    session.echo.erase(
+                        session.echo.begin(), session.echo.begin() + sent
+                    );
+                }
+            }
+        }
+    }
+
+    result.seconds = double(get_nsec() - measured) / 1000000000.0;
+
+    close(epoll);
+
+    return success;
+}
+
+static void print_text(const char *title, const result_type &result) {
+    const HISTOGRAM &h = result.rtt;
+
+    printf(
+        "%-8s %8llu messages, p50 %.1f, p99 %.1f, p99.9 %.1f, max %.1f us\n",
+        title, (unsigned long long) result.messages,
+        double(h.value_at(0.5)) / 1000.0, double(h.value_at(0.99)) / 1000.0,
+        double(h.value_at(0.999)) / 1000.0, double(h.get_max()) / 1000.0
+    );
+}
+
+static void print_json(const char *title, const result_type &result) {
+    const HISTOGRAM &h = result.rtt;
+
+    printf(
+        "\"%s\":{\"messages\":%llu,\"seconds\":%.3f,\"mean_us\":%.3f,"
+        "\"p50_us\":%.3f,\"p90_us\":%.3f,\"p99_us\":%.3f,\"p999_us\":%.3f,"
+        "\"max_us\":%.3f}", title, (unsigned long long) result.messages,
+        result.seconds,
+        h.get_count() ? double(h.get_sum()) / double(h.get_count()) / 1000.0 :
+        0.0,
+        double(h.value_at(0.5)) / 1000.0, double(h.value_at(0.9)) / 1000.0,
+        double(h.value_at(0.99)) / 1000.0, double(h.value_at(0.999)) / 1000.0,
+        double(h.get_max()) / 1000.0
+    );
+}
+
+static std::string escape(const std::string &text) {
+    std::string result;
+
+    for (char c : text) {
+        if (c == '"' || c == '\\') result.push_back('\\');
+
+        if (uint8_t(c) >= 0x20) result.push_back(c);
+    }
+
+    return result;
+}
+
+int main(int argc, char **argv) {
+    settings_type settings{
+        "127.0.0.1", "", "", "default", 1, 32, 1000.0, 10, 1, true, false
+    };
+
+    static struct option long_options[] = {
+        {"no-baseline", no_argument,       0,        'B' },
+        {"duration",    required_argument, 0,        'd' },
+        {"host",        required_argument, 0,        'H' },
+        {"help",        no_argument,       0,        'h' },
+        {"json",        no_argument,       0,        'j' },
+        {"label",       required_argument, 0,        'l' },
+        {"sessions",    required_argument, 0,        'n' },
+        {"rate",        required_argument, 0,        'r' },
+        {"size",        required_argument, 0,        's' },
+        {"warmup",      required_argument, 0,        'w' },
+        {0,             0,                 0,          0 }
+    };
+
+    int c;
+    while ((c = getopt_long(
+        argc, argv, "Bd:H:hjl:n:r:s:w:", long_options, nullptr
+    )) != -1) {
+        switch (c) {
+            case 'B': settings.baseline = false; break;
+            case 'd': settings.duration = unsigned(atoi(optarg)); break;
+            case 'H': settings.host = optarg; break;
+            case 'j': settings.json = true; break;
+            case 'l': settings.label = optarg; break;
+            case 'n': settings.sessions = size_t(atol(optarg)); break;
+            case 'r': settings.rate = atof(optarg); break;
+            case 's': settings.size = size_t(atol(optarg)); break;
+            case 'w': settings.warmup = unsigned(atoi(optarg)); break;
+            default : print_usage(argv[0]); return c == 'h' ? 0 : 1;
+        }
+    }
+
+    if (argc - optind != 2 || settings.sessions == 0 || settings.size == 0
+    ||  settings.duration == 0 || settings.rate < 0.0) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    settings.supply_port = argv[optind];
+    settings.demand_port = argv[optind + 1];
+
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, interrupt);
+
+    result_type herald{};
+    result_type direct{};
+    std::vector<session_type> sessions(
+        settings.sessions, session_type{-1, -1, 0, 0, 0, false, {}}
+    );
+
+    bool success = open_herald(settings, sessions)
+                && measure(settings, sessions, herald);
+
+    close_sessions(sessions);
+
+    if (success && settings.baseline) {
+        success = open_direct(settings, sessions)
+               && measure(settings, sessions, direct);
+
+        close_sessions(sessions);
+    }
+
+    if (!success) return 1;
+
+    if (settings.json) {
+        printf(
+            "{\"label\":\"%s\",\"sessions\":%zu,\"size\":%zu,\"rate\":%.3f,",
+            escape(settings.label).c_str(), settings.sessions, settings.size,
+            settings.rate
+        );
+
+        print_json("herald", herald);
+
+        if (settings.baseline) {
+            const HISTOGRAM &h = herald.rtt;
+            const HISTOGRAM &d = direct.rtt;
+
+            printf(",");
+            print_json("direct", direct);
+            printf(
+                ",\"added\":{\"p50_us\":%.3f,\"p99_us\":%.3f,"
+                "\"p999_us\":%.3f}",
+                (double(h.value_at(0.5)) - double(d.value_at(0.5))) / 1000.0,
+                (double(h.value_at(0.99)) - double(d.value_at(0.99))) / 1000.0,
+                (double(h.value_at(0.999)) - double(d.value_at(0.999))) /
+                1000.0
+            );
+        }
+
+        printf("}\n");
+    }
+    else {
+        print_text("herald", herald);
+
+        if (settings.baseline) print_text("direct", direct);
+    }
+
+    return 0;
+}
@@ -0,0 +1,648 @@
+// SPDX-License-Identifier: MIT
+// Churns pairs through a tcpherald instance for hours and fails if its memory,
+// descriptors or internal structures keep growing.
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cstdarg>
+#include <cerrno>
+#include <csignal>
+#include <deque>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <getopt.h>
+#include <dirent.h>
+#include <sys/resource.h>
+
+#include "procstat.h"
+#include "segment.h"
+#include "sockets.h"
+
+enum class ROLE : int {
+    NONE   = 0,
+    DEMAND = 1,
+    SUPPLY = 2
+};
+
+enum class PATTERN : uint8_t {
+    ECHO         = 0, // A request is answered and the demand client leaves.
+    SUPPLY_CLOSE = 1, // The answer is acknowledged and the supply agent leaves.
+    BULK         = 2, // A request is answered by a large response.
+    ABANDON      = 3, // The demand client leaves before it is paired.
+    MAX_PATTERNS = 4
+};
+
+struct settings_type {
+    std::string host;
+    std::string supply_port;
+    std::string demand_port;
+    std::string stats_file;
+    size_t clients;     // Demand clients connected at the same time.
+    size_t bulk_size;   // Bytes of the response of the bulk pattern.
+    unsigned duration;  // Seconds to keep churning.
+    unsigned interval;  // Seconds between the samples.
+    unsigned warmup;    // Seconds before the samples are compared.
+    double tolerance;   // Share of growth that is not counted.
+    int pid;
+    bool verbose;
+};
+
+struct connection_type {
+    ROLE role;
+    PATTERN pattern;
+    size_t received;
+    size_t owed;        // Bytes still to be queued for sending.
+    bool answered;      // The demand client has received its response.
+};
+
+struct metric_type {
+    const char *name;
+    uint64_t slack;     // Growth smaller than this is not counted.
+    bool drains;        // Returns to its baseline once the load stops.
+    uint64_t baseline;
+    uint64_t drained;
+    std::vector<uint64_t> samples;
+};
+
+static constexpr const size_t CHUNK_SIZE = 64 * 1024;
+static constexpr const size_t REQUEST_SIZE = 8;
+static constexpr const unsigned DRAIN_SECONDS = 30;
+static volatile sig_atomic_t interrupted = 0;
+
+static void print_usage(const char *name) {
+    fprintf(
+        stderr,
+        "Usage: %s [options] supply-port demand-port\n"
+        "Options:\n"
+        "  -b  --bulk          Response size of the bulk pairs (262144).\n"
+        "  -c  --clients       Concurrent demand clients (200).\n"
+        "  -d  --duration      Seconds to keep churning (3600).\n"
+        "  -f  --stats-file    Statistics file of the herald.\n"
+        "  -g  --tolerance     Percentage of growth to tolerate (10).\n"
+        "  -H  --host          Address of the herald (127.0.0.1).\n"
+        "  -h  --help          Display this usage information.\n"
+        "  -i  --interval      Seconds between the samples (10).\n"
+        "  -P  --pid           Process id of the herald.\n"
+        "  -v  --verbose       Print every sample.\n"
+        "  -w  --warmup        Seconds before growth is measured (60).\n"
+        "\n"
+        "The pairs cycle through echoing, closing from the supply side, bulk\n"
+        "responses and demand clients leaving before being paired. The\n"
+        "samples taken after the warm-up are split into quarters and a\n"
+        "metric fails when the peak of the last quarter exceeds the peak of\n"
+        "the first one by more than the tolerance. Once the load stops, the\n"
+        "open files and descriptors must return to where they started.\n",
+        name
+    );
+}
+
+static void print_log(const char *origin, const char *fmt, ...) {
+    va_list ap;
+
+    if (origin && *origin) fprintf(stderr, "%s: ", origin);
+
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+
+    fprintf(stderr, "\n");
+}
+
+static void interrupt(int) {
+    interrupted = 1;
+}
+
+static void raise_file_limit() {
+    struct rlimit limit;
+
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0
+    &&  limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+static bool count_files(int pid, uint64_t &count) {
+    char path[64];
+
+    snprintf(path, sizeof(path), "/proc/%d/fd", pid);
+
+    DIR *dir = opendir(path);
+
+    if (!dir) return false;
+
+    count = 0;
+
+    while (struct dirent *entry = readdir(dir)) {
+        if (entry->d_name[0] != '.') ++count;
+    }
+
+    closedir(dir);
+
+    return true;
+}
+
+static bool sample(
+    const settings_type &settings, const SEGMENT::layout_type *segment,
+    std::vector<metric_type> &metrics, std::vector<uint64_t> &values
+) {
+    // Takes the values of the metrics in their order, the first two of them
+    // from the proc file system and the rest from the statistics file.
+
+    PROCSTAT::sample_type process{};
+    SEGMENT::layout_type published;
+
+    values.assign(metrics.size(), 0);
+
+    if (!PROCSTAT::sample(settings.pid, process)
+    ||  !count_files(settings.pid, values[1])) {
+        return false;
+    }
+
+    values[0] = process.rss;
+
+    if (!segment || !SEGMENT::read(segment, published)) return true;
+
+    for (size_t i=2; i<metrics.size(); ++i) {
+        size_t index = SEGMENT::index_of(segment, metrics[i].name);
+
+        if (index < SEGMENT::MAX_FIELDS) values[i] = published.values[index];
+    }
+
+    return true;
+}
+
+static void pump(
+    SOCKETS &sockets, std::unordered_map<int, connection_type> &connections,
+    std::unordered_set<int> &owing, std::vector<uint8_t> &chunk
+) {
+    for (auto it = owing.begin(); it != owing.end();) {
+        int d = *it;
+        connection_type &connection = connections[d];
+
+        if (sockets.get_outgoing_size(d) < CHUNK_SIZE / 2) {
+            size_t size = std::min(connection.owed, CHUNK_SIZE);
+
+            chunk.assign(size, uint8_t('x'));
+            sockets.append_outgoing(d, chunk);
+            connection.owed -= size;
+        }
+
+        if (connection.owed == 0) it = owing.erase(it);
+        else ++it;
+    }
+}
+
+static const char *verdict(
+    const metric_type &metric, double tolerance, uint64_t &early,
+    uint64_t &late
+) {
+    const std::vector<uint64_t> &samples = metric.samples;
+    size_t quarter = samples.size() / 4;
+
+    early = 0;
+    late = 0;
+
+    if (quarter) {
+        early = *std::max_element(
+            samples.begin(), samples.begin() + long(quarter)
+        );
+        late = *std::max_element(samples.end() - long(quarter), samples.end());
+    }
+
+    if (metric.drains && metric.drained > metric.baseline) return "leaking";
+
+    if (quarter == 0) return "too short";
+
+    uint64_t allowed = std::max(
+        metric.slack, uint64_t(double(early) * tolerance)
+    );
+
+    return late > early + allowed ? "growing" : "ok";
+}
+
+int main(int argc, char **argv) {
+    settings_type settings{
+        "127.0.0.1", "", "", "", 200, 256 * 1024, 3600, 10, 60, 0.1, 0, false
+    };
+
+    static struct option long_options[] = {
+        {"bulk",        required_argument, 0,        'b' },
+        {"clients",     required_argument, 0,        'c' },
+        {"duration",    required_argument, 0,        'd' },
+        {"stats-file",  required_argument, 0,        'f' },
+        {"tolerance",   required_argument, 0,        'g' },
+        {"host",        required_argument, 0,        'H' },
+        {"help",        no_argument,       0,        'h' },
+        {"interval",    required_argument, 0,        'i' },
+        {"pid",         required_argument, 0,        'P' },
+        {"verbose",     no_argument,       0,        'v' },
+        {"warmup",      required_argument, 0,        'w' },
+        {0,             0,                 0,          0 }
+    };
+
+    int c;
+    while ((c = getopt_long(
+        argc, argv, "b:c:d:f:g:H:hi:P:vw:", long_options, nullptr
+    )) != -1) {
+        switch (c) {
+            case 'b': settings.bulk_size = size_t(atol(optarg)); break;
+            case 'c': settings.clients = size_t(atol(optarg)); break;
+            case 'd': settings.duration = unsigned(atoi(optarg)); break;
+            case 'f': settings.stats_file = optarg; break;
+            case 'g': settings.tolerance = atof(optarg) / 100.0; break;
+            case 'H': settings.host = optarg; break;
+            case 'i': settings.interval = unsigned(atoi(optarg)); break;
+            case 'P': settings.pid = atoi(optarg); break;
+            case 'v': settings.verbose = true; break;
+            case 'w': settings.warmup = unsigned(atoi(optarg)); break;
+            default : print_usage(argv[0]); return c == 'h' ? 0 : 1;
+        }
+    }
+
+    if (argc - optind != 2 || settings.pid <= 0 || settings.clients == 0
+    ||  settings.interval == 0 || settings.bulk_size == 0) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    settings.supply_port = argv[optind];
+    settings.demand_port = argv[optind + 1];
+
+    const SEGMENT::layout_type *segment = nullptr;
+
+    if (!settings.stats_file.empty()) {
+        segment = SEGMENT::attach(settings.stats_file.c_str());
+
+        if (!segment) {
+            fprintf(
+                stderr, "%s: %s\n", settings.stats_file.c_str(),
+                strerror(errno)
+            );
+            return 1;
+        }
+    }
+
+    std::vector<metric_type> metrics{
+        { "rss",            8 * 1024 * 1024, false, 0, 0, {} },
+        { "files",                       16,  true, 0, 0, {} },
+        { "descriptors",                 16,  true, 0, 0, {} },
+        { "memory_records",      256 * 1024, false, 0, 0, {} },
+        { "memory_buffers", 4 * 1024 * 1024, false, 0, 0, {} },
+        { "memory_flags",         64 * 1024, false, 0, 0, {} },
+        { "memory_maps",         256 * 1024, false, 0, 0, {} },
+        { "memory_heap",    8 * 1024 * 1024, false, 0, 0, {} }
+    };
+
+    if (!segment) metrics.resize(2);
+
+    std::vector<uint64_t> values;
+
+    // The statistics file is only published once per second, which is why
+    // the baseline is taken after it has surely been published.
+
+    if (segment) usleep(1100000);
+
+    if (!sample(settings, segment, metrics, values)) {
+        fprintf(stderr, "process %d could not be sampled\n", settings.pid);
+        if (segment) SEGMENT::detach(segment);
+        return 1;
+    }
+
+    for (size_t i=0; i<metrics.size(); ++i) metrics[i].baseline = values[i];
+
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, interrupt);
+    raise_file_limit();
+
+    SOCKETS sockets(print_log);
+
+    if (!sockets.init()) {
+        if (segment) SEGMENT::detach(segment);
+        return 1;
+    }
+
+    std::unordered_map<int, connection_type> connections;
+    std::unordered_set<int> owing;
+    std::deque<PATTERN> patterns;
+    std::vector<uint8_t> buffer;
+    std::vector<uint8_t> chunk;
+    uint64_t completed[static_cast<size_t>(PATTERN::MAX_PATTERNS)]{};
+    uint64_t failed = 0;
+    uint64_t started = 0;
+    size_t demand_active = 0;
+    size_t demand_pending = 0;
+    const char *host = settings.host.c_str();
+    bool sampled = true;
+
+    auto start_supply = [&]() {
+        if (!sockets.connect(
+            host, settings.supply_port.c_str(), int(ROLE::SUPPLY)
+        )) {
+            ++failed;
+        }
+    };
+
+    long long start = PROCSTAT::get_usec();
+    long long stop = start + (long long) settings.duration * 1000000LL;
+    long long warm = start + (long long) settings.warmup * 1000000LL;
+    long long next_sample = start + (long long) settings.interval * 1000000LL;
+    long long drain_stop = 0;
+
+    while (!interrupted) {
+        long long now = PROCSTAT::get_usec();
+        bool churning = now < stop;
+
+        while (churning && demand_active + demand_pending < settings.clients) {
+            // The patterns are handed out in turns, and every demand client
+            // that is to be paired is matched by a supply agent.
+
+            PATTERN pattern = static_cast<PATTERN>(
+                started++ % static_cast<uint64_t>(PATTERN::MAX_PATTERNS)
+            );
+
+            if (!sockets.connect(
+                host, settings.demand_port.c_str(), int(ROLE::DEMAND)
+            )) {
+                ++failed;
+                break;
+            }
+
+            patterns.push_back(pattern);
+            ++demand_pending;
+
+            if (pattern != PATTERN::ABANDON) start_supply();
+        }
+
+        if (!churning) {
+            if (drain_stop == 0) {
+                drain_stop = now + (long long) DRAIN_SECONDS * 1000000LL;
+            }
+
+            if (demand_active + demand_pending == 0 || now >= drain_stop) {
+                break;
+            }
+        }
+
+        if (!sockets.serve(owing.empty() ? 10 : 0)) {
+            fprintf(stderr, "failed to serve the sockets\n");
+            break;
+        }
+
+        int d;
+
+        while ((d = sockets.next_connection()) != SOCKETS::NO_DESCRIPTOR) {
+            ROLE role = static_cast<ROLE>(sockets.get_group(d));
+            connection_type &connection = connections[d];
+
+            connection = connection_type{role, PATTERN::ECHO, 0, 0, false};
+
+            if (role != ROLE::DEMAND) continue;
+
+            if (demand_pending) --demand_pending;
+
+            ++demand_active;
+
+            if (!patterns.empty()) {
+                connection.pattern = patterns.front();
+                patterns.pop_front();
+            }
+
+            if (connection.pattern == PATTERN::ABANDON) {
+                ++completed[static_cast<size_t>(PATTERN::ABANDON)];
+                sockets.disconnect(d);
+                continue;
+            }
+
+            chunk.assign(REQUEST_SIZE, uint8_t('x'));
+            chunk[0] = static_cast<uint8_t>(connection.pattern);
+            sockets.append_outgoing(d, chunk);
+        }
+
+        while ((d = sockets.next_disconnection()) != SOCKETS::NO_DESCRIPTOR) {
+            auto found = connections.find(d);
+
+            if (found == connections.end()) {
+                // A connection that could not be established.
+
+                if (sockets.get_group(d) == int(ROLE::DEMAND)) {
+                    if (demand_pending) --demand_pending;
+                    if (!patterns.empty()) patterns.pop_front();
+                }
+
+                ++failed;
+                continue;
+            }
+
+            const connection_type &connection = found->second;
+
+            if (connection.role == ROLE::DEMAND) {
+                --demand_active;
+
+                if (connection.pattern == PATTERN::SUPPLY_CLOSE
+                &&  connection.answered) {
+                    ++completed[static_cast<size_t>(PATTERN::SUPPLY_CLOSE)];
+                }
+                else if (!connection.answered
+                &&  connection.pattern != PATTERN::ABANDON) {
+                    ++failed;
+                }
+            }
+            else if (connection.received < REQUEST_SIZE && churning) {
+                // The supply agent was paired with a demand client that left
+                // or it timed out, so another one takes its place.
+
+                start_supply();
+            }
+
+            owing.erase(d);
+            connections.erase(found);
+        }
+
+        while ((d = sockets.next_incoming()) != SOCKETS::NO_DESCRIPTOR) {
+            sockets.swap_incoming(d, buffer);
+
+            auto found = connections.find(d);
+
+            if (found == connections.end() || buffer.empty()) {
+                buffer.clear();
+                continue;
+            }
+
+            connection_type &connection = found->second;
+
+            if (connection.role == ROLE::SUPPLY) {
+                bool first = connection.received == 0;
+
+                connection.received += buffer.size();
+
+                if (!first) {
+                    // The supply agent leaves only once its answer has been
+                    // acknowledged, lest the answer be lost in the herald.
+
+                    if (connection.pattern == PATTERN::SUPPLY_CLOSE
+                    &&  connection.received >= 2 * REQUEST_SIZE) {
+                        sockets.disconnect(d);
+                    }
+
+                    buffer.clear();
+                    continue;
+                }
+
+                connection.pattern = static_cast<PATTERN>(buffer[0]);
+
+                if (connection.pattern == PATTERN::BULK) {
+                    connection.owed = settings.bulk_size;
+                    owing.insert(d);
+                }
+                else {
+                    chunk.assign(REQUEST_SIZE, uint8_t('x'));
+                    sockets.append_outgoing(d, chunk);
+                }
+            }
+            else if (connection.role == ROLE::DEMAND) {
+                size_t expected = connection.pattern == PATTERN::BULK ? (
+                    settings.bulk_size
+                ) : REQUEST_SIZE;
+
+                connection.received += buffer.size();
+
+                if (!connection.answered && connection.received >= expected) {
+                    connection.answered = true;
+
+                    if (connection.pattern == PATTERN::SUPPLY_CLOSE) {
+                        chunk.assign(REQUEST_SIZE, uint8_t('x'));
+                        sockets.append_outgoing(d, chunk);
+                    }
+                    else {
+                        ++completed[static_cast<size_t>(connection.pattern)];
+                        sockets.disconnect(d);
+                    }
+                }
+            }
+
+            buffer.clear();
+        }
+
+        pump(sockets, connections, owing, chunk);
+
+        if (now >= next_sample && churning) {
+            next_sample += (long long) settings.interval * 1000000LL;
+
+            if (!sample(settings, segment, metrics, values)) {
+                fprintf(stderr, "process %d has gone away\n", settings.pid);
+                sampled = false;
+                break;
+            }
+
+            if (now >= warm) {
+                for (size_t i=0; i<metrics.size(); ++i) {
+                    metrics[i].samples.push_back(values[i]);
+                }
+            }
+
+            if (settings.verbose) {
+                printf("%8.0f s:", double(now - start) / 1000000.0);
+
+                for (size_t i=0; i<metrics.size(); ++i) {
+                    printf(
+                        " %s %llu", metrics[i].name,
+                        (unsigned long long) values[i]
+                    );
+                }
+
+                printf("\n");
+                fflush(stdout);
+            }
+        }
+    }
+
+    // The supply agents still waiting for a demand client are closed, after
+    // which the herald is given time to let go of every connection.
+
+    for (const auto &p : connections) sockets.disconnect(p.first);
+
+    for (size_t i=0; i<100 && !connections.empty(); ++i) {
+        sockets.serve(10);
+
+        int d;
+
+        while ((d = sockets.next_disconnection()) != SOCKETS::NO_DESCRIPTOR) {
+            connections.erase(d);
+        }
+
+        while ((d = sockets.next_incoming()) != SOCKETS::NO_DESCRIPTOR) {
+            sockets.swap_incoming(d, buffer);
+            buffer.clear();
+        }
+    }
+
+    sockets.deinit();
+
+    for (unsigned i=0; sampled && i<DRAIN_SECONDS && !interrupted; ++i) {
+        sampled = sample(settings, segment, metrics, values);
+
+        bool drained = true;
+
+        for (size_t j=0; sampled && j<metrics.size(); ++j) {
+            metrics[j].drained = values[j];
+
+            if (metrics[j].drains && values[j] > metrics[j].baseline) {
+                drained = false;
+            }
+        }
+
+        if (drained) break;
+
+        sleep(1);
+    }
+
+    if (segment) SEGMENT::detach(segment);
+
+    double seconds = double(PROCSTAT::get_usec() - start) / 1000000.0;
+    uint64_t pairs = 0;
+
+    for (uint64_t count : completed) pairs += count;
+
+    printf(
+        "Pairs:      %llu completed (%llu echo, %llu supply close, %llu bulk, "
+        "%llu abandoned), %llu failed, %.1f/s\n",
+        (unsigned long long) pairs,
+        (unsigned long long) completed[size_t(PATTERN::ECHO)],
+        (unsigned long long) completed[size_t(PATTERN::SUPPLY_CLOSE)],
+        (unsigned long long) completed[size_t(PATTERN::BULK)],
+        (unsigned long long) completed[size_t(PATTERN::ABANDON)],
+        (unsigned long long) failed, double(pairs) / seconds
+    );
+
+    printf(
+        "%-16s %14s %14s %14s %14s  %s\n",
+        "Metric", "Baseline", "Early peak", "Late peak", "Drained", "Verdict"
+    );
+
+    bool success = sampled && pairs > 0;
+
+    for (const metric_type &metric : metrics) {
+        uint64_t early;
+        uint64_t late;
+        const char *result = verdict(metric, settings.tolerance, early, late);
+
+        if (strcmp(result, "ok") && strcmp(result, "too short")) {
+            success = false;
+        }
+
+        printf(
+            "%-16s %14llu %14llu %14llu %14llu  %s\n", metric.name,
+            (unsigned long long) metric.baseline, (unsigned long long) early,
+            (unsigned long long) late, (unsigned long long) metric.drained,
+            result
+        );
+    }
+
+    if (!sampled) fprintf(stderr, "the herald could not be sampled\n");
+
+    return success ? 0 : 1;
+}
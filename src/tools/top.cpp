@@ -0,0 +1,184 @@
+// SPDX-License-Identifier: MIT
+// Shows the statistics that tcpherald instances publish in mapped files.
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <csignal>
+#include <vector>
+#include <string>
+#include <getopt.h>
+#include <unistd.h>
+
+#include "segment.h"
+
+struct instance_type {
+    std::string path;
+    const SEGMENT::layout_type *layout;
+    SEGMENT::layout_type previous;
+    SEGMENT::layout_type current;
+    bool has_previous;
+};
+
+static void print_usage(const char *name) {
+    fprintf(
+        stderr,
+        "Usage: %s [options] stats-file [stats-file ...]\n"
+        "Options:\n"
+        "  -h  --help          Display this usage information.\n"
+        "  -i  --interval      Seconds between the refreshes (1).\n"
+        "  -n  --count         Exit after the given number of refreshes.\n",
+        name
+    );
+}
+
+static bool map_instance(instance_type &instance) {
+    instance.layout = SEGMENT::attach(instance.path.c_str());
+
+    if (instance.layout) return true;
+
+    if (errno == EPROTO) {
+        fprintf(
+            stderr, "%s: not a statistics file of version %u\n",
+            instance.path.c_str(), unsigned(SEGMENT::VERSION)
+        );
+    }
+    else fprintf(stderr, "%s: %s\n", instance.path.c_str(), strerror(errno));
+
+    return false;
+}
+
+static void print_instances(std::vector<instance_type> &instances) {
+    static constexpr const int WIDTH = 22;
+
+    printf("%-24s", "field");
+
+    for (const instance_type &instance : instances) {
+        pid_t pid = pid_t(instance.layout->header.pid);
+        bool alive = kill(pid, 0) == 0 || errno == EPERM;
+        char title[WIDTH + 1];
+
+        snprintf(
+            title, sizeof(title), "pid %d%s", int(pid), alive ? "" : " (gone)"
+        );
+
+        printf("%*s", WIDTH, title);
+    }
+
+    printf("\n");
+
+    // The fields of the first instance are listed and matched by their names
+    // in the others, so that instances of different builds can be compared.
+
+    const SEGMENT::layout_type *first = instances.front().layout;
+
+    for (size_t i=0; i<first->header.field_count; ++i) {
+        const SEGMENT::field_type &field = first->fields[i];
+
+        printf("%-24.*s", int(SEGMENT::NAME_SIZE), field.name);
+
+        for (const instance_type &instance : instances) {
+            const SEGMENT::layout_type *layout = instance.layout;
+            size_t index = SEGMENT::index_of(layout, field.name);
+
+            char cell[64];
+
+            if (index == SEGMENT::MAX_FIELDS) {
+                snprintf(cell, sizeof(cell), "-");
+            }
+            else if (layout->fields[index].kind == SEGMENT::KIND::COUNTER
+            && instance.has_previous
+            && instance.current.header.published
+             > instance.previous.header.published) {
+                double seconds = double(
+                    instance.current.header.published -
+                    instance.previous.header.published
+                ) / 1000000.0;
+
+                double rate = double(
+                    instance.current.values[index] -
+                    instance.previous.values[index]
+                ) / seconds;
+
+                snprintf(
+                    cell, sizeof(cell), "%llu %.1f/s",
+                    (unsigned long long) instance.current.values[index], rate
+                );
+            }
+            else {
+                snprintf(
+                    cell, sizeof(cell), "%llu",
+                    (unsigned long long) instance.current.values[index]
+                );
+            }
+
+            printf("%*s", WIDTH, cell);
+        }
+
+        printf("\n");
+    }
+}
+
+int main(int argc, char **argv) {
+    unsigned interval = 1;
+    long count = -1;
+
+    static struct option long_options[] = {
+        {"count",       required_argument, 0,        'n' },
+        {"help",        no_argument,       0,        'h' },
+        {"interval",    required_argument, 0,        'i' },
+        {0,             0,                 0,          0 }
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, "hi:n:", long_options, nullptr)) >= 0) {
+        switch (c) {
+            case 'i': interval = unsigned(atoi(optarg)); break;
+            case 'n': count = atol(optarg); break;
+            default : print_usage(argv[0]); return c == 'h' ? 0 : 1;
+        }
+    }
+
+    if (optind >= argc || interval == 0) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    std::vector<instance_type> instances;
+
+    for (int i=optind; i<argc; ++i) {
+        instances.emplace_back();
+        instances.back().path = argv[i];
+        instances.back().has_previous = false;
+
+        if (!map_instance(instances.back())) return 1;
+    }
+
+    bool interactive = isatty(STDOUT_FILENO) && count != 1;
+
+    for (long refresh = 0; count < 0 || refresh < count; ++refresh) {
+        if (refresh > 0) sleep(interval);
+
+        for (instance_type &instance : instances) {
+            if (refresh > 0) {
+                instance.previous = instance.current;
+                instance.has_previous = true;
+            }
+
+            if (!SEGMENT::read(instance.layout, instance.current)) {
+                fprintf(
+                    stderr, "%s: could not take a consistent snapshot\n",
+                    instance.path.c_str()
+                );
+            }
+        }
+
+        if (interactive) printf("\033[H\033[2J");
+        else if (refresh > 0) printf("\n");
+
+        print_instances(instances);
+        fflush(stdout);
+    }
+
+    return 0;
+}
@@ -0,0 +1,153 @@
+// SPDX-License-Identifier: MIT
+// Decodes an event trace dumped by tcpherald into a readable timeline.
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <vector>
+#include <getopt.h>
+
+#include "trace.h"
+
+static void print_usage(const char *name) {
+    fprintf(
+        stderr,
+        "Usage: %s [options] trace-file\n"
+        "Options:\n"
+        "  -a  --absolute      Show monotonic clock time instead of offsets.\n"
+        "  -d  --descriptor    Only show the events of the given descriptor.\n"
+        "  -h  --help          Display this usage information.\n",
+        name
+    );
+}
+
+int main(int argc, char **argv) {
+    bool absolute = false;
+    bool filtered = false;
+    int descriptor = -1;
+
+    static struct option long_options[] = {
+        {"absolute",    no_argument,       0,        'a' },
+        {"descriptor",  required_argument, 0,        'd' },
+        {"help",        no_argument,       0,        'h' },
+        {0,             0,                 0,          0 }
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, "ad:h", long_options, nullptr)) != -1) {
+        switch (c) {
+            case 'a': absolute = true; break;
+            case 'd': filtered = true; descriptor = atoi(optarg); break;
+            default : print_usage(argv[0]); return c == 'h' ? 0 : 1;
+        }
+    }
+
+    if (optind >= argc) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    const char *path = argv[optind];
+    FILE *fp = fopen(path, "rb");
+
+    if (!fp) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return 1;
+    }
+
+    TRACE::header_type header;
+
+    if (fread(&header, sizeof(header), 1, fp) != 1
+    ||  memcmp(header.magic, TRACE::MAGIC, sizeof(header.magic))
+    ||  header.version != TRACE::VERSION
+    ||  header.event_size != sizeof(TRACE::event_type)) {
+        fprintf(
+            stderr, "%s: not a trace of version %u\n", path,
+            unsigned(TRACE::VERSION)
+        );
+        fclose(fp);
+        return 1;
+    }
+
+    std::vector<TRACE::event_type> events(size_t(header.count));
+
+    size_t count = fread(
+        events.data(), sizeof(TRACE::event_type), events.size(), fp
+    );
+
+    fclose(fp);
+
+    if (count != events.size()) {
+        fprintf(stderr, "%s: truncated after %lu events\n", path, count);
+        events.resize(count);
+    }
+
+    // The ticks are converted to nanoseconds by interpolating between the two
+    // calibration points recorded in the header.
+    long double scale = 1.0L;
+
+    if (header.dump_ticks > header.init_ticks) {
+        scale = (
+            (long double) (header.dump_nsec - header.init_nsec) /
+            (long double) (header.dump_ticks - header.init_ticks)
+        );
+    }
+
+    auto to_nsec = [&](uint64_t ticks) {
+        return (long double) header.init_nsec + (
+            ((long double) ticks - (long double) header.init_ticks) * scale
+        );
+    };
+
+    printf(
+        "%llu events, %llu lost before the dump\n",
+        (unsigned long long) events.size(), (unsigned long long) header.lost
+    );
+
+    if (events.empty()) return 0;
+
+    long double origin = absolute ? 0.0L : to_nsec(events.front().time);
+    long double previous = to_nsec(events.front().time);
+
+    for (const TRACE::event_type &event : events) {
+        long double nsec = to_nsec(event.time);
+        long double delta = nsec - previous;
+
+        previous = nsec;
+
+        if (filtered && event.descriptor != descriptor) continue;
+
+        TRACE::TYPE type = TRACE::type_of(event);
+        uint32_t value = TRACE::value_of(event);
+
+        printf(
+            "%16.6Lf %+12.3Lf us  %-8s fd %-6d", (nsec - origin) / 1e9L,
+            delta / 1e3L, TRACE::type_name(type), int(event.descriptor)
+        );
+
+        switch (type) {
+            case TRACE::TYPE::ACCEPT: {
+                printf(" listener %u", value);
+                break;
+            }
+            case TRACE::TYPE::PAIR: {
+                printf(" supply %u", value);
+                break;
+            }
+            case TRACE::TYPE::READ:
+            case TRACE::TYPE::WRITE: {
+                printf(" %u bytes", value);
+                break;
+            }
+            case TRACE::TYPE::AGAIN: {
+                printf(" %s", value ? "writing" : "reading");
+                break;
+            }
+            default: break;
+        }
+
+        printf("\n");
+    }
+
+    return 0;
+}
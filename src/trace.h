@@ -0,0 +1,165 @@
+// SPDX-License-Identifier: MIT
+#ifndef TRACE_H_17_10_2026
+#define TRACE_H_17_10_2026
+
+#include <array>
+#include <algorithm>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <time.h>
+
+class TRACE {
+    // Fixed-size ring of compact binary events. Recording an event stores 16
+    // bytes and never blocks, allocates or formats anything, so the ring can be
+    // kept on at all times and dumped only when something needs explaining.
+    //
+    // On x86 the events are stamped with the time-stamp counter. Since a dump
+    // carries two pairs of matching counter and clock readings, the decoder is
+    // able to convert the counter values to nanoseconds.
+
+    public:
+    static constexpr const char *MAGIC = "TCPHTRCE";
+    static constexpr const uint32_t VERSION = 1;
+    static constexpr const size_t CAPACITY = size_t(1) << 16;
+    static constexpr const uint32_t MAX_VALUE = (uint32_t(1) << 24) - 1;
+
+    static_assert((CAPACITY & (CAPACITY - 1)) == 0, "capacity must be 2^n");
+
+    enum class TYPE : uint8_t {
+        NONE      = 0,
+        ACCEPT    = 1, // value: listening descriptor
+        FREEZE    = 2,
+        UNFREEZE  = 3,
+        PAIR      = 4, // descriptor: demand, value: supply
+        READ      = 5, // value: bytes read
+        WRITE     = 6, // value: bytes written
+        AGAIN     = 7, // value: 0 for reading, 1 for writing
+        CLOSE     = 8,
+        TIMEOUT   = 9,
+        MAX_TYPES = 10
+    };
+
+    struct event_type {
+        uint64_t time;
+        int32_t  descriptor;
+        uint32_t info; // The type in the lowest byte, the value above it.
+    };
+
+    struct header_type {
+        char     magic[8];
+        uint32_t version;
+        uint32_t event_size;
+        uint64_t count;      // Number of events following the header.
+        uint64_t lost;       // Number of events overwritten before the dump.
+        uint64_t init_ticks;
+        uint64_t init_nsec;
+        uint64_t dump_ticks;
+        uint64_t dump_nsec;
+    };
+
+    static_assert(sizeof(event_type) == 16, "unexpected event size");
+    static_assert(sizeof(header_type) == 64, "unexpected header size");
+
+    TRACE()
+    : head      (0)
+    , init_ticks(get_ticks())
+    , init_nsec (get_nsec()) {}
+
+    ~TRACE() {}
+
+    inline void record(TYPE type, int descriptor, uint64_t value =0) {
+        event_type &event = events[size_t(head++) & (CAPACITY - 1)];
+
+        event.time = get_ticks();
+        event.descriptor = int32_t(descriptor);
+        event.info = (
+            uint32_t(value < MAX_VALUE ? value : MAX_VALUE) << 8
+        ) | static_cast<uint8_t>(type);
+    }
+
+    inline void serialize(std::vector<uint8_t> &out) const {
+        uint64_t count = head < CAPACITY ? head : CAPACITY;
+        header_type header{};
+
+        std::memcpy(header.magic, MAGIC, sizeof(header.magic));
+        header.version    = VERSION;
+        header.event_size = uint32_t(sizeof(event_type));
+        header.count      = count;
+        header.lost       = head - count;
+        header.init_ticks = init_ticks;
+        header.init_nsec  = init_nsec;
+        header.dump_ticks = get_ticks();
+        header.dump_nsec  = get_nsec();
+
+        const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&header);
+
+        out.reserve(out.size() + sizeof(header) + count * sizeof(event_type));
+        out.insert(out.end(), bytes, bytes + sizeof(header));
+
+        // The oldest event comes first, so the ring is copied in two parts.
+        size_t first = size_t(head - count) & (CAPACITY - 1);
+        size_t tail = std::min(size_t(count), CAPACITY - first);
+
+        bytes = reinterpret_cast<const uint8_t *>(events.data());
+
+        out.insert(
+            out.end(), bytes + first * sizeof(event_type),
+            bytes + (first + tail) * sizeof(event_type)
+        );
+
+        out.insert(
+            out.end(), bytes,
+            bytes + (size_t(count) - tail) * sizeof(event_type)
+        );
+    }
+
+    static inline TYPE type_of(const event_type &event) {
+        return static_cast<TYPE>(event.info & 0xff);
+    }
+
+    static inline uint32_t value_of(const event_type &event) {
+        return event.info >> 8;
+    }
+
+    static inline const char *type_name(TYPE type) {
+        switch (type) {
+            case TYPE::ACCEPT:   return "accept";
+            case TYPE::FREEZE:   return "freeze";
+            case TYPE::UNFREEZE: return "unfreeze";
+            case TYPE::PAIR:     return "pair";
+            case TYPE::READ:     return "read";
+            case TYPE::WRITE:    return "write";
+            case TYPE::AGAIN:    return "eagain";
+            case TYPE::CLOSE:    return "close";
+            case TYPE::TIMEOUT:  return "timeout";
+            default:             break;
+        }
+
+        return "unknown";
+    }
+
+    static inline uint64_t get_ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __builtin_ia32_rdtsc();
+#else
+        return get_nsec();
+#endif
+    }
+
+    static inline uint64_t get_nsec() {
+        struct timespec ts;
+
+        if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0) return 0;
+
+        return uint64_t(ts.tv_sec) * 1000000000ULL + uint64_t(ts.tv_nsec);
+    }
+
+    private:
+    uint64_t head;
+    uint64_t init_ticks;
+    uint64_t init_nsec;
+    std::array<event_type, CAPACITY> events;
+};
+
+#endif